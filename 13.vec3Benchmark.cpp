@@ -0,0 +1,65 @@
+// Benchmark the Vec3 backends on Sphere::hit, Vec3::reflect and Vec3::refract:
+//   g++ -O2 13.vec3Benchmark.cpp -o vec3Scalar
+//   g++ -O2 -mavx2 -DUSE_SIMD_VEC3 13.vec3Benchmark.cpp -o vec3SIMD
+//   g++ -O2 -msse4.1 -DUSE_FLOAT -DUSE_SIMD_VEC3 13.vec3Benchmark.cpp -o vec3SIMDFloat
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <string>
+#include "tools/ray.h"
+#include "tools/objects/sphere.h"
+#include "tools/util.h"
+
+template<typename Function>
+void benchmark(const std::string& name, int count, int repeat, Function function){
+    Real checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for(int r = 0; r < repeat; ++r){
+        for(int i = 0; i < count; ++i){
+            checksum += function(i);
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(end - start).count();
+    std::cout << name << ": " << seconds * 1e9 / (double(count) * repeat) << "(ns/op)"
+        << ", checksum " << checksum << std::endl;
+}
+
+int main(){
+#ifdef USE_SIMD_VEC3
+    std::string backend = "SIMD";
+#else
+    std::string backend = "scalar";
+#endif
+    std::cout << "Vec3 backend: " << backend << ", Real: "
+        << (sizeof(Real) == sizeof(float) ? "float" : "double") << std::endl;
+
+    const int count = 1 << 16, repeat = 64;
+    std::vector<Ray> rays;
+    std::vector<Sphere> spheres;
+    std::vector<Vec3> normals;
+    for(int i = 0; i < count; ++i){
+        Point3 origin = Vec3::random(-1.0, 1.0) + Vec3(0, 0, 8);
+        Point3 target = Vec3::random(-1.0, 1.0);
+        rays.push_back(Ray(origin, target - origin));
+        spheres.push_back(Sphere(Vec3::random(-1.0, 1.0), randomDouble(0.2, 1.0)));
+        normals.push_back(Vec3::randomVectorPillar(1.0));
+    }
+
+    benchmark("Sphere::hit", count, repeat, [&](int i){
+        HitRecord hitRecord;
+        if(spheres[i].hit(rays[i], &hitRecord, TINY, INF)){
+            return hitRecord.t + hitRecord.normal.x();
+        }
+        return Real(0);
+    });
+    benchmark("Vec3::reflect", count, repeat, [&](int i){
+        return Vec3::reflect(rays[i].direction(), normals[i]).x();
+    });
+    benchmark("Vec3::refract", count, repeat, [&](int i){
+        Vec3 in = normalize(rays[i].direction());
+        Vec3 norm = dot(in, normals[i]) < 0 ? normals[i] : -normals[i];
+        return Vec3::refract(in, norm, 1 / 1.5).y();
+    });
+    return 0;
+}
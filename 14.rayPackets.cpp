@@ -0,0 +1,199 @@
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include "tools/ppmMSAA.h"
+#include "tools/camera.h"
+#include "tools/ray.h"
+#include "tools/rayPacket.h"
+#include "tools/objects/objectList.h"
+#include "tools/objects/bvh.h"
+#include "tools/objects/sphere.h"
+#include "tools/util.h"
+#include "tools/materials/lambertian.h"
+#include "tools/materials/metal.h"
+#include "tools/materials/dielectric.h"
+
+class PixelShader: public PacketPixelCallback{
+public:
+    PixelShader(shared_ptr<Camera> cameraPtr,
+            shared_ptr<ObjectList> objectListPtr, int maxDepth = 50)
+            :cameraPtr(cameraPtr), objectListPtr(objectListPtr), maxDepth(maxDepth){}
+    virtual ~PixelShader(){}
+    virtual RGB operator()(double x, double y){
+        Ray ray = cameraPtr->getRayXY(x, y);
+        return shadeByDepth(ray, maxDepth);
+    }
+    // Camera rays of a pinhole camera are traced as one packet,
+    // the bounces after the first hit are traced one by one.
+    virtual void operator()(const double* x, const double* y, int n, RGB* colors){
+        if(!cameraPtr->isPinhole()){
+            for(int i = 0; i < n; ++i){
+                colors[i] = (*this)(x[i], y[i]);
+            }
+            return;
+        }
+        RayPacket packet;
+        cameraPtr->getRayPacketXY(x, y, n, packet);
+        objectListPtr->hitPacket(packet, TINY);
+        for(int i = 0; i < n; ++i){
+            HitRecord hitRecord;
+            Ray ray = packet.ray(i);
+            if(objectListPtr->packetHitRecord(packet, i, hitRecord, TINY)){
+                colors[i] = shadeHit(ray, hitRecord, maxDepth);
+            }
+            else{
+                colors[i] = backgroundColor(ray);
+            }
+        }
+    }
+
+protected:
+    RGB backgroundColor(const Ray& r){
+        Vec3 dir = normalize(r.direction());
+        auto t = 0.5 * (dir.y() + 1.0);
+        return interpolate(
+            Color(1.0, 1.0, 1.0),
+            Color(0.5, 0.7, 1.0),
+            t);
+    }
+
+    RGB shadeByDepth(const Ray& ray, int depth){
+        if(depth <= 0){
+            return RGB();
+        }
+        HitRecord hitRecord;
+        if(objectListPtr->hit(ray, &hitRecord, TINY, INF)){
+            return shadeHit(ray, hitRecord, depth);
+        }
+        return backgroundColor(ray);
+    }
+
+    RGB shadeHit(const Ray& ray, const HitRecord& hitRecord, int depth){
+        Ray scattered;
+        RGB attenuation;
+        if(hitRecord.matPtr &&
+                hitRecord.matPtr->scatter(ray, hitRecord, attenuation, scattered)){
+            return attenuation * shadeByDepth(scattered, depth - 1);
+        }
+        return RGB();
+    }
+
+    shared_ptr<Camera> cameraPtr;
+    shared_ptr<ObjectList> objectListPtr;
+    int maxDepth;
+};
+
+shared_ptr<ObjectList> randomScene(){
+    auto worldPtr = make_shared<ObjectList>();
+    worldPtr->add(make_shared<Sphere>(
+        Point3(0,-1000,0), 1000, make_shared<Lambertian>(RGB(0.5, 0.5, 0.5)*PI)));
+
+    auto albedoGlass = RGB(1.0, 1.0, 1.0)*PI;
+    Real fuzzGlass = 0.0;
+    for(int a = -11; a < 11; ++a){
+        for(int b = -11; b < 11; ++b){
+            auto chooseMat = randomDouble();
+            Point3 center(a + 0.9 * randomDouble(), 0.2, b + 0.9 * randomDouble());
+            if((center - Vec3(4, 0.2, 0)).length() > 0.9){
+                if(chooseMat < 0.8){
+                    //diffuse
+                    auto albedo = RGB::random() * RGB::random() * PI;
+                    worldPtr->add(make_shared<Sphere>(
+                        center, 0.2,
+                        make_shared<Lambertian>(albedo)));
+                }
+                else if(chooseMat < 0.95){
+                    //metal
+                    auto albedo = RGB::random(0.5, 1.0) * PI;
+                    auto fuzz = randomDouble(0, 0.5);
+                    worldPtr->add(make_shared<Sphere>(
+                        center, 0.2,
+                        make_shared<Metal>(albedo, fuzz)));
+                }
+                else{
+                    //dielectric
+                    worldPtr->add(make_shared<Sphere>(
+                        center, 0.2,
+                        make_shared<Dielectric>(albedoGlass, fuzzGlass, 1.5)));
+                }
+            }
+        }
+    }
+    worldPtr->add(make_shared<Sphere>(
+        Point3(0, 1, 0), 1.0,
+        make_shared<Dielectric>(albedoGlass, fuzzGlass, 1.5)));
+    worldPtr->add(make_shared<Sphere>(
+        Point3(-4, 1, 0), 1.0,
+        make_shared<Lambertian>(RGB(0.4, 0.2, 0.1)*PI)));
+    worldPtr->add(make_shared<Sphere>(
+        Point3(4, 1, 0), 1.0,
+        make_shared<Metal>(RGB(0.7, 0.6, 0.5)*PI)));
+    return worldPtr;
+}
+
+// Trace the camera rays of every pixel once, packetSize 1 means one by one.
+double tracePrimary(ObjectList& world, const Camera& camera, int width, int height, int packetSize, int& hits){
+    int blockWidth = packetSize >= 8 ? 4 : packetSize >= 4 ? 2 : 1;
+    int blockHeight = packetSize / blockWidth;
+    double x[MAX_PACKET_SIZE], y[MAX_PACKET_SIZE];
+    RayPacket packet;
+    hits = 0;
+    auto start = std::chrono::steady_clock::now();
+    for(int h0 = 0; h0 < height; h0 += blockHeight){
+        for(int w0 = 0; w0 < width; w0 += blockWidth){
+            int n = 0;
+            for(int h = h0; h < h0 + blockHeight && h < height; ++h){
+                for(int w = w0; w < w0 + blockWidth && w < width; ++w){
+                    x[n] = double(w) / (width - 1) * 2 - 1;
+                    y[n] = double(h) / (height - 1) * 2 - 1;
+                    ++n;
+                }
+            }
+            if(packetSize == 1){
+                hits += world.hit(camera.getRayXY(x[0], y[0]), nullptr, TINY, INF);
+                continue;
+            }
+            camera.getRayPacketXY(x, y, n, packet);
+            world.hitPacket(packet, TINY);
+            for(int i = 0; i < n; ++i){
+                hits += packet.hitIndex[i] >= 0;
+            }
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+int main(){
+    const auto aspectRatio = 16.0/9.0;
+    const int imageWidth = 480;
+    const int imageHeight = static_cast<int>(imageWidth / aspectRatio);
+
+    auto listPtr = randomScene();
+    auto worldPtr = make_shared<BVH>(*listPtr);
+
+    Point3 pos(13,2,3);
+    Point3 lookAt(0,0,0);
+    Vec3 up(0,1,0);
+    Real vfov = 20.0;
+    // Pinhole camera, so camera rays can be traced as packets.
+    auto cameraPtr =
+        make_shared<Camera>(pos, lookAt, up, vfov, aspectRatio);
+
+    int packetSizes[] = {1, 4, 8, 16};
+    for(int packetSize: packetSizes){
+        int hits;
+        double seconds = tracePrimary(*worldPtr, *cameraPtr, imageWidth, imageHeight, packetSize, hits);
+        std::cout << "Camera rays, packet size " << packetSize << ": "
+            << seconds * 1000 << "(ms), " << hits << " hits." << std::endl;
+    }
+
+    PixelShader pixelShader(cameraPtr, worldPtr, 48);
+    PPMMSAA ppm(imageWidth, imageHeight, 16, 0.5);
+    auto start = std::chrono::steady_clock::now();
+    ppm.shadePerPacket(&pixelShader, 16);
+    auto end = std::chrono::steady_clock::now();
+    std::cout << "Shading used time " << std::chrono::duration<double>(end - start).count() << "(s)." << std::endl;
+    ppm.writeFile("pictures/rayPackets.ppm", false, GAMMA);
+    return 0;
+}
@@ -0,0 +1,187 @@
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <vector>
+#include "tools/ppmMSAA.h"
+#include "tools/camera.h"
+#include "tools/ray.h"
+#include "tools/objects/objectList.h"
+#include "tools/objects/bvh.h"
+#include "tools/objects/sphere.h"
+#include "tools/objects/triangle.h"
+#include "tools/util.h"
+#include "tools/materials/lambertian.h"
+#include "tools/materials/metal.h"
+#include "tools/materials/dielectric.h"
+#include "tools/materials/diffuseLight.h"
+
+class PixelShader: public PixelCallback{
+public:
+    PixelShader(shared_ptr<Camera> cameraPtr,
+            shared_ptr<ObjectList> objectListPtr, int maxDepth = 50)
+            :cameraPtr(cameraPtr), objectListPtr(objectListPtr), maxDepth(maxDepth), mode(0){
+        lights = objectListPtr->emissiveObjects();
+    }
+    // 0: paths find the lights by chance, 1: next-event estimation
+    void switchMode(int mode){ this->mode = mode; }
+    virtual ~PixelShader(){}
+    virtual RGB operator()(double x, double y){
+        Ray ray = cameraPtr->getRayXY(x, y);
+        if(mode == 0){
+            return shadeByDepth(ray, maxDepth);
+        }
+        return shadeNextEvent(ray, maxDepth, true);
+    }
+
+protected:
+    RGB backgroundColor(const Ray& r){
+        return RGB(0.01, 0.01, 0.02);
+    }
+
+    RGB shadeByDepth(const Ray& ray, int depth){
+        if(depth <= 0){
+            return RGB();
+        }
+        HitRecord hitRecord;
+        if(objectListPtr->hit(ray, &hitRecord, TINY, INF)){
+            if(!hitRecord.matPtr){
+                return RGB();
+            }
+            RGB emitted = hitRecord.matPtr->emitted(hitRecord);
+            Ray scattered;
+            RGB attenuation;
+            if(hitRecord.matPtr->scatter(ray, hitRecord, attenuation, scattered)){
+                return emitted + attenuation * shadeByDepth(scattered, depth - 1);
+            }
+            return emitted;
+        }
+        return backgroundColor(ray);
+    }
+
+    // Diffuse hits sample one light with a shadow ray. The emission found by
+    // the following bounce is skipped then, since the light sample covers it.
+    RGB shadeNextEvent(const Ray& ray, int depth, bool countEmitted){
+        if(depth <= 0){
+            return RGB();
+        }
+        HitRecord hitRecord;
+        if(objectListPtr->hit(ray, &hitRecord, TINY, INF)){
+            if(!hitRecord.matPtr){
+                return RGB();
+            }
+            RGB color = countEmitted ? hitRecord.matPtr->emitted(hitRecord) : RGB();
+            bool diffuse = hitRecord.matPtr->isDiffuse();
+            if(diffuse){
+                color += directLight(ray, hitRecord);
+            }
+            Ray scattered;
+            RGB attenuation;
+            if(hitRecord.matPtr->scatter(ray, hitRecord, attenuation, scattered)){
+                color += attenuation * shadeNextEvent(scattered, depth - 1, !diffuse);
+            }
+            return color;
+        }
+        return backgroundColor(ray);
+    }
+
+    RGB directLight(const Ray& ray, const HitRecord& hitRecord){
+        if(lights.empty()){
+            return RGB();
+        }
+        int n = static_cast<int>(lights.size());
+        int k = std::min(static_cast<int>(randomDouble() * n), n - 1);
+        Vec3 dir;
+        HitRecord lightRecord;
+        Real pdf;
+        if(!lights[k]->sampleDirection(hitRecord.pos, dir, lightRecord, pdf) || pdf <= 0){
+            return RGB();
+        }
+        RGB value = hitRecord.matPtr->scatterValue(hitRecord, -ray.direction(), dir);
+        RGB emitted = lightRecord.matPtr->emitted(lightRecord);
+        if(dot(value, value) <= 0 || dot(emitted, emitted) <= 0){
+            return RGB();
+        }
+        // Stop the shadow ray just before the light itself.
+        Ray shadowRay(offsetRayOrigin(hitRecord.pos, hitRecord.normal, dir), dir);
+        if(objectListPtr->occluded(shadowRay, TINY, lightRecord.t * (1 - 1e-3))){
+            return RGB();
+        }
+        return Real(n) / pdf * value * emitted;
+    }
+
+    shared_ptr<Camera> cameraPtr;
+    shared_ptr<ObjectList> objectListPtr;
+    std::vector<shared_ptr<Object> > lights;
+    int maxDepth, mode;
+};
+
+shared_ptr<ObjectList> lightScene(){
+    auto worldPtr = make_shared<ObjectList>();
+    worldPtr->add(make_shared<Sphere>(
+        Point3(0,-1000,0), 1000, make_shared<Lambertian>(RGB(0.5, 0.5, 0.5)*PI)));
+    worldPtr->add(make_shared<Sphere>(
+        Point3(0, 1, 0), 1.0,
+        make_shared<Dielectric>(RGB(1.0, 1.0, 1.0)*PI, 0.0, 1.5)));
+    worldPtr->add(make_shared<Sphere>(
+        Point3(-4, 1, 0), 1.0,
+        make_shared<Lambertian>(RGB(0.4, 0.2, 0.1)*PI)));
+    worldPtr->add(make_shared<Sphere>(
+        Point3(4, 1, 0), 1.0,
+        make_shared<Metal>(RGB(0.7, 0.6, 0.5)*PI)));
+    for(int a = -4; a <= 4; ++a){
+        worldPtr->add(make_shared<Sphere>(
+            Point3(a, 0.2, 2.5), 0.2,
+            make_shared<Lambertian>(RGB::random(0.2, 0.9)*PI)));
+    }
+    // A small bright sphere light.
+    worldPtr->add(make_shared<Sphere>(
+        Point3(2, 2.5, 2), 0.1,
+        make_shared<DiffuseLight>(RGB(400, 300, 200))));
+    // A quad light facing down.
+    auto quadLight = make_shared<DiffuseLight>(RGB(6, 6, 8));
+    Point3 a(-3, 4, -1), b(-1, 4, -1), c(-1, 4, 1), d(-3, 4, 1);
+    worldPtr->add(make_shared<Triangle>(a, b, c, quadLight));
+    worldPtr->add(make_shared<Triangle>(a, c, d, quadLight));
+    return worldPtr;
+}
+
+RGB averageColor(const PPM& ppm){
+    RGB sum;
+    for(int h = 0; h < ppm.imageHeight(); ++h){
+        for(int w = 0; w < ppm.imageWidth(); ++w){
+            sum += ppm.pixel(h, w);
+        }
+    }
+    return sum / (ppm.imageWidth() * ppm.imageHeight());
+}
+
+int main(){
+    const auto aspectRatio = 16.0/9.0;
+    const int imageWidth = 480;
+    const int imageHeight = static_cast<int>(imageWidth / aspectRatio);
+    const int nSample = 16;
+
+    auto worldPtr = make_shared<BVH>(*lightScene());
+
+    Point3 pos(13,2,3);
+    Point3 lookAt(0,0,0);
+    Vec3 up(0,1,0);
+    Real vfov = 20.0;
+    auto cameraPtr =
+        make_shared<Camera>(pos, lookAt, up, vfov, aspectRatio);
+    PixelShader pixelShader(cameraPtr, worldPtr, 16);
+
+    const char* names[] = {"pictures/lightsPathOnly.ppm", "pictures/lightsNextEvent.ppm"};
+    for(int mode = 0; mode < 2; ++mode){
+        pixelShader.switchMode(mode);
+        PPMMSAA ppm(imageWidth, imageHeight, nSample, 0.5);
+        auto start = std::chrono::steady_clock::now();
+        ppm.shadePerPixel(&pixelShader, false);
+        auto end = std::chrono::steady_clock::now();
+        std::cout << (mode == 0 ? "Path only" : "Next-event estimation") << ": "
+            << std::chrono::duration<double>(end - start).count() << "(s), average color "
+            << averageColor(ppm) << std::endl;
+        ppm.writeFile(names[mode], false, HDR, 1.0);
+    }
+    return 0;
+}
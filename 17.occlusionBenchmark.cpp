@@ -0,0 +1,151 @@
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <vector>
+#include <string>
+#include "tools/ppm.h"
+#include "tools/camera.h"
+#include "tools/ray.h"
+#include "tools/objects/objectList.h"
+#include "tools/objects/bvh.h"
+#include "tools/objects/sphere.h"
+#include "tools/util.h"
+#include "tools/materials/lambertian.h"
+#include "tools/materials/metal.h"
+#include "tools/materials/dielectric.h"
+
+// Ambient occlusion rays from the first hit of every camera ray.
+struct VisibilityRays{
+    std::vector<Ray> rays;
+    std::vector<int> pixel;
+};
+
+shared_ptr<ObjectList> randomScene(){
+    auto worldPtr = make_shared<ObjectList>();
+    worldPtr->add(make_shared<Sphere>(
+        Point3(0,-1000,0), 1000, make_shared<Lambertian>(RGB(0.5, 0.5, 0.5)*PI)));
+
+    auto albedoGlass = RGB(1.0, 1.0, 1.0)*PI;
+    Real fuzzGlass = 0.0;
+    for(int a = -11; a < 11; ++a){
+        for(int b = -11; b < 11; ++b){
+            auto chooseMat = randomDouble();
+            Point3 center(a + 0.9 * randomDouble(), 0.2, b + 0.9 * randomDouble());
+            if((center - Vec3(4, 0.2, 0)).length() > 0.9){
+                if(chooseMat < 0.8){
+                    //diffuse
+                    auto albedo = RGB::random() * RGB::random() * PI;
+                    worldPtr->add(make_shared<Sphere>(
+                        center, 0.2,
+                        make_shared<Lambertian>(albedo)));
+                }
+                else if(chooseMat < 0.95){
+                    //metal
+                    auto albedo = RGB::random(0.5, 1.0) * PI;
+                    auto fuzz = randomDouble(0, 0.5);
+                    worldPtr->add(make_shared<Sphere>(
+                        center, 0.2,
+                        make_shared<Metal>(albedo, fuzz)));
+                }
+                else{
+                    //dielectric
+                    worldPtr->add(make_shared<Sphere>(
+                        center, 0.2,
+                        make_shared<Dielectric>(albedoGlass, fuzzGlass, 1.5)));
+                }
+            }
+        }
+    }
+    worldPtr->add(make_shared<Sphere>(
+        Point3(0, 1, 0), 1.0,
+        make_shared<Dielectric>(albedoGlass, fuzzGlass, 1.5)));
+    worldPtr->add(make_shared<Sphere>(
+        Point3(-4, 1, 0), 1.0,
+        make_shared<Lambertian>(RGB(0.4, 0.2, 0.1)*PI)));
+    worldPtr->add(make_shared<Sphere>(
+        Point3(4, 1, 0), 1.0,
+        make_shared<Metal>(RGB(0.7, 0.6, 0.5)*PI)));
+    return worldPtr;
+}
+
+VisibilityRays ambientOcclusionRays(ObjectList& world, const Camera& camera,
+        int width, int height, int raysPerPixel, Real distance){
+    VisibilityRays visibilityRays;
+    for(int h = 0; h < height; ++h){
+        for(int w = 0; w < width; ++w){
+            Ray ray = camera.getRayXY(double(w) / (width - 1) * 2 - 1, double(h) / (height - 1) * 2 - 1);
+            HitRecord hitRecord;
+            if(!world.hit(ray, &hitRecord, TINY, INF)){
+                continue;
+            }
+            for(int i = 0; i < raysPerPixel; ++i){
+                Vec3 dir = Vec3::randomVectorHemisphere(distance, hitRecord.normal);
+                visibilityRays.rays.push_back(Ray(offsetRayOrigin(hitRecord.pos, hitRecord.normal, dir), dir));
+                visibilityRays.pixel.push_back(h * width + w);
+            }
+        }
+    }
+    return visibilityRays;
+}
+
+// Trace every ray up to t = 1 (the AO distance), returns the seconds used.
+double traceVisibility(ObjectList& world, const VisibilityRays& visibilityRays, bool anyHit, std::vector<int>& occluded){
+    occluded.assign(occluded.size(), 0);
+    HitRecord hitRecord;
+    auto start = std::chrono::steady_clock::now();
+    for(std::size_t i = 0; i < visibilityRays.rays.size(); ++i){
+        bool blocked = anyHit ? world.occluded(visibilityRays.rays[i], TINY, 1) :
+            world.hit(visibilityRays.rays[i], &hitRecord, TINY, 1);
+        occluded[visibilityRays.pixel[i]] += blocked;
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+int main(){
+    const auto aspectRatio = 16.0/9.0;
+    const int imageWidth = 240;
+    const int imageHeight = static_cast<int>(imageWidth / aspectRatio);
+    const int raysPerPixel = 16;
+
+    auto listPtr = randomScene();
+    auto bvhPtr = make_shared<BVH>(*listPtr);
+
+    Point3 pos(13,2,3);
+    Point3 lookAt(0,0,0);
+    Vec3 up(0,1,0);
+    Real vfov = 20.0;
+    Camera camera(pos, lookAt, up, vfov, aspectRatio);
+
+    VisibilityRays visibilityRays = ambientOcclusionRays(*bvhPtr, camera, imageWidth, imageHeight, raysPerPixel, 1.0);
+    std::cout << visibilityRays.rays.size() << " ambient occlusion rays." << std::endl;
+
+    std::vector<int> occluded(imageWidth * imageHeight);
+    ObjectList* worlds[] = {listPtr.get(), bvhPtr.get()};
+    const char* worldNames[] = {"ObjectList", "BVH"};
+    for(int k = 0; k < 2; ++k){
+        double closestSeconds = traceVisibility(*worlds[k], visibilityRays, false, occluded);
+        long long closestCount = 0;
+        for(int count: occluded){
+            closestCount += count;
+        }
+        double anySeconds = traceVisibility(*worlds[k], visibilityRays, true, occluded);
+        long long anyCount = 0;
+        for(int count: occluded){
+            anyCount += count;
+        }
+        std::cout << worldNames[k] << ": closest hit " << closestSeconds * 1000 << "(ms), "
+            << "occluded " << anySeconds * 1000 << "(ms), speedup " << closestSeconds / anySeconds
+            << ", blocked " << closestCount << '/' << anyCount << std::endl;
+    }
+
+    std::ofstream out("pictures/ambientOcclusion.ppm");
+    out << "P3\n" << imageWidth << ' ' << imageHeight << "\n255\n";
+    for(int h = imageHeight - 1; h >= 0; --h){
+        for(int w = 0; w < imageWidth; ++w){
+            Real visible = 1 - Real(occluded[h * imageWidth + w]) / raysPerPixel;
+            writeRGB(out, RGB(visible, visible, visible), false);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,186 @@
+// Usage: environmentLight [map.hdr]
+// Without an argument a procedural sky with a sun is written to
+// pictures/proceduralSky.hdr and used.
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <vector>
+#include <string>
+#include "tools/ppmMSAA.h"
+#include "tools/camera.h"
+#include "tools/ray.h"
+#include "tools/environment.h"
+#include "tools/objects/objectList.h"
+#include "tools/objects/bvh.h"
+#include "tools/objects/sphere.h"
+#include "tools/util.h"
+#include "tools/materials/lambertian.h"
+#include "tools/materials/metal.h"
+#include "tools/materials/dielectric.h"
+
+class PixelShader: public PixelCallback{
+public:
+    PixelShader(shared_ptr<Camera> cameraPtr,
+            shared_ptr<ObjectList> objectListPtr,
+            shared_ptr<EnvironmentMap> environmentPtr, int maxDepth = 50)
+            :cameraPtr(cameraPtr), objectListPtr(objectListPtr),
+            environmentPtr(environmentPtr), maxDepth(maxDepth), mode(0){}
+    // 0: paths find the environment by chance, 1: the environment is importance-sampled
+    void switchMode(int mode){ this->mode = mode; }
+    virtual ~PixelShader(){}
+    virtual RGB operator()(double x, double y){
+        Ray ray = cameraPtr->getRayXY(x, y);
+        return shadeByDepth(ray, maxDepth, true);
+    }
+
+protected:
+    RGB backgroundColor(const Ray& r){
+        return environmentPtr->lookup(r.direction());
+    }
+
+    RGB shadeByDepth(const Ray& ray, int depth, bool countBackground){
+        if(depth <= 0){
+            return RGB();
+        }
+        HitRecord hitRecord;
+        if(objectListPtr->hit(ray, &hitRecord, TINY, INF)){
+            if(!hitRecord.matPtr){
+                return RGB();
+            }
+            RGB color;
+            bool sampled = mode == 1 && hitRecord.matPtr->isDiffuse();
+            if(sampled){
+                color += environmentLight(ray, hitRecord);
+            }
+            Ray scattered;
+            RGB attenuation;
+            if(hitRecord.matPtr->scatter(ray, hitRecord, attenuation, scattered)){
+                color += attenuation * shadeByDepth(scattered, depth - 1, !sampled);
+            }
+            return color;
+        }
+        return countBackground ? backgroundColor(ray) : RGB();
+    }
+
+    RGB environmentLight(const Ray& ray, const HitRecord& hitRecord){
+        Real pdf;
+        Vec3 dir = environmentPtr->sample(pdf);
+        if(pdf <= 0){
+            return RGB();
+        }
+        RGB value = hitRecord.matPtr->scatterValue(hitRecord, -ray.direction(), dir);
+        if(dot(value, value) <= 0){
+            return RGB();
+        }
+        Ray shadowRay(offsetRayOrigin(hitRecord.pos, hitRecord.normal, dir), dir);
+        if(objectListPtr->occluded(shadowRay, TINY, INF)){
+            return RGB();
+        }
+        return value * environmentPtr->lookup(dir) / pdf;
+    }
+
+    shared_ptr<Camera> cameraPtr;
+    shared_ptr<ObjectList> objectListPtr;
+    shared_ptr<EnvironmentMap> environmentPtr;
+    int maxDepth, mode;
+};
+
+// Sky gradient with a small sun 100 times as bright as the sky.
+bool writeProceduralSky(const std::string& fname, int width, int height){
+    Vec3 sun = normalize(Vec3(1, 0.6, 0.5));
+    Real cosSun = std::cos(degrees2radians(1.5));
+    std::vector<float> rgb(3 * width * height);
+    for(int v = 0; v < height; ++v){
+        for(int u = 0; u < width; ++u){
+            Real theta = (v + 0.5) / height * PI, phi = (u + 0.5) / width * 2 * PI;
+            Vec3 dir(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+            RGB color = dir.y() > 0 ?
+                interpolate(Color(1.0, 1.0, 1.0), Color(0.5, 0.7, 1.0), dir.y()) :
+                Color(0.3, 0.25, 0.2);
+            if(dot(dir, sun) > cosSun){
+                color = Color(100.0, 90.0, 70.0);
+            }
+            for(int c = 0; c < 3; ++c){
+                rgb[3 * (v * width + u) + c] = static_cast<float>(color[c]);
+            }
+        }
+    }
+    return writeHDRImage(fname, rgb.data(), width, height);
+}
+
+shared_ptr<ObjectList> smallScene(){
+    auto worldPtr = make_shared<ObjectList>();
+    worldPtr->add(make_shared<Sphere>(
+        Point3(0,-1000,0), 1000, make_shared<Lambertian>(RGB(0.5, 0.5, 0.5)*PI)));
+    worldPtr->add(make_shared<Sphere>(
+        Point3(0, 1, 0), 1.0,
+        make_shared<Dielectric>(RGB(1.0, 1.0, 1.0)*PI, 0.0, 1.5)));
+    worldPtr->add(make_shared<Sphere>(
+        Point3(-4, 1, 0), 1.0,
+        make_shared<Lambertian>(RGB(0.4, 0.2, 0.1)*PI)));
+    worldPtr->add(make_shared<Sphere>(
+        Point3(4, 1, 0), 1.0,
+        make_shared<Metal>(RGB(0.7, 0.6, 0.5)*PI)));
+    for(int a = -4; a <= 4; ++a){
+        worldPtr->add(make_shared<Sphere>(
+            Point3(a, 0.2, 2.5), 0.2,
+            make_shared<Lambertian>(RGB::random(0.2, 0.9)*PI)));
+    }
+    return worldPtr;
+}
+
+RGB averageColor(const PPM& ppm){
+    RGB sum;
+    for(int h = 0; h < ppm.imageHeight(); ++h){
+        for(int w = 0; w < ppm.imageWidth(); ++w){
+            sum += ppm.pixel(h, w);
+        }
+    }
+    return sum / (ppm.imageWidth() * ppm.imageHeight());
+}
+
+int main(int argc, char** argv){
+    std::string mapName = "pictures/proceduralSky.hdr";
+    if(argc > 1){
+        mapName = argv[1];
+    }
+    else if(!writeProceduralSky(mapName, 1024, 512)){
+        std::cerr << "Cannot write " << mapName << std::endl;
+        return 1;
+    }
+    auto environmentPtr = make_shared<EnvironmentMap>();
+    if(!environmentPtr->load(mapName)){
+        std::cerr << "Cannot load " << mapName << ": " << stbi_failure_reason() << std::endl;
+        return 1;
+    }
+    std::cout << "Environment " << environmentPtr->imageWidth() << 'x' << environmentPtr->imageHeight() << std::endl;
+
+    const auto aspectRatio = 16.0/9.0;
+    const int imageWidth = 480;
+    const int imageHeight = static_cast<int>(imageWidth / aspectRatio);
+    const int nSample = 16;
+
+    auto worldPtr = make_shared<BVH>(*smallScene());
+
+    Point3 pos(13,2,3);
+    Point3 lookAt(0,0,0);
+    Vec3 up(0,1,0);
+    Real vfov = 20.0;
+    auto cameraPtr =
+        make_shared<Camera>(pos, lookAt, up, vfov, aspectRatio);
+    PixelShader pixelShader(cameraPtr, worldPtr, environmentPtr, 16);
+
+    const char* names[] = {"pictures/environmentPathOnly.ppm", "pictures/environmentSampled.ppm"};
+    for(int mode = 0; mode < 2; ++mode){
+        pixelShader.switchMode(mode);
+        PPMMSAA ppm(imageWidth, imageHeight, nSample, 0.5);
+        auto start = std::chrono::steady_clock::now();
+        ppm.shadePerPixel(&pixelShader, false);
+        auto end = std::chrono::steady_clock::now();
+        std::cout << (mode == 0 ? "Path only" : "Importance-sampled environment") << ": "
+            << std::chrono::duration<double>(end - start).count() << "(s), average color "
+            << averageColor(ppm) << std::endl;
+        ppm.writeFile(names[mode], false, HDR, 0.5);
+    }
+    return 0;
+}
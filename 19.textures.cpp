@@ -0,0 +1,228 @@
+// Usage: textures [ground image] [sphere image]
+// Without arguments two procedural images are written to pictures/ first.
+// Tiled mip files are written next to the images.
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <vector>
+#include <string>
+#include "tools/ppmMSAA.h"
+#include "tools/ppmWavefront.h"
+#include "tools/camera.h"
+#include "tools/ray.h"
+#include "tools/objects/objectList.h"
+#include "tools/objects/bvh.h"
+#include "tools/objects/sphere.h"
+#include "tools/objects/triangle.h"
+#include "tools/util.h"
+#include "tools/materials/lambertian.h"
+#include "tools/materials/metal.h"
+#include "tools/materials/dielectric.h"
+#include "tools/textures/imageTexture.h"
+
+class PixelShader: public PixelCallback{
+public:
+    PixelShader(shared_ptr<Camera> cameraPtr,
+            shared_ptr<ObjectList> objectListPtr, Real dx, Real dy, int maxDepth = 50)
+            :cameraPtr(cameraPtr), objectListPtr(objectListPtr), dx(dx), dy(dy),
+            maxDepth(maxDepth), useDifferentials(true){}
+    // Without differentials every lookup goes to the finest mip level.
+    void switchDifferentials(bool useDifferentials){ this->useDifferentials = useDifferentials; }
+    virtual ~PixelShader(){}
+    virtual RGB operator()(double x, double y){
+        RayDifferential ray = cameraPtr->getRayDifferentialXY(x, y, dx, dy);
+        ray.hasDifferentials = useDifferentials;
+        return shadeByDepth(ray, maxDepth);
+    }
+
+protected:
+    RGB backgroundColor(const Ray& r){
+        Vec3 unitDir = normalize(r.direction());
+        Real t = 0.5 * (unitDir.y() + 1.0);
+        return interpolate(Color(1.0, 1.0, 1.0), Color(0.5, 0.7, 1.0), t);
+    }
+
+    // Only camera rays carry differentials, scattered rays use the finest level.
+    RGB shadeByDepth(const RayDifferential& ray, int depth){
+        if(depth <= 0){
+            return RGB();
+        }
+        HitRecord hitRecord;
+        if(objectListPtr->hit(ray, &hitRecord, TINY, INF)){
+            if(!hitRecord.matPtr){
+                return RGB();
+            }
+            hitRecord.computeDifferentials(ray);
+            Ray scattered;
+            RGB attenuation;
+            if(hitRecord.matPtr->scatter(ray, hitRecord, attenuation, scattered)){
+                return attenuation * shadeByDepth(RayDifferential(scattered), depth - 1);
+            }
+            return RGB();
+        }
+        return backgroundColor(ray);
+    }
+
+    shared_ptr<Camera> cameraPtr;
+    shared_ptr<ObjectList> objectListPtr;
+    Real dx, dy;
+    int maxDepth;
+    bool useDifferentials;
+};
+
+// Binary PPM, which stb_image reads.
+bool writeP6(const std::string& fname, const std::vector<unsigned char>& rgb, int width, int height){
+    std::ofstream out(fname.c_str(), std::ios::binary);
+    out << "P6\n" << width << ' ' << height << "\n255\n";
+    out.write(reinterpret_cast<const char*>(rgb.data()), rgb.size());
+    return out.good();
+}
+
+// Fine lines over a checkerboard, which aliases badly without mip-mapping.
+bool writeCheckerImage(const std::string& fname, int size){
+    std::vector<unsigned char> rgb(3 * size * size);
+    for(int y = 0; y < size; ++y){
+        for(int x = 0; x < size; ++x){
+            bool dark = ((x * 8 / size) + (y * 8 / size)) % 2;
+            bool line = x % 16 == 0 || y % 16 == 0;
+            unsigned char* c = &rgb[3 * (y * size + x)];
+            c[0] = line ? 20 : dark ? 60 : 230;
+            c[1] = line ? 20 : dark ? 90 : 220;
+            c[2] = line ? 20 : dark ? 140 : 200;
+        }
+    }
+    return writeP6(fname, rgb, size, size);
+}
+
+// Bands of latitude with a wavy pattern, laid out for spheres.
+bool writeBandImage(const std::string& fname, int width, int height){
+    std::vector<unsigned char> rgb(3 * width * height);
+    for(int y = 0; y < height; ++y){
+        for(int x = 0; x < width; ++x){
+            Real u = Real(x) / width, v = Real(y) / height;
+            Real band = 0.5 + 0.5 * std::sin(40 * v + 3 * std::sin(12 * PI * u));
+            unsigned char* c = &rgb[3 * (y * width + x)];
+            c[0] = static_cast<unsigned char>(255 * (0.9 * band + 0.1));
+            c[1] = static_cast<unsigned char>(255 * (0.5 * band + 0.2));
+            c[2] = static_cast<unsigned char>(255 * (0.2 * (1 - band) + 0.1));
+        }
+    }
+    return writeP6(fname, rgb, width, height);
+}
+
+// Largest difference between the mean colors of 16x16 pixel blocks of two
+// renders, relative to the brighter of the two blocks.
+Real largestBlockDifference(const PPM& a, const PPM& b){
+    const int block = 16;
+    Real largest = 0;
+    for(int h0 = 0; h0 + block <= a.imageHeight(); h0 += block){
+        for(int w0 = 0; w0 + block <= a.imageWidth(); w0 += block){
+            RGB meanA, meanB;
+            for(int h = h0; h < h0 + block; ++h){
+                for(int w = w0; w < w0 + block; ++w){
+                    meanA += a.pixel(h, w);
+                    meanB += b.pixel(h, w);
+                }
+            }
+            for(int c = 0; c < 3; ++c){
+                Real brighter = std::max(meanA[c], meanB[c]);
+                if(brighter > 0){
+                    largest = std::max(largest, std::fabs(meanA[c] - meanB[c]) / brighter);
+                }
+            }
+        }
+    }
+    return largest;
+}
+
+shared_ptr<ObjectList> textureScene(shared_ptr<TextureCache> cachePtr, int groundId, int sphereId){
+    auto worldPtr = make_shared<ObjectList>();
+    auto groundMaterial = make_shared<Lambertian>(make_shared<ImageTexture>(cachePtr, groundId, 16, 16));
+    Real s = 40;
+    Point3 a(-s, 0, -s), b(s, 0, -s), c(s, 0, s), d(-s, 0, s);
+    worldPtr->add(make_shared<Triangle>(a, c, b, groundMaterial, Vec3(0, 0, 0), Vec3(1, 1, 0), Vec3(1, 0, 0)));
+    worldPtr->add(make_shared<Triangle>(a, d, c, groundMaterial, Vec3(0, 0, 0), Vec3(0, 1, 0), Vec3(1, 1, 0)));
+    auto sphereTexture = make_shared<ImageTexture>(cachePtr, sphereId, 2, 1);
+    worldPtr->add(make_shared<Sphere>(
+        Point3(0, 1, 0), 1.0,
+        make_shared<Dielectric>(RGB(1.0, 1.0, 1.0)*PI, 0.0, 1.5)));
+    worldPtr->add(make_shared<Sphere>(
+        Point3(-4, 1, 0), 1.0, make_shared<Lambertian>(sphereTexture)));
+    worldPtr->add(make_shared<Sphere>(
+        Point3(4, 1, 0), 1.0,
+        make_shared<Metal>(RGB(0.7, 0.6, 0.5)*PI)));
+    for(int i = -4; i <= 4; ++i){
+        worldPtr->add(make_shared<Sphere>(
+            Point3(i, 0.2, 2.5), 0.2, make_shared<Lambertian>(sphereTexture, RGB::random(0.5, 1.0)*PI)));
+    }
+    return worldPtr;
+}
+
+int main(int argc, char** argv){
+    std::string groundName = "pictures/checker.ppm", sphereName = "pictures/bands.ppm";
+    if(argc > 2){
+        groundName = argv[1];
+        sphereName = argv[2];
+    }
+    else if(!writeCheckerImage(groundName, 2048) || !writeBandImage(sphereName, 2048, 1024)){
+        std::cerr << "Cannot write the procedural images" << std::endl;
+        return 1;
+    }
+
+    const auto aspectRatio = 16.0/9.0;
+    const int imageWidth = 480;
+    const int imageHeight = static_cast<int>(imageWidth / aspectRatio);
+    const int nSample = 16;
+
+    Point3 pos(13,2,3);
+    Point3 lookAt(0,0,0);
+    Vec3 up(0,1,0);
+    Real vfov = 20.0;
+    auto cameraPtr =
+        make_shared<Camera>(pos, lookAt, up, vfov, aspectRatio);
+
+    // Budgets in bytes, the last two are far below the size of the textures.
+    const std::size_t budgets[] = {std::size_t(64) << 20, std::size_t(256) << 10, std::size_t(256) << 10};
+    const bool differentials[] = {true, true, false};
+    const char* names[] = {"pictures/textures64MB.ppm", "pictures/textures256KB.ppm", "pictures/texturesNoMip.ppm"};
+    bool agree = true;
+    for(int mode = 0; mode < 3; ++mode){
+        auto cachePtr = make_shared<TextureCache>(budgets[mode]);
+        auto start = std::chrono::steady_clock::now();
+        int groundId = cachePtr->addTexture(groundName), sphereId = cachePtr->addTexture(sphereName);
+        if(groundId < 0 || sphereId < 0){
+            std::cerr << "Cannot load the textures: " << stbi_failure_reason() << std::endl;
+            return 1;
+        }
+        auto loaded = std::chrono::steady_clock::now();
+        if(mode == 0){
+            std::cout << "Tiled mip files ready in " << std::chrono::duration<double>(loaded - start).count() << "(s)" << std::endl;
+        }
+        auto worldPtr = make_shared<BVH>(*textureScene(cachePtr, groundId, sphereId));
+        PixelShader pixelShader(cameraPtr, worldPtr, 2.0 / imageWidth, 2.0 / imageHeight, 16);
+        pixelShader.switchDifferentials(differentials[mode]);
+
+        PPMMSAA ppm(imageWidth, imageHeight, nSample, 0.5);
+        start = std::chrono::steady_clock::now();
+        ppm.shadePerPixel(&pixelShader, false);
+        auto end = std::chrono::steady_clock::now();
+        std::size_t lookups = cachePtr->hitCount() + cachePtr->missCount();
+        std::cout << (budgets[mode] >> 10) << "KB cache, " << (differentials[mode] ? "mip-mapped" : "finest level only") << ": "
+            << std::chrono::duration<double>(end - start).count() << "(s), tile hit rate "
+            << 100.0 * cachePtr->hitCount() / std::max<std::size_t>(lookups, 1) << "%, "
+            << cachePtr->missCount() << " tile reads, peak " << (cachePtr->peakBytes() >> 10) << "KB resident" << std::endl;
+        ppm.writeFile(names[mode], false);
+        if(mode == 0){
+            // The wavefront integrator must see the same texture coordinates
+            // and footprints.
+            PPMWavefront wavefront(imageWidth, imageHeight, nSample, 0.5);
+            wavefront.shadeWavefront(*cameraPtr, *worldPtr, 16, false);
+            wavefront.writeFile("pictures/texturesWavefront.ppm", false);
+            Real difference = largestBlockDifference(ppm, wavefront);
+            agree = difference < 0.1;
+            std::cout << "Wavefront render differs by up to " << 100 * difference << "% in 16x16 blocks"
+                << (agree ? "" : ", too much!") << std::endl;
+        }
+    }
+    return agree ? 0 : 1;
+}
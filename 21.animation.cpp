@@ -0,0 +1,194 @@
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <cstdio>
+#include "tools/ppmMSAA.h"
+#include "tools/camera.h"
+#include "tools/ray.h"
+#include "tools/animation.h"
+#include "tools/objects/objectList.h"
+#include "tools/objects/bvh.h"
+#include "tools/objects/sphere.h"
+#include "tools/objects/instance.h"
+#include "tools/util.h"
+#include "tools/materials/lambertian.h"
+#include "tools/materials/metal.h"
+#include "tools/materials/dielectric.h"
+
+class PixelShader: public PixelCallback{
+public:
+    PixelShader(shared_ptr<Camera> cameraPtr,
+            shared_ptr<ObjectList> objectListPtr, int maxDepth = 50)
+            :cameraPtr(cameraPtr), objectListPtr(objectListPtr), maxDepth(maxDepth){}
+    virtual ~PixelShader(){}
+    virtual RGB operator()(double x, double y){
+        Ray ray = cameraPtr->getRayXY(x, y);
+        return shadeByDepth(ray, maxDepth);
+    }
+
+protected:
+    RGB backgroundColor(const Ray& r){
+        Vec3 dir = normalize(r.direction());
+        auto t = 0.5 * (dir.y() + 1.0);
+        return interpolate(
+            Color(1.0, 1.0, 1.0),
+            Color(0.5, 0.7, 1.0),
+            t);
+    }
+
+    RGB shadeByDepth(const Ray& ray, int depth){
+        if(depth <= 0){
+            return RGB();
+        }
+        HitRecord hitRecord;
+        if(objectListPtr->hit(ray, &hitRecord, TINY, INF)){
+            Ray scattered;
+            RGB attenuation;
+            if(hitRecord.matPtr &&
+                    hitRecord.matPtr->scatter(ray, hitRecord, attenuation, scattered)){
+                return attenuation * shadeByDepth(scattered, depth - 1);
+            }
+            return RGB();
+        }
+        return backgroundColor(ray);
+    }
+
+    shared_ptr<Camera> cameraPtr;
+    shared_ptr<ObjectList> objectListPtr;
+    int maxDepth;
+};
+
+shared_ptr<ObjectList> randomScene(){
+    auto worldPtr = make_shared<ObjectList>();
+    worldPtr->add(make_shared<Sphere>(
+        Point3(0,-1000,0), 1000, make_shared<Lambertian>(RGB(0.5, 0.5, 0.5)*PI)));
+
+    auto albedoGlass = RGB(1.0, 1.0, 1.0)*PI;
+    Real fuzzGlass = 0.0;
+    for(int a = -11; a < 11; ++a){
+        for(int b = -11; b < 11; ++b){
+            auto chooseMat = randomDouble();
+            Point3 center(a + 0.9 * randomDouble(), 0.2, b + 0.9 * randomDouble());
+            if((center - Vec3(4, 0.2, 0)).length() > 0.9){
+                if(chooseMat < 0.8){
+                    //diffuse
+                    auto albedo = RGB::random() * RGB::random() * PI;
+                    worldPtr->add(make_shared<Sphere>(
+                        center, 0.2,
+                        make_shared<Lambertian>(albedo)));
+                }
+                else if(chooseMat < 0.95){
+                    //metal
+                    auto albedo = RGB::random(0.5, 1.0) * PI;
+                    auto fuzz = randomDouble(0, 0.5);
+                    worldPtr->add(make_shared<Sphere>(
+                        center, 0.2,
+                        make_shared<Metal>(albedo, fuzz)));
+                }
+                else{
+                    //dielectric
+                    worldPtr->add(make_shared<Sphere>(
+                        center, 0.2,
+                        make_shared<Dielectric>(albedoGlass, fuzzGlass, 1.5)));
+                }
+            }
+        }
+    }
+    worldPtr->add(make_shared<Sphere>(
+        Point3(0, 1, 0), 1.0,
+        make_shared<Dielectric>(albedoGlass, fuzzGlass, 1.5)));
+    worldPtr->add(make_shared<Sphere>(
+        Point3(-4, 1, 0), 1.0,
+        make_shared<Lambertian>(RGB(0.4, 0.2, 0.1)*PI)));
+    worldPtr->add(make_shared<Sphere>(
+        Point3(4, 1, 0), 1.0,
+        make_shared<Metal>(RGB(0.7, 0.6, 0.5)*PI)));
+    return worldPtr;
+}
+
+// Three spheres in a row, turned and scaled as a whole by its instance.
+shared_ptr<Instance> spinner(){
+    ObjectList parts;
+    parts.add(make_shared<Sphere>(Point3(-1, 0, 0), 0.4, make_shared<Metal>(RGB(0.8, 0.3, 0.3)*PI)));
+    parts.add(make_shared<Sphere>(Point3(0, 0, 0), 0.25, make_shared<Lambertian>(RGB(0.8, 0.8, 0.2)*PI)));
+    parts.add(make_shared<Sphere>(Point3(1, 0, 0), 0.4, make_shared<Metal>(RGB(0.3, 0.3, 0.8)*PI)));
+    return make_shared<Instance>(make_shared<BVH>(parts), Transform());
+}
+
+// A quarter turn around the scene while every fifth small sphere bounces
+// and the spinner above the glass sphere turns, tilts and grows.
+Animation turntable(const ObjectList& world, shared_ptr<Instance> spinnerPtr, Real aspectRatio){
+    Animation animation(Vec3(0, 1, 0), aspectRatio, 0.1, 10.0);
+    Real radius = std::sqrt(13.0*13.0 + 3.0*3.0), start = std::atan2(3.0, 13.0);
+    for(int i = 0; i <= 9; ++i){
+        Real time = i / 9.0, angle = start + time * PI / 2;
+        animation.addCameraKey(time, Point3(radius * std::cos(angle), 2, radius * std::sin(angle)), Point3(0, 0, 0), 20);
+    }
+    for(int i = 1; i < world.size() - 3; i += 5){
+        shared_ptr<Object> object = world[i];
+        Point3 rest = object->position();
+        Track<Point3>& track = animation.objectTrack(object);
+        for(int k = 0; k <= 16; ++k){
+            Real time = k / 16.0;
+            track.addKey(time, rest + Vec3(0, 1.5 * std::fabs(std::sin(2 * PI * time + i)), 0));
+        }
+    }
+    TransformTrack& spin = animation.instanceTrack(spinnerPtr);
+    for(int k = 0; k <= 8; ++k){
+        Real time = k / 8.0;
+        spin.addKey(time, Point3(0, 2.6, 0), Vec3(0, 360 * time, 30 * std::sin(2 * PI * time)), Vec3(1, 1, 1) * (0.6 + 0.4 * time));
+    }
+    return animation;
+}
+
+int main(){
+    const auto aspectRatio = 16.0/9.0;
+    const int imageWidth = 320;
+    const int imageHeight = static_cast<int>(imageWidth / aspectRatio);
+    const int nSample = 4;
+    const int maxDepth = 16;
+    const int nFrame = 24;
+
+    auto listPtr = randomScene();
+    auto spinnerPtr = spinner();
+    Animation animation = turntable(*listPtr, spinnerPtr, aspectRatio);
+    listPtr->add(spinnerPtr);
+    auto worldPtr = make_shared<BVH>(*listPtr);
+    auto cameraPtr = make_shared<Camera>(animation.cameraAt(0));
+    PixelShader pixelShader(cameraPtr, worldPtr, maxDepth);
+    // One framebuffer for all frames.
+    PPMMSAA ppm(imageWidth, imageHeight, nSample, 0.5);
+
+    for(int mode = 0; mode < 2; ++mode){
+        animation.apply(0);
+        worldPtr->build();
+        double updateTime = 0, renderTime = 0, sahCost = 0;
+        for(int frame = 0; frame < nFrame; ++frame){
+            Real time = Real(frame) / (nFrame - 1);
+            auto start = std::chrono::steady_clock::now();
+            animation.apply(time);
+            // Nothing is added or removed, so refitting is enough.
+            if(mode == 0 || !worldPtr->refit()){
+                worldPtr->build();
+            }
+            auto updated = std::chrono::steady_clock::now();
+            sahCost += worldPtr->sahCost();
+            *cameraPtr = animation.cameraAt(time);
+            ppm.shadePerPixel(&pixelShader, false);
+            auto end = std::chrono::steady_clock::now();
+            updateTime += std::chrono::duration<double>(updated - start).count();
+            renderTime += std::chrono::duration<double>(end - updated).count();
+            if(mode == 1){
+                char fname[64];
+                std::snprintf(fname, sizeof(fname), "pictures/animation%03d.ppm", frame);
+                ppm.writeFile(fname, false, GAMMA);
+            }
+        }
+        std::cout << (mode == 0 ? "Rebuild" : "Refit") << " every frame: BVH update " << updateTime * 1000 / nFrame
+            << "(ms/frame), render " << renderTime / nFrame << "(s/frame), average SAH cost "
+            << sahCost / nFrame << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,152 @@
+// Weekend scene with the diffuse spheres moving up while the shutter is
+// open, traced with swept boxes and with boxes interpolated to the ray time.
+#include <iostream>
+#include <chrono>
+#include "tools/ppmMSAA.h"
+#include "tools/camera.h"
+#include "tools/ray.h"
+#include "tools/objects/objectList.h"
+#include "tools/objects/bvh.h"
+#include "tools/objects/sphere.h"
+#include "tools/objects/movingSphere.h"
+#include "tools/util.h"
+#include "tools/materials/lambertian.h"
+#include "tools/materials/metal.h"
+#include "tools/materials/dielectric.h"
+
+class PixelShader: public PixelCallback{
+public:
+    PixelShader(shared_ptr<Camera> cameraPtr,
+            shared_ptr<ObjectList> objectListPtr, int maxDepth = 50)
+            :cameraPtr(cameraPtr), objectListPtr(objectListPtr), maxDepth(maxDepth){}
+    virtual ~PixelShader(){}
+    virtual RGB operator()(double x, double y){
+        Ray ray = cameraPtr->getRayXY(x, y);
+        return shadeByDepth(ray, maxDepth);
+    }
+
+protected:
+    RGB backgroundColor(const Ray& r){
+        Vec3 dir = normalize(r.direction());
+        auto t = 0.5 * (dir.y() + 1.0);
+        return interpolate(
+            Color(1.0, 1.0, 1.0),
+            Color(0.5, 0.7, 1.0),
+            t);
+    }
+
+    RGB shadeByDepth(const Ray& ray, int depth){
+        if(depth <= 0){
+            return RGB();
+        }
+        HitRecord hitRecord;
+        if(objectListPtr->hit(ray, &hitRecord, TINY, INF)){
+            Ray scattered;
+            RGB attenuation;
+            if(hitRecord.matPtr &&
+                    hitRecord.matPtr->scatter(ray, hitRecord, attenuation, scattered)){
+                return attenuation * shadeByDepth(scattered, depth - 1);
+            }
+            return RGB();
+        }
+        return backgroundColor(ray);
+    }
+
+    shared_ptr<Camera> cameraPtr;
+    shared_ptr<ObjectList> objectListPtr;
+    int maxDepth;
+};
+
+shared_ptr<ObjectList> randomScene(){
+    auto worldPtr = make_shared<ObjectList>();
+    worldPtr->add(make_shared<Sphere>(
+        Point3(0,-1000,0), 1000, make_shared<Lambertian>(RGB(0.5, 0.5, 0.5)*PI)));
+
+    auto albedoGlass = RGB(1.0, 1.0, 1.0)*PI;
+    Real fuzzGlass = 0.0;
+    for(int a = -11; a < 11; ++a){
+        for(int b = -11; b < 11; ++b){
+            auto chooseMat = randomDouble();
+            Point3 center(a + 0.9 * randomDouble(), 0.2, b + 0.9 * randomDouble());
+            if((center - Vec3(4, 0.2, 0)).length() > 0.9){
+                if(chooseMat < 0.8){
+                    //diffuse, rolling sideways during the shutter
+                    auto albedo = RGB::random() * RGB::random() * PI;
+                    Point3 center1 = center + Vec3(0, 0, randomDouble(-1.0, 1.0));
+                    worldPtr->add(make_shared<MovingSphere>(
+                        center, center1, 0.2,
+                        make_shared<Lambertian>(albedo)));
+                }
+                else if(chooseMat < 0.95){
+                    //metal
+                    auto albedo = RGB::random(0.5, 1.0) * PI;
+                    auto fuzz = randomDouble(0, 0.5);
+                    worldPtr->add(make_shared<Sphere>(
+                        center, 0.2,
+                        make_shared<Metal>(albedo, fuzz)));
+                }
+                else{
+                    //dielectric
+                    worldPtr->add(make_shared<Sphere>(
+                        center, 0.2,
+                        make_shared<Dielectric>(albedoGlass, fuzzGlass, 1.5)));
+                }
+            }
+        }
+    }
+    worldPtr->add(make_shared<Sphere>(
+        Point3(0, 1, 0), 1.0,
+        make_shared<Dielectric>(albedoGlass, fuzzGlass, 1.5)));
+    worldPtr->add(make_shared<Sphere>(
+        Point3(-4, 1, 0), 1.0,
+        make_shared<Lambertian>(RGB(0.4, 0.2, 0.1)*PI)));
+    worldPtr->add(make_shared<Sphere>(
+        Point3(4, 1, 0), 1.0,
+        make_shared<Metal>(RGB(0.7, 0.6, 0.5)*PI)));
+    return worldPtr;
+}
+
+int main(){
+    const auto aspectRatio = 16.0/9.0;
+    const int imageWidth = 400;
+    const int imageHeight = static_cast<int>(imageWidth / aspectRatio);
+    const int nSample = 32;
+    const int maxDepth = 16;
+
+    Point3 pos(13,2,3);
+    Point3 lookAt(0,0,0);
+    Vec3 up(0,1,0);
+    Real vfov = 20.0;
+    Real aperture = 0.1;
+    Real focusDist = 10.0;
+    auto cameraPtr =
+        make_shared<Camera>(pos, lookAt, up, vfov, aspectRatio, aperture, focusDist);
+
+    auto worldPtr = make_shared<BVH>(*randomScene());
+    PixelShader pixelShader(cameraPtr, worldPtr, maxDepth);
+    PPMMSAA ppm(imageWidth, imageHeight, nSample, 0.5);
+
+    // A closed shutter sees the spheres at rest, the cost without motion blur.
+    const char* modes[] = {"Shutter closed", "Swept boxes", "Time-interpolated boxes"};
+    const char* names[] = {"pictures/motionBlurClosed.ppm", "pictures/motionBlurSwept.ppm", "pictures/motionBlur.ppm"};
+    for(int mode = 0; mode < 3; ++mode){
+        cameraPtr->setShutter(0.0, mode == 0 ? 0.0 : 1.0);
+        worldPtr->switchMotionBoxes(mode != 1);
+        // Camera rays alone, where traversal is most of the cost.
+        const int nRay = 1000000;
+        int hits = 0;
+        auto start = std::chrono::steady_clock::now();
+        for(int i = 0; i < nRay; ++i){
+            hits += worldPtr->hit(cameraPtr->getRayXY(randomDouble(-1, 1), randomDouble(-1, 1)), nullptr, TINY, INF);
+        }
+        auto end = std::chrono::steady_clock::now();
+        std::cout << modes[mode] << ": " << nRay / std::chrono::duration<double>(end - start).count() / 1e6
+            << " Mrays/s (" << hits << " hits), ";
+        start = std::chrono::steady_clock::now();
+        ppm.shadePerPixel(&pixelShader, false);
+        end = std::chrono::steady_clock::now();
+        std::cout << "render " << std::chrono::duration<double>(end - start).count() << "(s)" << std::endl;
+        ppm.writeFile(names[mode], false, GAMMA);
+    }
+    return 0;
+}
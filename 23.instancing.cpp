@@ -0,0 +1,196 @@
+// Usage: instancing [trees per side]
+// A forest of instances of one tree mesh, a million trees by default. A
+// small forest is also rendered with every triangle copied into one BVH,
+// which should give the same picture.
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <cstdlib>
+#include "tools/ppmMSAA.h"
+#include "tools/camera.h"
+#include "tools/ray.h"
+#include "tools/transform.h"
+#include "tools/objects/objectList.h"
+#include "tools/objects/bvh.h"
+#include "tools/objects/instance.h"
+#include "tools/objects/sphere.h"
+#include "tools/objects/triangle.h"
+#include "tools/util.h"
+#include "tools/materials/lambertian.h"
+
+class PixelShader: public PixelCallback{
+public:
+    PixelShader(shared_ptr<Camera> cameraPtr,
+            shared_ptr<ObjectList> objectListPtr, int maxDepth = 50)
+            :cameraPtr(cameraPtr), objectListPtr(objectListPtr), maxDepth(maxDepth){}
+    virtual ~PixelShader(){}
+    virtual RGB operator()(double x, double y){
+        Ray ray = cameraPtr->getRayXY(x, y);
+        return shadeByDepth(ray, maxDepth);
+    }
+
+protected:
+    RGB backgroundColor(const Ray& r){
+        Vec3 dir = normalize(r.direction());
+        auto t = 0.5 * (dir.y() + 1.0);
+        return interpolate(
+            Color(1.0, 1.0, 1.0),
+            Color(0.5, 0.7, 1.0),
+            t);
+    }
+
+    RGB shadeByDepth(const Ray& ray, int depth){
+        if(depth <= 0){
+            return RGB();
+        }
+        HitRecord hitRecord;
+        if(objectListPtr->hit(ray, &hitRecord, TINY, INF)){
+            Ray scattered;
+            RGB attenuation;
+            if(hitRecord.matPtr &&
+                    hitRecord.matPtr->scatter(ray, hitRecord, attenuation, scattered)){
+                return attenuation * shadeByDepth(scattered, depth - 1);
+            }
+            return RGB();
+        }
+        return backgroundColor(ray);
+    }
+
+    shared_ptr<Camera> cameraPtr;
+    shared_ptr<ObjectList> objectListPtr;
+    int maxDepth;
+};
+
+struct MeshTriangle{
+    Point3 v0, v1, v2;
+    shared_ptr<Material> matPtr;
+};
+
+// A cone of leaves in layers on a six-sided trunk, standing at the origin.
+std::vector<MeshTriangle> treeMesh(shared_ptr<Material> leaves, shared_ptr<Material> bark){
+    std::vector<MeshTriangle> mesh;
+    const int sides = 12;
+    for(int s = 0; s < 6; ++s){
+        Real a0 = 2 * PI * s / 6, a1 = 2 * PI * (s + 1) / 6, r = 0.08;
+        Point3 b0(r * cos(a0), 0, r * sin(a0)), b1(r * cos(a1), 0, r * sin(a1));
+        Vec3 up(0, 0.6, 0);
+        mesh.push_back(MeshTriangle{b0, b1 + up, b1, bark});
+        mesh.push_back(MeshTriangle{b0, b0 + up, b1 + up, bark});
+    }
+    for(int layer = 0; layer < 3; ++layer){
+        Real bottom = 0.4 + 0.45 * layer, radius = 0.6 - 0.15 * layer;
+        Point3 tip(0, bottom + 0.9, 0);
+        for(int s = 0; s < sides; ++s){
+            Real a0 = 2 * PI * s / sides, a1 = 2 * PI * (s + 1) / sides;
+            Point3 p0(radius * cos(a0), bottom, radius * sin(a0)), p1(radius * cos(a1), bottom, radius * sin(a1));
+            mesh.push_back(MeshTriangle{p0, tip, p1, leaves});
+            mesh.push_back(MeshTriangle{p0, p1, Point3(0, bottom, 0), leaves});
+        }
+    }
+    return mesh;
+}
+
+// Trees on a jittered grid, turned and scaled at random. Every fourth one
+// gets autumn leaves through the instance material, which covers the bark
+// as well, as a cheap variation.
+std::vector<Transform> forestLayout(int side, std::vector<shared_ptr<Material> >& materials){
+    std::vector<Transform> layout;
+    layout.reserve(static_cast<std::size_t>(side) * side);
+    materials.assign(static_cast<std::size_t>(side) * side, nullptr);
+    auto autumn = make_shared<Lambertian>(RGB(0.6, 0.3, 0.1)*PI);
+    for(int i = 0; i < side; ++i){
+        for(int j = 0; j < side; ++j){
+            Vec3 offset(2 * i + randomDouble(-0.5, 0.5), 0, -2 * j + randomDouble(-0.5, 0.5));
+            layout.push_back(Transform::translate(offset)
+                * Transform::rotate(Vec3(0, 1, 0), randomDouble(0, 360))
+                * Transform::scale(randomDouble(0.7, 1.3)));
+            if(randomDouble() < 0.25){
+                materials[layout.size() - 1] = autumn;
+            }
+        }
+    }
+    return layout;
+}
+
+int main(int argc, char** argv){
+    const auto aspectRatio = 16.0/9.0;
+    const int imageWidth = 320;
+    const int imageHeight = static_cast<int>(imageWidth / aspectRatio);
+    const int nSample = 8;
+    const int maxDepth = 8;
+    int side = argc > 1 ? std::atoi(argv[1]) : 1000;
+
+    auto leaves = make_shared<Lambertian>(RGB(0.1, 0.4, 0.1)*PI);
+    auto bark = make_shared<Lambertian>(RGB(0.3, 0.2, 0.1)*PI);
+    auto ground = make_shared<Sphere>(Point3(0, -10000, 0), 10000, make_shared<Lambertian>(RGB(0.4, 0.45, 0.3)*PI));
+    std::vector<MeshTriangle> mesh = treeMesh(leaves, bark);
+    auto treePtr = make_shared<BVH>();
+    for(const MeshTriangle& t: mesh){
+        treePtr->add(make_shared<Triangle>(t.v0, t.v1, t.v2, t.matPtr));
+    }
+    treePtr->build();
+    std::size_t treeBytes = treePtr->memoryBytes() + mesh.size() * (sizeof(Triangle) + 16);
+
+    // The same small forest twice, to check instances against plain triangles.
+    const int smallSide = 12;
+    std::vector<shared_ptr<Material> > smallMaterials;
+    std::vector<Transform> smallLayout = forestLayout(smallSide, smallMaterials);
+    auto instancedPtr = make_shared<BVH>(), flatPtr = make_shared<BVH>();
+    instancedPtr->add(ground);
+    flatPtr->add(ground);
+    for(std::size_t i = 0; i < smallLayout.size(); ++i){
+        const Transform& transform = smallLayout[i];
+        instancedPtr->add(make_shared<Instance>(treePtr, transform, smallMaterials[i]));
+        for(const MeshTriangle& t: mesh){
+            flatPtr->add(make_shared<Triangle>(transform.point(t.v0), transform.point(t.v1), transform.point(t.v2),
+                smallMaterials[i] ? smallMaterials[i] : t.matPtr));
+        }
+    }
+    instancedPtr->build();
+    flatPtr->build();
+    auto smallCameraPtr = make_shared<Camera>(Point3(-4, 3, 4), Point3(smallSide, 0, -smallSide), Vec3(0, 1, 0), 40, aspectRatio);
+    PPMMSAA ppm(imageWidth, imageHeight, nSample, 0.5);
+    const char* smallNames[] = {"pictures/forestFlat.ppm", "pictures/forestInstanced.ppm"};
+    RGB means[2];
+    for(int mode = 0; mode < 2; ++mode){
+        PixelShader pixelShader(smallCameraPtr, mode == 0 ? flatPtr : instancedPtr, maxDepth);
+        auto start = std::chrono::steady_clock::now();
+        ppm.shadePerPixel(&pixelShader, false);
+        auto end = std::chrono::steady_clock::now();
+        for(int h = 0; h < imageHeight; ++h){
+            for(int w = 0; w < imageWidth; ++w){
+                means[mode] += ppm.pixel(h, w) / Real(imageWidth * imageHeight);
+            }
+        }
+        std::cout << smallLayout.size() << " trees, " << (mode == 0 ? "flattened" : "instanced") << ": "
+            << std::chrono::duration<double>(end - start).count() << "(s), mean color " << means[mode] << std::endl;
+        ppm.writeFile(smallNames[mode], false, GAMMA);
+    }
+
+    std::vector<shared_ptr<Material> > materials;
+    std::vector<Transform> layout = forestLayout(side, materials);
+    auto start = std::chrono::steady_clock::now();
+    auto forestPtr = make_shared<BVH>();
+    forestPtr->add(ground);
+    for(std::size_t i = 0; i < layout.size(); ++i){
+        forestPtr->add(make_shared<Instance>(treePtr, layout[i], materials[i]));
+    }
+    forestPtr->build();
+    auto built = std::chrono::steady_clock::now();
+    std::size_t instanceBytes = forestPtr->memoryBytes() + layout.size() * (sizeof(Instance) + 16);
+    std::cout << layout.size() << " trees of " << mesh.size() << " triangles built in "
+        << std::chrono::duration<double>(built - start).count() << "(s): tree mesh " << treeBytes / 1024.0
+        << "KB, instances and top level " << instanceBytes / 1048576.0 << "MB, flattened would be about "
+        << layout.size() * treeBytes / 1048576.0 << "MB" << std::endl;
+    layout.clear();
+    layout.shrink_to_fit();
+
+    auto cameraPtr = make_shared<Camera>(Point3(-6, 6, 6), Point3(side, 0, -side), Vec3(0, 1, 0), 40, aspectRatio);
+    PixelShader pixelShader(cameraPtr, forestPtr, maxDepth);
+    start = std::chrono::steady_clock::now();
+    ppm.shadePerPixel(&pixelShader, false);
+    auto end = std::chrono::steady_clock::now();
+    std::cout << "Rendered in " << std::chrono::duration<double>(end - start).count() << "(s)" << std::endl;
+    ppm.writeFile("pictures/forest.ppm", false, GAMMA);
+    return 0;
+}
@@ -0,0 +1,164 @@
+// Usage: regression [update | bias <relative bias>]
+// Renders small reference scenes with fixed seeds and compares them with
+// the references in pictures/regression*.pfm, which are written first if
+// they do not exist, or again with "update". Returns 1 if any scene fails,
+// so it can guard changes to the intersection code, materials or sampling.
+// "bias 0.01" brightens every sample by 1% to show that such errors fail.
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cstdlib>
+#include "tools/ppmMSAA.h"
+#include "tools/camera.h"
+#include "tools/ray.h"
+#include "tools/imageCompare.h"
+#include "tools/objects/objectList.h"
+#include "tools/objects/bvh.h"
+#include "tools/objects/sphere.h"
+#include "tools/objects/triangle.h"
+#include "tools/util.h"
+#include "tools/materials/lambertian.h"
+#include "tools/materials/metal.h"
+#include "tools/materials/dielectric.h"
+
+class PixelShader: public PixelCallback{
+public:
+    PixelShader(shared_ptr<Camera> cameraPtr,
+            shared_ptr<ObjectList> objectListPtr, int maxDepth = 50, Real bias = 0)
+            :cameraPtr(cameraPtr), objectListPtr(objectListPtr), maxDepth(maxDepth), bias(bias){}
+    virtual ~PixelShader(){}
+    // bias scales every sample, to check that the comparison notices.
+    virtual RGB operator()(double x, double y){
+        Ray ray = cameraPtr->getRayXY(x, y);
+        return (1 + bias) * shadeByDepth(ray, maxDepth);
+    }
+
+protected:
+    RGB backgroundColor(const Ray& r){
+        Vec3 dir = normalize(r.direction());
+        auto t = 0.5 * (dir.y() + 1.0);
+        return interpolate(
+            Color(1.0, 1.0, 1.0),
+            Color(0.5, 0.7, 1.0),
+            t);
+    }
+
+    RGB shadeByDepth(const Ray& ray, int depth){
+        if(depth <= 0){
+            return RGB();
+        }
+        HitRecord hitRecord;
+        if(objectListPtr->hit(ray, &hitRecord, TINY, INF)){
+            Ray scattered;
+            RGB attenuation;
+            if(hitRecord.matPtr &&
+                    hitRecord.matPtr->scatter(ray, hitRecord, attenuation, scattered)){
+                return attenuation * shadeByDepth(scattered, depth - 1);
+            }
+            return RGB();
+        }
+        return backgroundColor(ray);
+    }
+
+    shared_ptr<Camera> cameraPtr;
+    shared_ptr<ObjectList> objectListPtr;
+    int maxDepth;
+    Real bias;
+};
+
+shared_ptr<ObjectList> regressionScene(int scene){
+    auto worldPtr = make_shared<ObjectList>();
+    worldPtr->add(make_shared<Sphere>(
+        Point3(0,-1000,0), 1000, make_shared<Lambertian>(RGB(0.5, 0.5, 0.5)*PI)));
+    if(scene == 0){
+        // Diffuse only.
+        worldPtr->add(make_shared<Sphere>(Point3(-2.2, 1, 0), 1.0, make_shared<Lambertian>(RGB(0.7, 0.2, 0.2)*PI)));
+        worldPtr->add(make_shared<Sphere>(Point3(0, 1, 0), 1.0, make_shared<Lambertian>(RGB(0.2, 0.7, 0.2)*PI)));
+        worldPtr->add(make_shared<Triangle>(Point3(1.2, 0, -1), Point3(3.2, 0, 1), Point3(2.2, 2, 0),
+            make_shared<Lambertian>(RGB(0.2, 0.2, 0.7)*PI)));
+    }
+    else if(scene == 1){
+        // Specular: mirror, fuzzy metal and glass.
+        worldPtr->add(make_shared<Sphere>(Point3(-2.2, 1, 0), 1.0, make_shared<Metal>(RGB(0.8, 0.8, 0.8)*PI)));
+        worldPtr->add(make_shared<Sphere>(Point3(0, 1, 0), 1.0, make_shared<Dielectric>(RGB(1.0, 1.0, 1.0)*PI, 0.0, 1.5)));
+        worldPtr->add(make_shared<Sphere>(Point3(2.2, 1, 0), 1.0, make_shared<Metal>(RGB(0.7, 0.6, 0.5)*PI, 0.3)));
+    }
+    else{
+        // Many small random spheres, through a BVH.
+        seedRandom(7);
+        for(int a = -4; a < 4; ++a){
+            for(int b = -4; b < 4; ++b){
+                Point3 center(a + 0.9 * randomDouble(), 0.3, b + 0.9 * randomDouble());
+                Real chooseMat = randomDouble();
+                shared_ptr<Material> material;
+                if(chooseMat < 0.7){
+                    material = make_shared<Lambertian>(RGB::random() * RGB::random() * PI);
+                }
+                else if(chooseMat < 0.9){
+                    material = make_shared<Metal>(RGB::random(0.5, 1.0) * PI, randomDouble(0, 0.5));
+                }
+                else{
+                    material = make_shared<Dielectric>(RGB(1.0, 1.0, 1.0)*PI, 0.0, 1.5);
+                }
+                worldPtr->add(make_shared<Sphere>(center, 0.3, material));
+            }
+        }
+        return make_shared<BVH>(*worldPtr);
+    }
+    return worldPtr;
+}
+
+int main(int argc, char** argv){
+    const int imageWidth = 96;
+    const int imageHeight = 54;
+    const int referenceSamples = 1024;
+    const int testSamples = 64;
+    const int maxDepth = 8;
+    bool update = argc > 1 && std::string(argv[1]) == "update";
+    Real bias = argc > 2 && std::string(argv[1]) == "bias" ? std::atof(argv[2]) : 0;
+    const char* sceneNames[] = {"diffuse", "specular", "spheres"};
+
+    auto cameraPtr = make_shared<Camera>(Point3(0, 2, 8), Point3(0, 0.8, 0), Vec3(0, 1, 0), 40, Real(imageWidth) / imageHeight);
+    bool allPassed = true;
+    for(int scene = 0; scene < 3; ++scene){
+        // A reference of another sample count is another file.
+        std::string prefix = std::string("pictures/regression_") + sceneNames[scene] + "_" + std::to_string(referenceSamples) + "spp";
+        auto worldPtr = regressionScene(scene);
+        EstimatedImage reference;
+        reference.samples = referenceSamples;
+        bool found = !update && reference.read(prefix);
+        if(!update && !found){
+            // A missing reference would otherwise be rendered and compared against itself.
+            std::cout << sceneNames[scene] << ": FAIL no reference " << prefix << ".pfm, run with \"update\" to render it" << std::endl;
+            allPassed = false;
+            continue;
+        }
+        if(update){
+            PixelShader pixelShader(cameraPtr, worldPtr, maxDepth);
+            seedRandom(1);
+            reference = estimateImage(&pixelShader, imageWidth, imageHeight, referenceSamples);
+            if(!reference.write(prefix)){
+                std::cerr << "Cannot write " << prefix << ".pfm" << std::endl;
+                return 1;
+            }
+            std::cout << sceneNames[scene] << ": reference written to " << prefix << ".pfm" << std::endl;
+        }
+        // A different seed than the reference, so the two estimates are independent.
+        PixelShader pixelShader(cameraPtr, worldPtr, maxDepth, bias);
+        seedRandom(2);
+        EstimatedImage image = estimateImage(&pixelShader, imageWidth, imageHeight, testSamples);
+        if(image.width != reference.width || image.height != reference.height){
+            std::cout << sceneNames[scene] << ": reference has a different size, run with \"update\"" << std::endl;
+            allPassed = false;
+            continue;
+        }
+        ConvergenceTest test = convergenceTest(image, reference);
+        allPassed = allPassed && test.passed();
+        std::cout << std::setw(9) << sceneNames[scene] << ": " << (test.passed() ? "PASS" : "FAIL")
+            << " RMSE " << rmse(image, reference) << ", relMSE " << relativeMSE(image, reference)
+            << ", mean z " << test.meanZ << " (limit " << test.meanZLimit << ")"
+            << ", |z| > 3.29 for " << 100 * test.outlierFraction << "% (limit " << 100 * test.outlierLimit << "%)"
+            << (test.biased() ? ", biased" : "") << (test.tooManyOutliers() ? ", too many outliers" : "") << std::endl;
+    }
+    return allPassed ? 0 : 1;
+}
@@ -0,0 +1,185 @@
+// Renders the weekend scene with different thread counts and in two
+// separate halves, and checks that every pixel comes out bit for bit the
+// same, because every sample draws from its own counter-based stream.
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+#include <cstdint>
+#include "tools/ppmMSAA.h"
+#include "tools/camera.h"
+#include "tools/ray.h"
+#include "tools/objects/objectList.h"
+#include "tools/objects/bvh.h"
+#include "tools/objects/sphere.h"
+#include "tools/util.h"
+#include "tools/materials/lambertian.h"
+#include "tools/materials/metal.h"
+#include "tools/materials/dielectric.h"
+
+class PixelShader: public PixelCallback{
+public:
+    PixelShader(shared_ptr<Camera> cameraPtr,
+            shared_ptr<ObjectList> objectListPtr, int maxDepth = 50)
+            :cameraPtr(cameraPtr), objectListPtr(objectListPtr), maxDepth(maxDepth){}
+    virtual ~PixelShader(){}
+    virtual RGB operator()(double x, double y){
+        Ray ray = cameraPtr->getRayXY(x, y);
+        return shadeByDepth(ray, maxDepth);
+    }
+
+protected:
+    RGB backgroundColor(const Ray& r){
+        Vec3 dir = normalize(r.direction());
+        auto t = 0.5 * (dir.y() + 1.0);
+        return interpolate(
+            Color(1.0, 1.0, 1.0),
+            Color(0.5, 0.7, 1.0),
+            t);
+    }
+
+    RGB shadeByDepth(const Ray& ray, int depth){
+        if(depth <= 0){
+            return RGB();
+        }
+        HitRecord hitRecord;
+        if(objectListPtr->hit(ray, &hitRecord, TINY, INF)){
+            Ray scattered;
+            RGB attenuation;
+            if(hitRecord.matPtr &&
+                    hitRecord.matPtr->scatter(ray, hitRecord, attenuation, scattered)){
+                return attenuation * shadeByDepth(scattered, depth - 1);
+            }
+            return RGB();
+        }
+        return backgroundColor(ray);
+    }
+
+    shared_ptr<Camera> cameraPtr;
+    shared_ptr<ObjectList> objectListPtr;
+    int maxDepth;
+};
+
+shared_ptr<ObjectList> randomScene(){
+    auto worldPtr = make_shared<ObjectList>();
+    worldPtr->add(make_shared<Sphere>(
+        Point3(0,-1000,0), 1000, make_shared<Lambertian>(RGB(0.5, 0.5, 0.5)*PI)));
+
+    auto albedoGlass = RGB(1.0, 1.0, 1.0)*PI;
+    Real fuzzGlass = 0.0;
+    for(int a = -11; a < 11; ++a){
+        for(int b = -11; b < 11; ++b){
+            auto chooseMat = randomDouble();
+            Point3 center(a + 0.9 * randomDouble(), 0.2, b + 0.9 * randomDouble());
+            if((center - Vec3(4, 0.2, 0)).length() > 0.9){
+                if(chooseMat < 0.8){
+                    //diffuse
+                    auto albedo = RGB::random() * RGB::random() * PI;
+                    worldPtr->add(make_shared<Sphere>(
+                        center, 0.2,
+                        make_shared<Lambertian>(albedo)));
+                }
+                else if(chooseMat < 0.95){
+                    //metal
+                    auto albedo = RGB::random(0.5, 1.0) * PI;
+                    auto fuzz = randomDouble(0, 0.5);
+                    worldPtr->add(make_shared<Sphere>(
+                        center, 0.2,
+                        make_shared<Metal>(albedo, fuzz)));
+                }
+                else{
+                    //dielectric
+                    worldPtr->add(make_shared<Sphere>(
+                        center, 0.2,
+                        make_shared<Dielectric>(albedoGlass, fuzzGlass, 1.5)));
+                }
+            }
+        }
+    }
+    worldPtr->add(make_shared<Sphere>(
+        Point3(0, 1, 0), 1.0,
+        make_shared<Dielectric>(albedoGlass, fuzzGlass, 1.5)));
+    worldPtr->add(make_shared<Sphere>(
+        Point3(-4, 1, 0), 1.0,
+        make_shared<Lambertian>(RGB(0.4, 0.2, 0.1)*PI)));
+    worldPtr->add(make_shared<Sphere>(
+        Point3(4, 1, 0), 1.0,
+        make_shared<Metal>(RGB(0.7, 0.6, 0.5)*PI)));
+    return worldPtr;
+}
+
+// FNV-1a over the bytes of every pixel.
+std::uint64_t imageHash(const PPM& ppm){
+    std::uint64_t hash = 14695981039346656037ULL;
+    for(int h = 0; h < ppm.imageHeight(); ++h){
+        for(int w = 0; w < ppm.imageWidth(); ++w){
+            RGB pixel = ppm.pixel(h, w);
+            for(int c = 0; c < 3; ++c){
+                Real value = pixel[c];
+                unsigned char bytes[sizeof(Real)];
+                std::memcpy(bytes, &value, sizeof(Real));
+                for(unsigned char b: bytes){
+                    hash = (hash ^ b) * 1099511628211ULL;
+                }
+            }
+        }
+    }
+    return hash;
+}
+
+int main(){
+    const auto aspectRatio = 16.0/9.0;
+    const int imageWidth = 240;
+    const int imageHeight = static_cast<int>(imageWidth / aspectRatio);
+    const int nSample = 8;
+    const int maxDepth = 16;
+    const int tileSize = 16;
+
+    Point3 pos(13,2,3);
+    Point3 lookAt(0,0,0);
+    Vec3 up(0,1,0);
+    Real vfov = 20.0;
+    Real aperture = 0.1;
+    Real focusDist = 10.0;
+    auto cameraPtr =
+        make_shared<Camera>(pos, lookAt, up, vfov, aspectRatio, aperture, focusDist);
+    auto worldPtr = make_shared<BVH>(*randomScene());
+    PixelShader pixelShader(cameraPtr, worldPtr, maxDepth);
+
+    PPMMSAA reference(imageWidth, imageHeight, nSample, 0.5);
+    reference.shadeTiles(&pixelShader, tileSize, 1, false);
+    std::uint64_t referenceHash = imageHash(reference);
+    std::cout << std::hex << "1 thread:          " << referenceHash << std::endl;
+    bool allSame = true;
+
+    for(int nThreads = 2; nThreads <= 4; nThreads += 2){
+        PPMMSAA ppm(imageWidth, imageHeight, nSample, 0.5);
+        ppm.shadeTiles(&pixelShader, tileSize, nThreads, false);
+        std::uint64_t hash = imageHash(ppm);
+        allSame = allSame && hash == referenceHash;
+        std::cout << nThreads << " threads:         " << hash << std::endl;
+    }
+
+    // As if two machines each rendered half of the tiles, the last half first.
+    PPMMSAA first(imageWidth, imageHeight, nSample, 0.5), second(imageWidth, imageHeight, nSample, 0.5);
+    int tiles = first.tileCount(tileSize);
+    second.shadeTileRange(&pixelShader, tileSize, tiles / 2, tiles, 1, false);
+    first.shadeTileRange(&pixelShader, tileSize, 0, tiles / 2, 1, false);
+    for(int h = 0; h < imageHeight; ++h){
+        for(int w = 0; w < imageWidth; ++w){
+            // Pixels outside the rendered tiles are black.
+            first.setPixel(h, w, first.pixel(h, w) + second.pixel(h, w));
+        }
+    }
+    std::uint64_t hash = imageHash(first);
+    allSame = allSame && hash == referenceHash;
+    std::cout << "two halves:        " << hash << std::endl;
+
+    PPMMSAA reseeded(imageWidth, imageHeight, nSample, 0.5);
+    reseeded.setSeed(1);
+    reseeded.shadeTiles(&pixelShader, tileSize, 1, false);
+    std::cout << "1 thread, seed 1:  " << imageHash(reseeded) << std::dec << std::endl;
+
+    std::cout << (allSame ? "All renders with seed 0 are identical." : "Renders differ!") << std::endl;
+    reference.writeFile("pictures/deterministic.ppm", false, GAMMA);
+    return allSame ? 0 : 1;
+}
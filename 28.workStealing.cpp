@@ -0,0 +1,216 @@
+// Renders the weekend scene in large tiles on several threads, once with
+// threads taking whole tiles from a shared counter and once with the
+// work-stealing scheduler of shadeTiles, which splits the last tiles so no
+// thread runs dry. Prints the time and the idle time of every thread; the
+// images must be identical and tiles must have been split. With fewer cores than threads the threads take turns,
+// so the idle times mean less.
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <atomic>
+#include <cstdlib>
+#include "tools/ppmMSAA.h"
+#include "tools/parallel.h"
+#include "tools/camera.h"
+#include "tools/ray.h"
+#include "tools/objects/objectList.h"
+#include "tools/objects/bvh.h"
+#include "tools/objects/sphere.h"
+#include "tools/util.h"
+#include "tools/materials/lambertian.h"
+#include "tools/materials/metal.h"
+#include "tools/materials/dielectric.h"
+
+class PixelShader: public PixelCallback{
+public:
+    PixelShader(shared_ptr<Camera> cameraPtr,
+            shared_ptr<ObjectList> objectListPtr, int maxDepth = 50)
+            :cameraPtr(cameraPtr), objectListPtr(objectListPtr), maxDepth(maxDepth){}
+    virtual ~PixelShader(){}
+    virtual RGB operator()(double x, double y){
+        Ray ray = cameraPtr->getRayXY(x, y);
+        return shadeByDepth(ray, maxDepth);
+    }
+
+protected:
+    RGB backgroundColor(const Ray& r){
+        Vec3 dir = normalize(r.direction());
+        auto t = 0.5 * (dir.y() + 1.0);
+        return interpolate(
+            Color(1.0, 1.0, 1.0),
+            Color(0.5, 0.7, 1.0),
+            t);
+    }
+
+    RGB shadeByDepth(const Ray& ray, int depth){
+        if(depth <= 0){
+            return RGB();
+        }
+        HitRecord hitRecord;
+        if(objectListPtr->hit(ray, &hitRecord, TINY, INF)){
+            Ray scattered;
+            RGB attenuation;
+            if(hitRecord.matPtr &&
+                    hitRecord.matPtr->scatter(ray, hitRecord, attenuation, scattered)){
+                return attenuation * shadeByDepth(scattered, depth - 1);
+            }
+            return RGB();
+        }
+        return backgroundColor(ray);
+    }
+
+    shared_ptr<Camera> cameraPtr;
+    shared_ptr<ObjectList> objectListPtr;
+    int maxDepth;
+};
+
+shared_ptr<ObjectList> randomScene(){
+    auto worldPtr = make_shared<ObjectList>();
+    worldPtr->add(make_shared<Sphere>(
+        Point3(0,-1000,0), 1000, make_shared<Lambertian>(RGB(0.5, 0.5, 0.5)*PI)));
+
+    auto albedoGlass = RGB(1.0, 1.0, 1.0)*PI;
+    Real fuzzGlass = 0.0;
+    for(int a = -11; a < 11; ++a){
+        for(int b = -11; b < 11; ++b){
+            auto chooseMat = randomDouble();
+            Point3 center(a + 0.9 * randomDouble(), 0.2, b + 0.9 * randomDouble());
+            if((center - Vec3(4, 0.2, 0)).length() > 0.9){
+                if(chooseMat < 0.8){
+                    //diffuse
+                    auto albedo = RGB::random() * RGB::random() * PI;
+                    worldPtr->add(make_shared<Sphere>(
+                        center, 0.2,
+                        make_shared<Lambertian>(albedo)));
+                }
+                else if(chooseMat < 0.95){
+                    //metal
+                    auto albedo = RGB::random(0.5, 1.0) * PI;
+                    auto fuzz = randomDouble(0, 0.5);
+                    worldPtr->add(make_shared<Sphere>(
+                        center, 0.2,
+                        make_shared<Metal>(albedo, fuzz)));
+                }
+                else{
+                    //dielectric
+                    worldPtr->add(make_shared<Sphere>(
+                        center, 0.2,
+                        make_shared<Dielectric>(albedoGlass, fuzzGlass, 1.5)));
+                }
+            }
+        }
+    }
+    worldPtr->add(make_shared<Sphere>(
+        Point3(0, 1, 0), 1.0,
+        make_shared<Dielectric>(albedoGlass, fuzzGlass, 1.5)));
+    worldPtr->add(make_shared<Sphere>(
+        Point3(-4, 1, 0), 1.0,
+        make_shared<Lambertian>(RGB(0.4, 0.2, 0.1)*PI)));
+    worldPtr->add(make_shared<Sphere>(
+        Point3(4, 1, 0), 1.0,
+        make_shared<Metal>(RGB(0.7, 0.6, 0.5)*PI)));
+    return worldPtr;
+}
+
+// What shadeTiles did before: whole tiles from a shared counter, with the
+// same sample streams. Returns the time threads spent rendering.
+double shadeSharedCounter(PPM& ppm, PixelCallback* callbackPtr, int nSample, int tileSize, int nThreads){
+    int width = ppm.imageWidth(), height = ppm.imageHeight();
+    int tilesX = (width + tileSize - 1) / tileSize, tilesY = (height + tileSize - 1) / tileSize;
+    std::atomic<long long> busy(0);
+    parallelFor(0, tilesX * tilesY, [&](int tile){
+        auto start = std::chrono::steady_clock::now();
+        int w0 = (tile % tilesX) * tileSize, h0 = height - 1 - (tile / tilesX) * tileSize;
+        for(int h = h0; h > h0 - tileSize && h >= 0; --h){
+            for(int w = w0; w < w0 + tileSize && w < width; ++w){
+                RGB pixel;
+                for(int i = 0; i < nSample; ++i){
+                    beginSample(static_cast<std::uint64_t>(h) * width + w, i);
+                    double x = (w + randomDouble(-0.5, 0.5)) / (width - 1) * 2 - 1,
+                        y = (h + randomDouble(-0.5, 0.5)) / (height - 1) * 2 - 1;
+                    pixel += (*callbackPtr)(x, y);
+                    endSample();
+                }
+                ppm.setPixel(h, w, pixel * (Real(1) / nSample));
+            }
+        }
+        busy += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    }, 1, nThreads);
+    return busy * 1e-6;
+}
+
+bool samePixels(const PPM& a, const PPM& b){
+    for(int h = 0; h < a.imageHeight(); ++h){
+        for(int w = 0; w < a.imageWidth(); ++w){
+            for(int c = 0; c < 3; ++c){
+                if(a.pixel(h, w)[c] != b.pixel(h, w)[c]){
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Usage: 28.workStealing [threads]
+int main(int argc, char** argv){
+    const auto aspectRatio = 16.0/9.0;
+    const int imageWidth = 400;
+    const int imageHeight = static_cast<int>(imageWidth / aspectRatio);
+    const int nSample = 16;
+    const int maxDepth = 16;
+    const int tileSize = 64;
+    int nThreads = argc > 1 ? std::atoi(argv[1]) : 4;
+
+    Point3 pos(13,2,3);
+    Point3 lookAt(0,0,0);
+    Vec3 up(0,1,0);
+    Real vfov = 20.0;
+    Real aperture = 0.1;
+    Real focusDist = 10.0;
+    auto cameraPtr =
+        make_shared<Camera>(pos, lookAt, up, vfov, aspectRatio, aperture, focusDist);
+    auto worldPtr = make_shared<BVH>(*randomScene());
+    PixelShader pixelShader(cameraPtr, worldPtr, maxDepth);
+    std::cout << std::fixed << std::setprecision(3);
+
+    PPMMSAA shared(imageWidth, imageHeight, nSample, 0.5);
+    auto start = std::chrono::steady_clock::now();
+    double busy = shadeSharedCounter(shared, &pixelShader, nSample, tileSize, nThreads);
+    double sharedSeconds = secondsSince(start);
+    std::cout << "Shared counter, " << nThreads << " threads: " << sharedSeconds << " s, idle "
+        << sharedSeconds * nThreads - busy << " s in total" << std::endl;
+
+    PPMMSAA stealing(imageWidth, imageHeight, nSample, 0.5);
+    start = std::chrono::steady_clock::now();
+    stealing.shadeTiles(&pixelShader, tileSize, nThreads, false);
+    double stealingSeconds = secondsSince(start);
+    double idle = 0;
+    int splits = 0;
+    for(const WorkerStats& stats: stealing.schedulerStats()){
+        idle += stats.idleSeconds;
+        splits += stats.splits;
+    }
+    std::cout << "Work stealing,  " << nThreads << " threads: " << stealingSeconds << " s, idle "
+        << idle << " s in total" << std::endl;
+    std::cout << "thread  regions  steals  splits  busy (s)  idle (s)" << std::endl;
+    for(std::size_t i = 0; i < stealing.schedulerStats().size(); ++i){
+        const WorkerStats& stats = stealing.schedulerStats()[i];
+        std::cout << std::setw(6) << i << std::setw(9) << stats.regions << std::setw(8) << stats.steals
+            << std::setw(8) << stats.splits << std::setw(10) << stats.busySeconds << std::setw(10) << stats.idleSeconds << std::endl;
+    }
+
+    bool same = samePixels(shared, stealing);
+    std::cout << (same ? "The images are identical." : "The images differ!") << std::endl;
+    // Several threads on several tiles must share the last ones.
+    bool splitEnough = nThreads <= 1 || stealing.tileCount(tileSize) <= 1 || splits > 0;
+    if(!splitEnough){
+        std::cout << "No tile was split!" << std::endl;
+    }
+    stealing.writeFile("pictures/workStealing.ppm", false, GAMMA);
+    return same && splitEnough ? 0 : 1;
+}
@@ -0,0 +1,168 @@
+// Renders a field of many small spheres, too large for the caches, with
+// the pixels in scanlines and with tiles and their pixels along Morton and
+// Hilbert curves, on one thread. Prints the throughput and, where the
+// kernel allows perf_event_open, the cache misses of every order. The
+// tiled images must be identical, whatever the order.
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <cstdlib>
+#include "tools/ppmMSAA.h"
+#include "tools/perfCounters.h"
+#include "tools/camera.h"
+#include "tools/ray.h"
+#include "tools/objects/objectList.h"
+#include "tools/objects/bvh.h"
+#include "tools/objects/sphere.h"
+#include "tools/util.h"
+#include "tools/materials/lambertian.h"
+#include "tools/materials/metal.h"
+
+class PixelShader: public PixelCallback{
+public:
+    PixelShader(shared_ptr<Camera> cameraPtr,
+            shared_ptr<ObjectList> objectListPtr, int maxDepth = 50)
+            :cameraPtr(cameraPtr), objectListPtr(objectListPtr), maxDepth(maxDepth){}
+    virtual ~PixelShader(){}
+    virtual RGB operator()(double x, double y){
+        Ray ray = cameraPtr->getRayXY(x, y);
+        return shadeByDepth(ray, maxDepth);
+    }
+
+protected:
+    RGB backgroundColor(const Ray& r){
+        Vec3 dir = normalize(r.direction());
+        auto t = 0.5 * (dir.y() + 1.0);
+        return interpolate(
+            Color(1.0, 1.0, 1.0),
+            Color(0.5, 0.7, 1.0),
+            t);
+    }
+
+    RGB shadeByDepth(const Ray& ray, int depth){
+        if(depth <= 0){
+            return RGB();
+        }
+        HitRecord hitRecord;
+        if(objectListPtr->hit(ray, &hitRecord, TINY, INF)){
+            Ray scattered;
+            RGB attenuation;
+            if(hitRecord.matPtr &&
+                    hitRecord.matPtr->scatter(ray, hitRecord, attenuation, scattered)){
+                return attenuation * shadeByDepth(scattered, depth - 1);
+            }
+            return RGB();
+        }
+        return backgroundColor(ray);
+    }
+
+    shared_ptr<Camera> cameraPtr;
+    shared_ptr<ObjectList> objectListPtr;
+    int maxDepth;
+};
+
+// side x side spheres, each with its own material, on a large ground.
+shared_ptr<ObjectList> sphereField(int side){
+    auto worldPtr = make_shared<ObjectList>();
+    worldPtr->add(make_shared<Sphere>(
+        Point3(0,-10000,0), 10000, make_shared<Lambertian>(RGB(0.5, 0.5, 0.5)*PI)));
+    Real spacing = 0.5;
+    for(int a = 0; a < side; ++a){
+        for(int b = 0; b < side; ++b){
+            Point3 center((a - side / 2 + 0.8 * randomDouble()) * spacing, 0.15, (b - side / 2 + 0.8 * randomDouble()) * spacing);
+            if(randomDouble() < 0.8){
+                worldPtr->add(make_shared<Sphere>(center, 0.15,
+                    make_shared<Lambertian>(RGB::random() * RGB::random() * PI)));
+            }
+            else{
+                worldPtr->add(make_shared<Sphere>(center, 0.15,
+                    make_shared<Metal>(RGB::random(0.5, 1.0) * PI, randomDouble(0, 0.3))));
+            }
+        }
+    }
+    return worldPtr;
+}
+
+bool samePixels(const PPM& a, const PPM& b){
+    for(int h = 0; h < a.imageHeight(); ++h){
+        for(int w = 0; w < a.imageWidth(); ++w){
+            for(int c = 0; c < 3; ++c){
+                if(a.pixel(h, w)[c] != b.pixel(h, w)[c]){
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+void report(const std::string& name, double seconds, long long samples, const PerfCounters& counters){
+    std::cout << std::left << std::setw(18) << name << std::right << std::fixed << std::setprecision(3)
+        << std::setw(8) << seconds << " s" << std::setw(10) << std::setprecision(1) << samples / seconds * 1e-3 << " k samples/s";
+    for(int i = PerfCounters::PERF_L1D_READ_MISSES; i <= PerfCounters::PERF_LLC_MISSES; ++i){
+        auto event = PerfCounters::Event(i);
+        if(counters.available(event)){
+            std::cout << ", " << PerfCounters::name(event) << ' ' << std::setprecision(2) << double(counters.value(event)) / samples << "/sample";
+        }
+    }
+    if(counters.available(PerfCounters::PERF_LLC_MISSES) && counters.value(PerfCounters::PERF_LLC_REFERENCES) > 0){
+        std::cout << ", LLC miss rate " << std::setprecision(1)
+            << 100.0 * counters.value(PerfCounters::PERF_LLC_MISSES) / counters.value(PerfCounters::PERF_LLC_REFERENCES) << '%';
+    }
+    std::cout << std::endl;
+}
+
+// Usage: 29.tileOrder [spheres per side]
+int main(int argc, char** argv){
+    const auto aspectRatio = 16.0/9.0;
+    const int imageWidth = 320;
+    const int imageHeight = static_cast<int>(imageWidth / aspectRatio);
+    const int nSample = 4;
+    const int maxDepth = 8;
+    const int tileSize = 16;
+    int side = argc > 1 ? std::atoi(argv[1]) : 700;
+
+    Point3 pos(0,8,40);
+    Point3 lookAt(0,0,20);
+    Vec3 up(0,1,0);
+    Real vfov = 40.0;
+    Real aperture = 0.0;
+    Real focusDist = 20.0;
+    auto cameraPtr =
+        make_shared<Camera>(pos, lookAt, up, vfov, aspectRatio, aperture, focusDist);
+    auto worldPtr = make_shared<BVH>(*sphereField(side));
+    std::cout << side * side << " spheres, BVH " << worldPtr->memoryBytes() / (1 << 20) << " MB" << std::endl;
+    PixelShader pixelShader(cameraPtr, worldPtr, maxDepth);
+    long long samples = 1LL * imageWidth * imageHeight * nSample;
+    PerfCounters counters;
+    if(!counters.available(PerfCounters::PERF_LLC_MISSES)){
+        std::cout << "Cache counters are not available here, timing only." << std::endl;
+    }
+
+    PPMMSAA scanline(imageWidth, imageHeight, nSample, 0.5);
+    auto start = std::chrono::steady_clock::now();
+    counters.start();
+    scanline.shadePerPixel(&pixelShader, false);
+    counters.stop();
+    report("shadePerPixel", std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(), samples, counters);
+
+    const PixelOrder orders[] = {ORDER_SCANLINE, ORDER_MORTON, ORDER_HILBERT};
+    const char* names[] = {"tiles, scanline", "tiles, Morton", "tiles, Hilbert"};
+    PPMMSAA reference(imageWidth, imageHeight, nSample, 0.5);
+    bool same = true;
+    for(int i = 0; i < 3; ++i){
+        PPMMSAA ppm(imageWidth, imageHeight, nSample, 0.5);
+        PPMMSAA& target = i == 0 ? reference : ppm;
+        target.setOrder(orders[i], orders[i]);
+        start = std::chrono::steady_clock::now();
+        counters.start();
+        target.shadeTiles(&pixelShader, tileSize, 1, false);
+        counters.stop();
+        report(names[i], std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(), samples, counters);
+        same = same && samePixels(reference, target);
+    }
+    std::cout << (same ? "The tiled images are identical." : "The tiled images differ!") << std::endl;
+    reference.writeFile("pictures/tileOrder.ppm", false, GAMMA);
+    return same ? 0 : 1;
+}
@@ -0,0 +1,162 @@
+// Builds a scene of a million spheres with their own materials twice: with
+// make_shared per sphere and material, and in a SceneArena. Prints the time
+// to make the objects and to build the BVH, the heap they take, and the
+// time to render a small image of each.
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include "tools/ppmMSAA.h"
+#include "tools/arena.h"
+#include "tools/camera.h"
+#include "tools/ray.h"
+#include "tools/objects/objectList.h"
+#include "tools/objects/bvh.h"
+#include "tools/objects/sphere.h"
+#include "tools/util.h"
+#include "tools/materials/lambertian.h"
+#include "tools/materials/metal.h"
+
+class PixelShader: public PixelCallback{
+public:
+    PixelShader(shared_ptr<Camera> cameraPtr,
+            shared_ptr<ObjectList> objectListPtr, int maxDepth = 50)
+            :cameraPtr(cameraPtr), objectListPtr(objectListPtr), maxDepth(maxDepth){}
+    virtual ~PixelShader(){}
+    virtual RGB operator()(double x, double y){
+        Ray ray = cameraPtr->getRayXY(x, y);
+        return shadeByDepth(ray, maxDepth);
+    }
+
+protected:
+    RGB backgroundColor(const Ray& r){
+        Vec3 dir = normalize(r.direction());
+        auto t = 0.5 * (dir.y() + 1.0);
+        return interpolate(
+            Color(1.0, 1.0, 1.0),
+            Color(0.5, 0.7, 1.0),
+            t);
+    }
+
+    RGB shadeByDepth(const Ray& ray, int depth){
+        if(depth <= 0){
+            return RGB();
+        }
+        HitRecord hitRecord;
+        if(objectListPtr->hit(ray, &hitRecord, TINY, INF)){
+            Ray scattered;
+            RGB attenuation;
+            if(hitRecord.matPtr &&
+                    hitRecord.matPtr->scatter(ray, hitRecord, attenuation, scattered)){
+                return attenuation * shadeByDepth(scattered, depth - 1);
+            }
+            return RGB();
+        }
+        return backgroundColor(ray);
+    }
+
+    shared_ptr<Camera> cameraPtr;
+    shared_ptr<ObjectList> objectListPtr;
+    int maxDepth;
+};
+
+// Bytes allocated from the heap, -1 where unknown.
+long long heapBytes(){
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    struct mallinfo2 info = mallinfo2();
+    return static_cast<long long>(info.uordblks + info.hblkhd);
+#else
+    return -1;
+#endif
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// side x side spheres, 80% diffuse and 20% metal. make(args) returns a
+// shared_ptr to a new T, from the heap or from an arena.
+template<typename Maker>
+shared_ptr<ObjectList> sphereField(int side, Maker& maker){
+    seedRandom(1);
+    auto worldPtr = make_shared<ObjectList>();
+    worldPtr->add(maker.template make<Sphere>(
+        Point3(0,-10000,0), 10000, maker.template make<Lambertian>(RGB(0.5, 0.5, 0.5)*PI)));
+    Real spacing = 0.5;
+    for(int a = 0; a < side; ++a){
+        for(int b = 0; b < side; ++b){
+            Point3 center((a - side / 2 + 0.8 * randomDouble()) * spacing, 0.15, (b - side / 2 + 0.8 * randomDouble()) * spacing);
+            if(randomDouble() < 0.8){
+                worldPtr->add(maker.template make<Sphere>(center, 0.15,
+                    maker.template make<Lambertian>(RGB::random() * RGB::random() * PI)));
+            }
+            else{
+                worldPtr->add(maker.template make<Sphere>(center, 0.15,
+                    maker.template make<Metal>(RGB::random(0.5, 1.0) * PI, randomDouble(0, 0.3))));
+            }
+        }
+    }
+    return worldPtr;
+}
+
+struct HeapMaker{
+    template<typename T, typename... Args>
+    shared_ptr<T> make(Args&&... args){ return make_shared<T>(std::forward<Args>(args)...); }
+};
+
+template<typename Maker>
+void run(const char* name, int side, Maker& maker, shared_ptr<Camera> cameraPtr){
+    long long heapBefore = heapBytes();
+    auto start = std::chrono::steady_clock::now();
+    auto listPtr = sphereField(side, maker);
+    double makeSeconds = secondsSince(start);
+    long long objectBytes = heapBytes() - heapBefore;
+    start = std::chrono::steady_clock::now();
+    auto worldPtr = make_shared<BVH>(*listPtr);
+    double buildSeconds = secondsSince(start);
+
+    double renderSeconds;
+    {
+        PixelShader pixelShader(cameraPtr, worldPtr, 8);
+        PPMMSAA ppm(320, 180, 4, 0.5);
+        start = std::chrono::steady_clock::now();
+        ppm.shadeTiles(&pixelShader, 16, 1, false);
+        renderSeconds = secondsSince(start);
+    }
+
+    std::cout << std::left << std::setw(12) << name << std::right << std::fixed << std::setprecision(3)
+        << "objects " << makeSeconds << " s, BVH " << buildSeconds << " s, render " << renderSeconds << " s";
+    if(heapBefore >= 0){
+        std::cout << ", objects and list take " << std::setprecision(1) << objectBytes / double(1 << 20) << " MB";
+    }
+    std::cout << std::endl;
+    start = std::chrono::steady_clock::now();
+    worldPtr.reset();
+    listPtr.reset();
+    std::cout << "            freed in " << std::setprecision(3) << secondsSince(start) << " s" << std::endl;
+}
+
+// Usage: 30.sceneArena [spheres per side]
+int main(int argc, char** argv){
+    const auto aspectRatio = 16.0/9.0;
+    int side = argc > 1 ? std::atoi(argv[1]) : 1000;
+
+    Point3 pos(0,8,40);
+    Point3 lookAt(0,0,20);
+    Vec3 up(0,1,0);
+    auto cameraPtr = make_shared<Camera>(pos, lookAt, up, 40.0, aspectRatio, 0.0, 20.0);
+    std::cout << side * side + 1 << " spheres and materials" << std::endl;
+
+    HeapMaker heap;
+    run("make_shared", side, heap, cameraPtr);
+    {
+        SceneArena arena;
+        run("SceneArena", side, arena, cameraPtr);
+        std::cout << "            arena: " << arena.blockCount() << " blocks, "
+            << arena.bytesUsed() / double(1 << 20) << " MB used of " << arena.bytesReserved() / double(1 << 20) << " MB" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,240 @@
+// Renders the weekend scene with a path tracer that keeps the vertices of
+// each path, hit records included, in the thread's scratch arena, and
+// counts the heap allocations made while shading samples. After its first
+// sample a thread has grown its arena and must not allocate again. The
+// image must match the recursive PixelShader's.
+#include <iostream>
+#include <iomanip>
+#include <atomic>
+#include <cstdlib>
+#include "tools/allocationCounter.h"
+#include "tools/ppmMSAA.h"
+#include "tools/scratch.h"
+#include "tools/camera.h"
+#include "tools/ray.h"
+#include "tools/objects/objectList.h"
+#include "tools/objects/bvh.h"
+#include "tools/objects/sphere.h"
+#include "tools/util.h"
+#include "tools/materials/lambertian.h"
+#include "tools/materials/metal.h"
+#include "tools/materials/dielectric.h"
+
+class PixelShader: public PixelCallback{
+public:
+    PixelShader(shared_ptr<Camera> cameraPtr,
+            shared_ptr<ObjectList> objectListPtr, int maxDepth = 50)
+            :cameraPtr(cameraPtr), objectListPtr(objectListPtr), maxDepth(maxDepth){}
+    virtual ~PixelShader(){}
+    virtual RGB operator()(double x, double y){
+        Ray ray = cameraPtr->getRayXY(x, y);
+        return shadeByDepth(ray, maxDepth);
+    }
+
+protected:
+    RGB backgroundColor(const Ray& r){
+        Vec3 dir = normalize(r.direction());
+        auto t = 0.5 * (dir.y() + 1.0);
+        return interpolate(
+            Color(1.0, 1.0, 1.0),
+            Color(0.5, 0.7, 1.0),
+            t);
+    }
+
+    RGB shadeByDepth(const Ray& ray, int depth){
+        if(depth <= 0){
+            return RGB();
+        }
+        HitRecord hitRecord;
+        if(objectListPtr->hit(ray, &hitRecord, TINY, INF)){
+            Ray scattered;
+            RGB attenuation;
+            if(hitRecord.matPtr &&
+                    hitRecord.matPtr->scatter(ray, hitRecord, attenuation, scattered)){
+                return attenuation * shadeByDepth(scattered, depth - 1);
+            }
+            return RGB();
+        }
+        return backgroundColor(ray);
+    }
+
+    shared_ptr<Camera> cameraPtr;
+    shared_ptr<ObjectList> objectListPtr;
+    int maxDepth;
+};
+
+// Follows the path first and applies the attenuations from its end back,
+// like PixelShader::shadeByDepth without the recursion.
+class ScratchPathShader: public PixelCallback{
+public:
+    ScratchPathShader(shared_ptr<Camera> cameraPtr,
+            shared_ptr<ObjectList> objectListPtr, int maxDepth = 50)
+            :cameraPtr(cameraPtr), objectListPtr(objectListPtr), maxDepth(maxDepth){}
+    virtual ~ScratchPathShader(){}
+    virtual RGB operator()(double x, double y){
+        Ray ray = cameraPtr->getRayXY(x, y);
+        // Freed by shadeTiles after the sample.
+        PathVertex* vertices = scratchArena().makeArray<PathVertex>(maxDepth);
+        int n = 0;
+        RGB radiance;
+        while(n < maxDepth){
+            PathVertex& vertex = vertices[n];
+            if(!objectListPtr->hit(ray, &vertex.hitRecord, TINY, INF)){
+                radiance = backgroundColor(ray);
+                break;
+            }
+            Ray scattered;
+            if(!vertex.hitRecord.matPtr ||
+                    !vertex.hitRecord.matPtr->scatter(ray, vertex.hitRecord, vertex.attenuation, scattered)){
+                break;
+            }
+            ray = scattered;
+            ++n;
+        }
+        for(int i = n - 1; i >= 0; --i){
+            radiance = vertices[i].attenuation * radiance;
+        }
+        return radiance;
+    }
+
+protected:
+    struct PathVertex{
+        HitRecord hitRecord;
+        RGB attenuation;
+    };
+
+    RGB backgroundColor(const Ray& r){
+        Vec3 dir = normalize(r.direction());
+        auto t = 0.5 * (dir.y() + 1.0);
+        return interpolate(
+            Color(1.0, 1.0, 1.0),
+            Color(0.5, 0.7, 1.0),
+            t);
+    }
+
+    shared_ptr<Camera> cameraPtr;
+    shared_ptr<ObjectList> objectListPtr;
+    int maxDepth;
+};
+
+// Counts the allocations made inside the callback, apart for the first
+// sample of each thread.
+class CountingCallback: public PixelCallback{
+public:
+    CountingCallback(PixelCallback* callbackPtr):callbackPtr(callbackPtr), first(0), later(0){}
+    virtual RGB operator()(double x, double y){
+        thread_local bool firstSample = true;
+        std::uint64_t before = threadAllocationCount();
+        RGB color = (*callbackPtr)(x, y);
+        (firstSample ? first : later) += threadAllocationCount() - before;
+        firstSample = false;
+        return color;
+    }
+
+    PixelCallback* callbackPtr;
+    std::atomic<std::uint64_t> first, later;
+};
+
+shared_ptr<ObjectList> randomScene(){
+    auto worldPtr = make_shared<ObjectList>();
+    worldPtr->add(make_shared<Sphere>(
+        Point3(0,-1000,0), 1000, make_shared<Lambertian>(RGB(0.5, 0.5, 0.5)*PI)));
+
+    auto albedoGlass = RGB(1.0, 1.0, 1.0)*PI;
+    Real fuzzGlass = 0.0;
+    for(int a = -11; a < 11; ++a){
+        for(int b = -11; b < 11; ++b){
+            auto chooseMat = randomDouble();
+            Point3 center(a + 0.9 * randomDouble(), 0.2, b + 0.9 * randomDouble());
+            if((center - Vec3(4, 0.2, 0)).length() > 0.9){
+                if(chooseMat < 0.8){
+                    //diffuse
+                    auto albedo = RGB::random() * RGB::random() * PI;
+                    worldPtr->add(make_shared<Sphere>(
+                        center, 0.2,
+                        make_shared<Lambertian>(albedo)));
+                }
+                else if(chooseMat < 0.95){
+                    //metal
+                    auto albedo = RGB::random(0.5, 1.0) * PI;
+                    auto fuzz = randomDouble(0, 0.5);
+                    worldPtr->add(make_shared<Sphere>(
+                        center, 0.2,
+                        make_shared<Metal>(albedo, fuzz)));
+                }
+                else{
+                    //dielectric
+                    worldPtr->add(make_shared<Sphere>(
+                        center, 0.2,
+                        make_shared<Dielectric>(albedoGlass, fuzzGlass, 1.5)));
+                }
+            }
+        }
+    }
+    worldPtr->add(make_shared<Sphere>(
+        Point3(0, 1, 0), 1.0,
+        make_shared<Dielectric>(albedoGlass, fuzzGlass, 1.5)));
+    worldPtr->add(make_shared<Sphere>(
+        Point3(-4, 1, 0), 1.0,
+        make_shared<Lambertian>(RGB(0.4, 0.2, 0.1)*PI)));
+    worldPtr->add(make_shared<Sphere>(
+        Point3(4, 1, 0), 1.0,
+        make_shared<Metal>(RGB(0.7, 0.6, 0.5)*PI)));
+    return worldPtr;
+}
+
+bool samePixels(const PPM& a, const PPM& b){
+    for(int h = 0; h < a.imageHeight(); ++h){
+        for(int w = 0; w < a.imageWidth(); ++w){
+            for(int c = 0; c < 3; ++c){
+                if(a.pixel(h, w)[c] != b.pixel(h, w)[c]){
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// Usage: 31.scratchArena [threads]
+int main(int argc, char** argv){
+    const auto aspectRatio = 16.0/9.0;
+    const int imageWidth = 240;
+    const int imageHeight = static_cast<int>(imageWidth / aspectRatio);
+    const int nSample = 8;
+    const int maxDepth = 16;
+    const int tileSize = 16;
+    int nThreads = argc > 1 ? std::atoi(argv[1]) : 4;
+
+    Point3 pos(13,2,3);
+    Point3 lookAt(0,0,0);
+    Vec3 up(0,1,0);
+    Real vfov = 20.0;
+    Real aperture = 0.1;
+    Real focusDist = 10.0;
+    auto cameraPtr =
+        make_shared<Camera>(pos, lookAt, up, vfov, aspectRatio, aperture, focusDist);
+    auto worldPtr = make_shared<BVH>(*randomScene());
+    PixelShader pixelShader(cameraPtr, worldPtr, maxDepth);
+    ScratchPathShader scratchShader(cameraPtr, worldPtr, maxDepth);
+
+    PPMMSAA recursive(imageWidth, imageHeight, nSample, 0.5);
+    recursive.shadeTiles(&pixelShader, tileSize, nThreads, false);
+
+    PPMMSAA scratch(imageWidth, imageHeight, nSample, 0.5);
+    CountingCallback counting(&scratchShader);
+    std::uint64_t before = allocationCount();
+    scratch.shadeTiles(&counting, tileSize, nThreads, false);
+    std::uint64_t total = allocationCount() - before;
+    long long samples = 1LL * imageWidth * imageHeight * nSample;
+
+    std::cout << "Allocations during the render:      " << total << std::endl;
+    std::cout << "  in the first sample of the threads " << counting.first << std::endl;
+    std::cout << "  in the other " << samples - nThreads << " samples     " << counting.later << std::endl;
+    std::cout << "Scratch arena of the main thread:   " << scratchArena().bytesReserved() << " bytes in "
+        << scratchArena().heapAllocationCount() << " block(s)" << std::endl;
+    bool same = samePixels(recursive, scratch);
+    std::cout << (same ? "The image matches the recursive shader's." : "The images differ!") << std::endl;
+    scratch.writeFile("pictures/scratchArena.ppm", false, GAMMA);
+    return same && counting.later == 0 ? 0 : 1;
+}
@@ -0,0 +1,202 @@
+// Builds BVHs over a million spheres with the median, binned SAH and LBVH
+// builders on one thread and on several, and prints the build time, the
+// SAH cost of the tree and the time to render a small image with it. The
+// images of one builder must not depend on the thread count. Then builds
+// every builder over spheres spaced exponentially along a line, which the
+// surface area heuristic peels off one at a time, and checks that the trees
+// stay within the traversal stack and hit like the plain list.
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include "tools/ppmMSAA.h"
+#include "tools/camera.h"
+#include "tools/ray.h"
+#include "tools/objects/objectList.h"
+#include "tools/objects/bvh.h"
+#include "tools/objects/compressedBVH.h"
+#include "tools/objects/sphere.h"
+#include "tools/util.h"
+#include "tools/materials/lambertian.h"
+#include "tools/materials/metal.h"
+
+class PixelShader: public PixelCallback{
+public:
+    PixelShader(shared_ptr<Camera> cameraPtr,
+            shared_ptr<ObjectList> objectListPtr, int maxDepth = 50)
+            :cameraPtr(cameraPtr), objectListPtr(objectListPtr), maxDepth(maxDepth){}
+    virtual ~PixelShader(){}
+    virtual RGB operator()(double x, double y){
+        Ray ray = cameraPtr->getRayXY(x, y);
+        return shadeByDepth(ray, maxDepth);
+    }
+
+protected:
+    RGB backgroundColor(const Ray& r){
+        Vec3 dir = normalize(r.direction());
+        auto t = 0.5 * (dir.y() + 1.0);
+        return interpolate(
+            Color(1.0, 1.0, 1.0),
+            Color(0.5, 0.7, 1.0),
+            t);
+    }
+
+    RGB shadeByDepth(const Ray& ray, int depth){
+        if(depth <= 0){
+            return RGB();
+        }
+        HitRecord hitRecord;
+        if(objectListPtr->hit(ray, &hitRecord, TINY, INF)){
+            Ray scattered;
+            RGB attenuation;
+            if(hitRecord.matPtr &&
+                    hitRecord.matPtr->scatter(ray, hitRecord, attenuation, scattered)){
+                return attenuation * shadeByDepth(scattered, depth - 1);
+            }
+            return RGB();
+        }
+        return backgroundColor(ray);
+    }
+
+    shared_ptr<Camera> cameraPtr;
+    shared_ptr<ObjectList> objectListPtr;
+    int maxDepth;
+};
+
+// n spheres in clusters of different sizes and densities above a ground,
+// sharing a few materials.
+shared_ptr<ObjectList> clusteredSpheres(int n){
+    seedRandom(3);
+    auto worldPtr = make_shared<ObjectList>();
+    worldPtr->add(make_shared<Sphere>(
+        Point3(0,-10000,0), 10000, make_shared<Lambertian>(RGB(0.5, 0.5, 0.5)*PI)));
+    shared_ptr<Material> materials[] = {
+        make_shared<Lambertian>(RGB(0.8, 0.3, 0.2)*PI), make_shared<Lambertian>(RGB(0.2, 0.6, 0.3)*PI),
+        make_shared<Lambertian>(RGB(0.3, 0.3, 0.8)*PI), make_shared<Metal>(RGB(0.8, 0.8, 0.7)*PI, 0.1)};
+    const int clusters = 200;
+    for(int c = 0; c < clusters; ++c){
+        Point3 center(randomDouble(-40, 40), randomDouble(1, 8), randomDouble(-40, 40));
+        Real spread = randomDouble(0.5, 4);
+        for(int i = 0; i < (n - 1) / clusters; ++i){
+            Point3 p = center + spread * Vec3::randomVectorSphere(1.0);
+            worldPtr->add(make_shared<Sphere>(p, randomDouble(0.01, 0.05), materials[i % 4]));
+        }
+    }
+    return worldPtr;
+}
+
+// FNV-1a over the bytes of every pixel.
+std::uint64_t imageHash(const PPM& ppm){
+    std::uint64_t hash = 14695981039346656037ULL;
+    for(int h = 0; h < ppm.imageHeight(); ++h){
+        for(int w = 0; w < ppm.imageWidth(); ++w){
+            RGB pixel = ppm.pixel(h, w);
+            for(int c = 0; c < 3; ++c){
+                Real value = pixel[c];
+                unsigned char bytes[sizeof(Real)];
+                std::memcpy(bytes, &value, sizeof(Real));
+                for(unsigned char b: bytes){
+                    hash = (hash ^ b) * 1099511628211ULL;
+                }
+            }
+        }
+    }
+    return hash;
+}
+
+// n spheres at x = 1.25^i, each far from all before it.
+shared_ptr<ObjectList> exponentialSpheres(int n){
+    auto worldPtr = make_shared<ObjectList>();
+    auto materialPtr = make_shared<Lambertian>(RGB(0.5, 0.5, 0.5)*PI);
+    for(int i = 0; i < n; ++i){
+        worldPtr->add(make_shared<Sphere>(Point3(std::pow(1.25, i), 0, 0), 0.1, materialPtr));
+    }
+    return worldPtr;
+}
+
+// Rays along the line of spheres from before the first one, slightly
+// tilted, so traversal reaches the deepest leaves. Counts the rays whose
+// closest hit or occlusion differs from the list.
+int deepTreeErrors(ObjectList& list, ObjectList& tree){
+    int errors = 0;
+    for(int i = 0; i < 1000; ++i){
+        Ray ray(Point3(-1, randomDouble(-0.05, 0.05), randomDouble(-0.05, 0.05)), Vec3(1, randomDouble(-1e-3, 1e-3), randomDouble(-1e-3, 1e-3)));
+        HitRecord a, b;
+        bool hitA = list.hit(ray, &a, TINY, INF), hitB = tree.hit(ray, &b, TINY, INF);
+        errors += hitA != hitB || (hitA && a.objectIndex != b.objectIndex);
+        errors += list.occluded(ray, TINY, INF) != tree.occluded(ray, TINY, INF);
+    }
+    return errors;
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Usage: 32.bvhBuild [spheres [threads]]
+int main(int argc, char** argv){
+    int n = argc > 1 ? std::atoi(argv[1]) : 1000000;
+    int nThreads = argc > 2 ? std::atoi(argv[2]) : 4;
+    const auto aspectRatio = 16.0/9.0;
+    auto cameraPtr = make_shared<Camera>(Point3(0,20,70), Point3(0,2,0), Vec3(0,1,0), 40.0, aspectRatio, 0.0, 70.0);
+    auto listPtr = clusteredSpheres(n);
+    std::cout << listPtr->size() << " spheres" << std::endl;
+    std::cout << "builder  threads  build (s)  nodes     SAH cost  render (s)" << std::endl;
+
+    const BVHBuilder builders[] = {BVH_MEDIAN, BVH_SAH, BVH_LBVH};
+    const char* names[] = {"median", "SAH", "LBVH"};
+    bool allSame = true;
+    for(int b = 0; b < 3; ++b){
+        std::uint64_t firstHash = 0;
+        const int threadCounts[] = {1, nThreads};
+        for(int t = 0; t < 2; ++t){
+            auto bvhPtr = make_shared<BVH>(4, builders[b]);
+            for(int i = 0; i < listPtr->size(); ++i){
+                bvhPtr->add((*listPtr)[i]);
+            }
+            bvhPtr->setBuilder(builders[b], threadCounts[t]);
+            auto start = std::chrono::steady_clock::now();
+            bvhPtr->build();
+            double buildSeconds = secondsSince(start);
+
+            PixelShader pixelShader(cameraPtr, bvhPtr, 8);
+            PPMMSAA ppm(240, 135, 4, 0.5);
+            start = std::chrono::steady_clock::now();
+            ppm.shadeTiles(&pixelShader, 16, 1, false);
+            double renderSeconds = secondsSince(start);
+            std::uint64_t hash = imageHash(ppm);
+            if(t == 0){
+                firstHash = hash;
+            }
+            allSame = allSame && hash == firstHash;
+            std::cout << std::left << std::setw(9) << names[b] << std::right << std::setw(7) << threadCounts[t]
+                << std::fixed << std::setprecision(3) << std::setw(11) << buildSeconds << std::setw(9) << bvhPtr->nodeCount()
+                << std::setprecision(2) << std::setw(11) << bvhPtr->sahCost()
+                << std::setprecision(3) << std::setw(12) << renderSeconds << std::endl;
+            if(b == 1 && t == 0){
+                ppm.writeFile("pictures/bvhBuild.ppm", false, GAMMA);
+            }
+        }
+    }
+    std::cout << (allSame ? "Every builder makes the same image on 1 and " : "Images differ between 1 and ")
+        << nThreads << " threads." << std::endl;
+
+    // 1.25^9 < 10, so the last sphere stays within the range of Real.
+    auto linePtr = exponentialSpheres(9 * std::numeric_limits<Real>::max_exponent10);
+    const BVHBuilder deepBuilders[] = {BVH_MEDIAN, BVH_SAH, BVH_LBVH, BVH_SBVH};
+    const char* deepNames[] = {"median", "SAH", "LBVH", "SBVH"};
+    bool allShallow = true;
+    seedRandom(7);
+    std::cout << std::endl << linePtr->size() << " exponentially spaced spheres" << std::endl;
+    std::cout << "builder    depth  errors  compressed errors" << std::endl;
+    for(int b = 0; b < 4; ++b){
+        BVH bvh(*linePtr, 4, deepBuilders[b]);
+        CompressedBVH compressed(*linePtr, 4, deepBuilders[b]);
+        int errors = deepTreeErrors(*linePtr, bvh), compressedErrors = deepTreeErrors(*linePtr, compressed);
+        allShallow = allShallow && errors == 0 && compressedErrors == 0;
+        std::cout << std::left << std::setw(9) << deepNames[b] << std::right << std::setw(7) << bvh.depth()
+            << std::setw(8) << errors << std::setw(19) << compressedErrors << std::endl;
+    }
+    return allSame && allShallow ? 0 : 1;
+}
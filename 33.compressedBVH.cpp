@@ -0,0 +1,166 @@
+// Traces a million spheres with a BVH and with a CompressedBVH, whose nodes
+// keep 8 bit child boxes, and prints the memory of each tree, the build
+// time, the SAH cost, and the time to render a small image on one thread.
+// Random rays must hit the same spheres at the same distance in both, so
+// the images must be identical.
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include "tools/ppmMSAA.h"
+#include "tools/camera.h"
+#include "tools/ray.h"
+#include "tools/objects/objectList.h"
+#include "tools/objects/bvh.h"
+#include "tools/objects/compressedBVH.h"
+#include "tools/objects/sphere.h"
+#include "tools/util.h"
+#include "tools/materials/lambertian.h"
+#include "tools/materials/metal.h"
+
+class PixelShader: public PixelCallback{
+public:
+    PixelShader(shared_ptr<Camera> cameraPtr,
+            shared_ptr<ObjectList> objectListPtr, int maxDepth = 50)
+            :cameraPtr(cameraPtr), objectListPtr(objectListPtr), maxDepth(maxDepth){}
+    virtual ~PixelShader(){}
+    virtual RGB operator()(double x, double y){
+        Ray ray = cameraPtr->getRayXY(x, y);
+        return shadeByDepth(ray, maxDepth);
+    }
+
+protected:
+    RGB backgroundColor(const Ray& r){
+        Vec3 dir = normalize(r.direction());
+        auto t = 0.5 * (dir.y() + 1.0);
+        return interpolate(
+            Color(1.0, 1.0, 1.0),
+            Color(0.5, 0.7, 1.0),
+            t);
+    }
+
+    RGB shadeByDepth(const Ray& ray, int depth){
+        if(depth <= 0){
+            return RGB();
+        }
+        HitRecord hitRecord;
+        if(objectListPtr->hit(ray, &hitRecord, TINY, INF)){
+            Ray scattered;
+            RGB attenuation;
+            if(hitRecord.matPtr &&
+                    hitRecord.matPtr->scatter(ray, hitRecord, attenuation, scattered)){
+                return attenuation * shadeByDepth(scattered, depth - 1);
+            }
+            return RGB();
+        }
+        return backgroundColor(ray);
+    }
+
+    shared_ptr<Camera> cameraPtr;
+    shared_ptr<ObjectList> objectListPtr;
+    int maxDepth;
+};
+
+// n spheres in clusters of different sizes and densities above a ground,
+// sharing a few materials.
+shared_ptr<ObjectList> clusteredSpheres(int n){
+    seedRandom(3);
+    auto worldPtr = make_shared<ObjectList>();
+    worldPtr->add(make_shared<Sphere>(
+        Point3(0,-10000,0), 10000, make_shared<Lambertian>(RGB(0.5, 0.5, 0.5)*PI)));
+    shared_ptr<Material> materials[] = {
+        make_shared<Lambertian>(RGB(0.8, 0.3, 0.2)*PI), make_shared<Lambertian>(RGB(0.2, 0.6, 0.3)*PI),
+        make_shared<Lambertian>(RGB(0.3, 0.3, 0.8)*PI), make_shared<Metal>(RGB(0.8, 0.8, 0.7)*PI, 0.1)};
+    const int clusters = 200;
+    for(int c = 0; c < clusters; ++c){
+        Point3 center(randomDouble(-40, 40), randomDouble(1, 8), randomDouble(-40, 40));
+        Real spread = randomDouble(0.5, 4);
+        for(int i = 0; i < (n - 1) / clusters; ++i){
+            Point3 p = center + spread * Vec3::randomVectorSphere(1.0);
+            worldPtr->add(make_shared<Sphere>(p, randomDouble(0.01, 0.05), materials[i % 4]));
+        }
+    }
+    return worldPtr;
+}
+
+// FNV-1a over the bytes of every pixel.
+std::uint64_t imageHash(const PPM& ppm){
+    std::uint64_t hash = 14695981039346656037ULL;
+    for(int h = 0; h < ppm.imageHeight(); ++h){
+        for(int w = 0; w < ppm.imageWidth(); ++w){
+            RGB pixel = ppm.pixel(h, w);
+            for(int c = 0; c < 3; ++c){
+                Real value = pixel[c];
+                unsigned char bytes[sizeof(Real)];
+                std::memcpy(bytes, &value, sizeof(Real));
+                for(unsigned char b: bytes){
+                    hash = (hash ^ b) * 1099511628211ULL;
+                }
+            }
+        }
+    }
+    return hash;
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Usage: 33.compressedBVH [spheres]
+int main(int argc, char** argv){
+    int n = argc > 1 ? std::atoi(argv[1]) : 1000000;
+    const auto aspectRatio = 16.0/9.0;
+    auto cameraPtr = make_shared<Camera>(Point3(0,20,70), Point3(0,2,0), Vec3(0,1,0), 40.0, aspectRatio, 0.0, 70.0);
+    auto listPtr = clusteredSpheres(n);
+    std::cout << listPtr->size() << " spheres" << std::endl;
+
+    auto start = std::chrono::steady_clock::now();
+    auto bvhPtr = make_shared<BVH>(*listPtr);
+    double bvhSeconds = secondsSince(start);
+    start = std::chrono::steady_clock::now();
+    auto compressedPtr = make_shared<CompressedBVH>(*listPtr);
+    double compressedSeconds = secondsSince(start);
+
+    // Rays from around the scene towards random points in it.
+    seedRandom(4);
+    int same = 0, rays = 100000;
+    for(int i = 0; i < rays; ++i){
+        Point3 from = 60 * Vec3::randomVectorSphere(1.0) + Vec3(0, 30, 0);
+        Point3 to(randomDouble(-40, 40), randomDouble(0, 10), randomDouble(-40, 40));
+        Ray ray(from, to - from);
+        HitRecord a, b;
+        bool hitA = bvhPtr->hit(ray, &a, TINY, INF), hitB = compressedPtr->hit(ray, &b, TINY, INF);
+        same += hitA == hitB && (!hitA || (a.t == b.t && a.objectIndex == b.objectIndex));
+    }
+
+    std::uint64_t hashes[2];
+    double renderSeconds[2];
+    shared_ptr<BVH> trees[] = {bvhPtr, compressedPtr};
+    for(int t = 0; t < 2; ++t){
+        PixelShader pixelShader(cameraPtr, trees[t], 8);
+        PPMMSAA ppm(240, 135, 4, 0.5);
+        start = std::chrono::steady_clock::now();
+        ppm.shadeTiles(&pixelShader, 16, 1, false);
+        renderSeconds[t] = secondsSince(start);
+        hashes[t] = imageHash(ppm);
+        if(t == 1){
+            ppm.writeFile("pictures/compressedBVH.ppm", false, GAMMA);
+        }
+    }
+
+    std::cout << std::fixed;
+    std::cout << "               nodes    tree (MB)  build (s)  SAH cost  render (s)" << std::endl;
+    std::cout << "BVH         " << std::setw(9) << bvhPtr->nodeCount() << std::setprecision(1) << std::setw(11)
+        << bvhPtr->memoryBytes() / double(1 << 20) << std::setprecision(3) << std::setw(11) << bvhSeconds
+        << std::setprecision(2) << std::setw(10) << bvhPtr->sahCost() << std::setprecision(3) << std::setw(11) << renderSeconds[0] << std::endl;
+    std::cout << "compressed  " << std::setw(9) << compressedPtr->nodeCount() << std::setprecision(1) << std::setw(11)
+        << compressedPtr->memoryBytes() / double(1 << 20) << std::setprecision(3) << std::setw(11) << compressedSeconds
+        << std::setprecision(2) << std::setw(10) << compressedPtr->sahCost() << std::setprecision(3) << std::setw(11) << renderSeconds[1] << std::endl;
+    std::cout << "Tree memory is the nodes, the primitive indices and the object pointers, "
+        << sizeof(BVHNode) << " and " << sizeof(CompressedBVHNode) << " bytes per node." << std::endl;
+    std::cout << same << " of " << rays << " random rays hit the same." << std::endl;
+    bool identical = hashes[0] == hashes[1] && same == rays;
+    std::cout << (identical ? "The images are identical." : "The images differ!") << std::endl;
+    return identical ? 0 : 1;
+}
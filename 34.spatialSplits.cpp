@@ -0,0 +1,206 @@
+// Builds BVHs with object splits only (BVH_SAH) and with spatial splits
+// (BVH_SBVH) for two scenes whose primitives overlap a lot: the random
+// scene on its 1000 radius ground sphere, and long thin triangles leaning
+// in every direction. Prints the references in the leaves, the nodes, the
+// SAH cost, the build time and the time to render a small image on one
+// thread. Random rays must hit the same primitive at the same distance with
+// both trees, so the images must be identical.
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include "tools/ppmMSAA.h"
+#include "tools/camera.h"
+#include "tools/ray.h"
+#include "tools/objects/objectList.h"
+#include "tools/objects/bvh.h"
+#include "tools/objects/sphere.h"
+#include "tools/objects/triangle.h"
+#include "tools/util.h"
+#include "tools/materials/lambertian.h"
+#include "tools/materials/metal.h"
+#include "tools/materials/dielectric.h"
+
+class PixelShader: public PixelCallback{
+public:
+    PixelShader(shared_ptr<Camera> cameraPtr,
+            shared_ptr<ObjectList> objectListPtr, int maxDepth = 50)
+            :cameraPtr(cameraPtr), objectListPtr(objectListPtr), maxDepth(maxDepth){}
+    virtual ~PixelShader(){}
+    virtual RGB operator()(double x, double y){
+        Ray ray = cameraPtr->getRayXY(x, y);
+        return shadeByDepth(ray, maxDepth);
+    }
+
+protected:
+    RGB backgroundColor(const Ray& r){
+        Vec3 dir = normalize(r.direction());
+        auto t = 0.5 * (dir.y() + 1.0);
+        return interpolate(
+            Color(1.0, 1.0, 1.0),
+            Color(0.5, 0.7, 1.0),
+            t);
+    }
+
+    RGB shadeByDepth(const Ray& ray, int depth){
+        if(depth <= 0){
+            return RGB();
+        }
+        HitRecord hitRecord;
+        if(objectListPtr->hit(ray, &hitRecord, TINY, INF)){
+            Ray scattered;
+            RGB attenuation;
+            if(hitRecord.matPtr &&
+                    hitRecord.matPtr->scatter(ray, hitRecord, attenuation, scattered)){
+                return attenuation * shadeByDepth(scattered, depth - 1);
+            }
+            return RGB();
+        }
+        return backgroundColor(ray);
+    }
+
+    shared_ptr<Camera> cameraPtr;
+    shared_ptr<ObjectList> objectListPtr;
+    int maxDepth;
+};
+
+shared_ptr<ObjectList> randomScene(){
+    auto worldPtr = make_shared<ObjectList>();
+    worldPtr->add(make_shared<Sphere>(
+        Point3(0,-1000,0), 1000, make_shared<Lambertian>(RGB(0.5, 0.5, 0.5)*PI)));
+
+    auto albedoGlass = RGB(1.0, 1.0, 1.0)*PI;
+    Real fuzzGlass = 0.0;
+    for(int a = -11; a < 11; ++a){
+        for(int b = -11; b < 11; ++b){
+            auto chooseMat = randomDouble();
+            Point3 center(a + 0.9 * randomDouble(), 0.2, b + 0.9 * randomDouble());
+            if((center - Vec3(4, 0.2, 0)).length() > 0.9){
+                if(chooseMat < 0.8){
+                    //diffuse
+                    auto albedo = RGB::random() * RGB::random() * PI;
+                    worldPtr->add(make_shared<Sphere>(
+                        center, 0.2,
+                        make_shared<Lambertian>(albedo)));
+                }
+                else if(chooseMat < 0.95){
+                    //metal
+                    auto albedo = RGB::random(0.5, 1.0) * PI;
+                    auto fuzz = randomDouble(0, 0.5);
+                    worldPtr->add(make_shared<Sphere>(
+                        center, 0.2,
+                        make_shared<Metal>(albedo, fuzz)));
+                }
+                else{
+                    //dielectric
+                    worldPtr->add(make_shared<Sphere>(
+                        center, 0.2,
+                        make_shared<Dielectric>(albedoGlass, fuzzGlass, 1.5)));
+                }
+            }
+        }
+    }
+    worldPtr->add(make_shared<Sphere>(
+        Point3(0, 1, 0), 1.0,
+        make_shared<Dielectric>(albedoGlass, fuzzGlass, 1.5)));
+    worldPtr->add(make_shared<Sphere>(
+        Point3(-4, 1, 0), 1.0,
+        make_shared<Lambertian>(RGB(0.4, 0.2, 0.1)*PI)));
+    worldPtr->add(make_shared<Sphere>(
+        Point3(4, 1, 0), 1.0,
+        make_shared<Metal>(RGB(0.7, 0.6, 0.5)*PI)));
+    return worldPtr;
+}
+
+// n thin triangles, 4 to 12 long, leaning in random directions over the
+// ground, so their boxes are large and overlap.
+shared_ptr<ObjectList> strawScene(int n){
+    seedRandom(5);
+    auto worldPtr = make_shared<ObjectList>();
+    worldPtr->add(make_shared<Sphere>(
+        Point3(0,-1000,0), 1000, make_shared<Lambertian>(RGB(0.5, 0.5, 0.5)*PI)));
+    shared_ptr<Material> materials[] = {
+        make_shared<Lambertian>(RGB(0.8, 0.7, 0.3)*PI), make_shared<Lambertian>(RGB(0.5, 0.6, 0.2)*PI),
+        make_shared<Metal>(RGB(0.8, 0.8, 0.7)*PI, 0.2)};
+    for(int i = 0; i < n; ++i){
+        Point3 base(randomDouble(-10, 10), 0, randomDouble(-10, 10));
+        Vec3 dir = normalize(Vec3(randomDouble(-1, 1), randomDouble(0.1, 0.6), randomDouble(-1, 1)));
+        Vec3 side = 0.03 * normalize(cross(dir, Vec3::randomVectorSphere(1.0)));
+        worldPtr->add(make_shared<Triangle>(base - side, base + side, base + randomDouble(4, 12) * dir, materials[i % 3]));
+    }
+    return worldPtr;
+}
+
+// FNV-1a over the bytes of every pixel.
+std::uint64_t imageHash(const PPM& ppm){
+    std::uint64_t hash = 14695981039346656037ULL;
+    for(int h = 0; h < ppm.imageHeight(); ++h){
+        for(int w = 0; w < ppm.imageWidth(); ++w){
+            RGB pixel = ppm.pixel(h, w);
+            for(int c = 0; c < 3; ++c){
+                Real value = pixel[c];
+                unsigned char bytes[sizeof(Real)];
+                std::memcpy(bytes, &value, sizeof(Real));
+                for(unsigned char b: bytes){
+                    hash = (hash ^ b) * 1099511628211ULL;
+                }
+            }
+        }
+    }
+    return hash;
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Prints a line per builder and returns whether both trees hit the same.
+bool compareBuilders(const char* name, shared_ptr<ObjectList> listPtr, shared_ptr<Camera> cameraPtr, const Point3& target){
+    const BVHBuilder builders[] = {BVH_SAH, BVH_SBVH};
+    const char* builderNames[] = {"SAH", "SBVH"};
+    shared_ptr<BVH> trees[2];
+    std::uint64_t hashes[2];
+    std::cout << name << ", " << listPtr->size() << " primitives" << std::endl;
+    std::cout << "builder  references    nodes  SAH cost  build (s)  render (s)" << std::endl;
+    for(int b = 0; b < 2; ++b){
+        auto start = std::chrono::steady_clock::now();
+        trees[b] = make_shared<BVH>(*listPtr, 4, builders[b]);
+        double buildSeconds = secondsSince(start);
+        PixelShader pixelShader(cameraPtr, trees[b], 8);
+        PPMMSAA ppm(240, 135, 4, 0.5);
+        start = std::chrono::steady_clock::now();
+        ppm.shadeTiles(&pixelShader, 16, 1, false);
+        double renderSeconds = secondsSince(start);
+        hashes[b] = imageHash(ppm);
+        std::cout << std::left << std::setw(7) << builderNames[b] << std::right << std::setw(12) << trees[b]->referenceCount()
+            << std::setw(9) << trees[b]->nodeCount() << std::fixed << std::setprecision(2) << std::setw(10) << trees[b]->sahCost()
+            << std::setprecision(3) << std::setw(11) << buildSeconds << std::setw(12) << renderSeconds << std::endl;
+    }
+    // Rays from around the scene towards random points near the target.
+    seedRandom(4);
+    int same = 0, rays = 100000;
+    for(int i = 0; i < rays; ++i){
+        Point3 from = target + 30 * Vec3::randomVectorSphere(1.0);
+        Point3 to = target + Vec3(randomDouble(-10, 10), randomDouble(-2, 2), randomDouble(-10, 10));
+        Ray ray(from, to - from);
+        HitRecord a, b;
+        bool hitA = trees[0]->hit(ray, &a, TINY, INF), hitB = trees[1]->hit(ray, &b, TINY, INF);
+        same += hitA == hitB && (!hitA || (a.t == b.t && a.objectIndex == b.objectIndex));
+    }
+    std::cout << same << " of " << rays << " random rays hit the same, the images are "
+        << (hashes[0] == hashes[1] ? "identical." : "different!") << std::endl << std::endl;
+    return same == rays && hashes[0] == hashes[1];
+}
+
+// Usage: 34.spatialSplits [triangles]
+int main(int argc, char** argv){
+    int n = argc > 1 ? std::atoi(argv[1]) : 20000;
+    const auto aspectRatio = 16.0/9.0;
+    seedRandom(2);
+    auto randomCameraPtr = make_shared<Camera>(Point3(13,2,3), Point3(0,0,0), Vec3(0,1,0), 20.0, aspectRatio, 0.0, 10.0);
+    bool same = compareBuilders("Random scene", randomScene(), randomCameraPtr, Point3(0,0,0));
+    auto strawCameraPtr = make_shared<Camera>(Point3(18,8,18), Point3(0,2,0), Vec3(0,1,0), 40.0, aspectRatio, 0.0, 25.0);
+    same = compareBuilders("Straws", strawScene(n), strawCameraPtr, Point3(0,2,0)) && same;
+    return same ? 0 : 1;
+}
@@ -0,0 +1,230 @@
+// Compares the accelerators on three scenes: the random scene, whose small
+// spheres lie evenly on a ground sphere, a million spheres in clusters, and
+// long thin triangles. For each it prints the build time, the memory, and
+// the rays per second on one thread for camera rays and for rays leaving
+// the hit points in random directions, and counts the rays whose closest
+// hit differs from the binned SAH BVH.
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include <vector>
+#include <functional>
+#include "tools/camera.h"
+#include "tools/ray.h"
+#include "tools/objects/objectList.h"
+#include "tools/objects/bvh.h"
+#include "tools/objects/compressedBVH.h"
+#include "tools/objects/grid.h"
+#include "tools/objects/sphere.h"
+#include "tools/objects/triangle.h"
+#include "tools/util.h"
+#include "tools/materials/lambertian.h"
+#include "tools/materials/metal.h"
+#include "tools/materials/dielectric.h"
+
+shared_ptr<ObjectList> randomScene(){
+    auto worldPtr = make_shared<ObjectList>();
+    worldPtr->add(make_shared<Sphere>(
+        Point3(0,-1000,0), 1000, make_shared<Lambertian>(RGB(0.5, 0.5, 0.5)*PI)));
+
+    auto albedoGlass = RGB(1.0, 1.0, 1.0)*PI;
+    Real fuzzGlass = 0.0;
+    for(int a = -11; a < 11; ++a){
+        for(int b = -11; b < 11; ++b){
+            auto chooseMat = randomDouble();
+            Point3 center(a + 0.9 * randomDouble(), 0.2, b + 0.9 * randomDouble());
+            if((center - Vec3(4, 0.2, 0)).length() > 0.9){
+                if(chooseMat < 0.8){
+                    //diffuse
+                    auto albedo = RGB::random() * RGB::random() * PI;
+                    worldPtr->add(make_shared<Sphere>(
+                        center, 0.2,
+                        make_shared<Lambertian>(albedo)));
+                }
+                else if(chooseMat < 0.95){
+                    //metal
+                    auto albedo = RGB::random(0.5, 1.0) * PI;
+                    auto fuzz = randomDouble(0, 0.5);
+                    worldPtr->add(make_shared<Sphere>(
+                        center, 0.2,
+                        make_shared<Metal>(albedo, fuzz)));
+                }
+                else{
+                    //dielectric
+                    worldPtr->add(make_shared<Sphere>(
+                        center, 0.2,
+                        make_shared<Dielectric>(albedoGlass, fuzzGlass, 1.5)));
+                }
+            }
+        }
+    }
+    worldPtr->add(make_shared<Sphere>(
+        Point3(0, 1, 0), 1.0,
+        make_shared<Dielectric>(albedoGlass, fuzzGlass, 1.5)));
+    worldPtr->add(make_shared<Sphere>(
+        Point3(-4, 1, 0), 1.0,
+        make_shared<Lambertian>(RGB(0.4, 0.2, 0.1)*PI)));
+    worldPtr->add(make_shared<Sphere>(
+        Point3(4, 1, 0), 1.0,
+        make_shared<Metal>(RGB(0.7, 0.6, 0.5)*PI)));
+    return worldPtr;
+}
+
+// n spheres in clusters of different sizes and densities above a ground,
+// sharing a few materials.
+shared_ptr<ObjectList> clusteredSpheres(int n){
+    seedRandom(3);
+    auto worldPtr = make_shared<ObjectList>();
+    worldPtr->add(make_shared<Sphere>(
+        Point3(0,-10000,0), 10000, make_shared<Lambertian>(RGB(0.5, 0.5, 0.5)*PI)));
+    shared_ptr<Material> materials[] = {
+        make_shared<Lambertian>(RGB(0.8, 0.3, 0.2)*PI), make_shared<Lambertian>(RGB(0.2, 0.6, 0.3)*PI),
+        make_shared<Lambertian>(RGB(0.3, 0.3, 0.8)*PI), make_shared<Metal>(RGB(0.8, 0.8, 0.7)*PI, 0.1)};
+    const int clusters = 200;
+    for(int c = 0; c < clusters; ++c){
+        Point3 center(randomDouble(-40, 40), randomDouble(1, 8), randomDouble(-40, 40));
+        Real spread = randomDouble(0.5, 4);
+        for(int i = 0; i < (n - 1) / clusters; ++i){
+            Point3 p = center + spread * Vec3::randomVectorSphere(1.0);
+            worldPtr->add(make_shared<Sphere>(p, randomDouble(0.01, 0.05), materials[i % 4]));
+        }
+    }
+    return worldPtr;
+}
+
+// n thin triangles, 4 to 12 long, leaning in random directions over the
+// ground, so their boxes are large and overlap.
+shared_ptr<ObjectList> strawScene(int n){
+    seedRandom(5);
+    auto worldPtr = make_shared<ObjectList>();
+    worldPtr->add(make_shared<Sphere>(
+        Point3(0,-1000,0), 1000, make_shared<Lambertian>(RGB(0.5, 0.5, 0.5)*PI)));
+    shared_ptr<Material> materials[] = {
+        make_shared<Lambertian>(RGB(0.8, 0.7, 0.3)*PI), make_shared<Lambertian>(RGB(0.5, 0.6, 0.2)*PI),
+        make_shared<Metal>(RGB(0.8, 0.8, 0.7)*PI, 0.2)};
+    for(int i = 0; i < n; ++i){
+        Point3 base(randomDouble(-10, 10), 0, randomDouble(-10, 10));
+        Vec3 dir = normalize(Vec3(randomDouble(-1, 1), randomDouble(0.1, 0.6), randomDouble(-1, 1)));
+        Vec3 side = 0.03 * normalize(cross(dir, Vec3::randomVectorSphere(1.0)));
+        worldPtr->add(make_shared<Triangle>(base - side, base + side, base + randomDouble(4, 12) * dir, materials[i % 3]));
+    }
+    return worldPtr;
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+struct Accelerator{
+    const char* name;
+    std::function<shared_ptr<ObjectList>(const ObjectList&, std::size_t&)> make;
+};
+
+// Camera rays through random points of the image, and from each hit a ray
+// in a random direction of the hemisphere around the normal.
+void makeRays(ObjectList& reference, const Camera& camera, int n, std::vector<Ray>& primary, std::vector<Ray>& secondary){
+    for(int i = 0; i < n; ++i){
+        Ray ray = camera.getRayXY(randomDouble(-1, 1), randomDouble(-1, 1));
+        primary.push_back(ray);
+        HitRecord hitRecord;
+        if(reference.hit(ray, &hitRecord, TINY, INF)){
+            secondary.push_back(Ray(hitRecord.pos, hitRecord.normal + Vec3::randomVectorSphere(1.0)));
+        }
+    }
+}
+
+// Returns the seconds to trace the rays and counts the closest hits that
+// differ from those in t and objectIndex.
+double traceRays(ObjectList& accelerator, const std::vector<Ray>& rays, std::vector<Real>& t, std::vector<int>& index, int& different){
+    bool compare = !t.empty();
+    t.resize(rays.size());
+    index.resize(rays.size());
+    auto start = std::chrono::steady_clock::now();
+    for(std::size_t i = 0; i < rays.size(); ++i){
+        HitRecord hitRecord;
+        bool hit = accelerator.hit(rays[i], &hitRecord, TINY, INF);
+        Real hitT = hit ? hitRecord.t : INF;
+        int hitIndex = hit ? hitRecord.objectIndex : -1;
+        if(compare){
+            different += hitT != t[i] || hitIndex != index[i];
+        }
+        else{
+            t[i] = hitT;
+            index[i] = hitIndex;
+        }
+    }
+    return secondsSince(start);
+}
+
+void compareAccelerators(const char* name, shared_ptr<ObjectList> listPtr, const Camera& camera, int nRays){
+    std::vector<Accelerator> accelerators = {
+        {"BVH SAH", [](const ObjectList& list, std::size_t& bytes){
+            auto bvhPtr = make_shared<BVH>(list);
+            bytes = bvhPtr->memoryBytes();
+            return bvhPtr;
+        }},
+        {"BVH SBVH", [](const ObjectList& list, std::size_t& bytes){
+            auto bvhPtr = make_shared<BVH>(list, 4, BVH_SBVH);
+            bytes = bvhPtr->memoryBytes();
+            return bvhPtr;
+        }},
+        {"BVH LBVH", [](const ObjectList& list, std::size_t& bytes){
+            auto bvhPtr = make_shared<BVH>(list, 4, BVH_LBVH);
+            bytes = bvhPtr->memoryBytes();
+            return bvhPtr;
+        }},
+        {"compressed BVH", [](const ObjectList& list, std::size_t& bytes){
+            auto bvhPtr = make_shared<CompressedBVH>(list);
+            bytes = bvhPtr->memoryBytes();
+            return bvhPtr;
+        }},
+        {"uniform grid", [](const ObjectList& list, std::size_t& bytes){
+            auto gridPtr = make_shared<Grid>(list, 2, false);
+            bytes = gridPtr->memoryBytes();
+            return gridPtr;
+        }},
+        {"two-level grid", [](const ObjectList& list, std::size_t& bytes){
+            auto gridPtr = make_shared<Grid>(list, 2, true);
+            bytes = gridPtr->memoryBytes();
+            return gridPtr;
+        }}
+    };
+    std::cout << name << ", " << listPtr->size() << " primitives" << std::endl;
+    std::cout << "accelerator     build (s)  memory (MB)  camera (Mrays/s)  random (Mrays/s)  different" << std::endl;
+    std::vector<Ray> primary, secondary;
+    std::vector<Real> primaryT, secondaryT;
+    std::vector<int> primaryIndex, secondaryIndex;
+    for(const Accelerator& accelerator: accelerators){
+        std::size_t bytes = 0;
+        auto start = std::chrono::steady_clock::now();
+        auto acceleratorPtr = accelerator.make(*listPtr, bytes);
+        double buildSeconds = secondsSince(start);
+        if(primary.empty()){
+            seedRandom(6);
+            makeRays(*acceleratorPtr, camera, nRays, primary, secondary);
+        }
+        int different = 0;
+        double primarySeconds = traceRays(*acceleratorPtr, primary, primaryT, primaryIndex, different);
+        double secondarySeconds = traceRays(*acceleratorPtr, secondary, secondaryT, secondaryIndex, different);
+        std::cout << std::left << std::setw(15) << accelerator.name << std::right << std::fixed << std::setprecision(3)
+            << std::setw(10) << buildSeconds << std::setprecision(1) << std::setw(13) << bytes / double(1 << 20)
+            << std::setprecision(2) << std::setw(18) << primary.size() / primarySeconds * 1e-6
+            << std::setw(18) << secondary.size() / secondarySeconds * 1e-6 << std::setw(11) << different << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+// Usage: 35.grid [rays]
+int main(int argc, char** argv){
+    int nRays = argc > 1 ? std::atoi(argv[1]) : 200000;
+    const auto aspectRatio = 16.0/9.0;
+    seedRandom(2);
+    Camera randomCamera(Point3(13,2,3), Point3(0,0,0), Vec3(0,1,0), 20.0, aspectRatio, 0.0, 10.0);
+    compareAccelerators("Random scene", randomScene(), randomCamera, nRays);
+    Camera clusterCamera(Point3(0,20,70), Point3(0,2,0), Vec3(0,1,0), 40.0, aspectRatio, 0.0, 70.0);
+    compareAccelerators("Clusters", clusteredSpheres(1000000), clusterCamera, nRays);
+    Camera strawCamera(Point3(18,8,18), Point3(0,2,0), Vec3(0,1,0), 40.0, aspectRatio, 0.0, 25.0);
+    compareAccelerators("Straws", strawScene(20000), strawCamera, nRays);
+    return 0;
+}
@@ -0,0 +1,120 @@
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+#include <new>
+#include <atomic>
+#include <cstdlib>
+#include <cstdint>
+#include <cstddef>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+// Replaces the global operator new and delete to count heap allocations of
+// the whole program and of each thread, to check that a loop does not
+// allocate. It defines the replacements, so include it in one source file
+// of a program only.
+#ifdef _MSC_VER
+#define ALLOCATION_COUNTER_NOINLINE __declspec(noinline)
+#else
+#define ALLOCATION_COUNTER_NOINLINE __attribute__((noinline))
+#endif
+
+namespace allocationCounter{
+    static std::atomic<std::uint64_t> totalCount(0);
+    static thread_local std::uint64_t threadCount = 0;
+
+    // Out of line, so the compiler does not pair malloc and free inlined
+    // into new and delete expressions and warn about mismatches.
+    ALLOCATION_COUNTER_NOINLINE static void* allocate(std::size_t size, std::size_t alignment = 0){
+        ++threadCount;
+        totalCount.fetch_add(1, std::memory_order_relaxed);
+        size = size > 0 ? size : 1;
+        void* p = nullptr;
+        if(alignment <= alignof(std::max_align_t)){
+            p = std::malloc(size);
+        }
+        else{
+#ifdef _WIN32
+            p = _aligned_malloc(size, alignment);
+#else
+            if(posix_memalign(&p, alignment, size) != 0){
+                p = nullptr;
+            }
+#endif
+        }
+        if(p == nullptr){
+            throw std::bad_alloc();
+        }
+        return p;
+    }
+    ALLOCATION_COUNTER_NOINLINE static void deallocate(void* p, std::size_t alignment = 0)noexcept{
+#ifdef _WIN32
+        if(alignment > alignof(std::max_align_t)){
+            _aligned_free(p);
+            return;
+        }
+#endif
+        std::free(p);
+    }
+    static void* allocateNoThrow(std::size_t size, std::size_t alignment = 0)noexcept{
+        try{
+            return allocate(size, alignment);
+        }
+        catch(...){
+            return nullptr;
+        }
+    }
+}
+
+// Allocations of the program so far.
+inline std::uint64_t allocationCount(){ return allocationCounter::totalCount.load(); }
+// Allocations of the calling thread so far.
+inline std::uint64_t threadAllocationCount(){ return allocationCounter::threadCount; }
+
+void* operator new(std::size_t size){ return allocationCounter::allocate(size); }
+void* operator new[](std::size_t size){ return allocationCounter::allocate(size); }
+void* operator new(std::size_t size, const std::nothrow_t&)noexcept{ return allocationCounter::allocateNoThrow(size); }
+void* operator new[](std::size_t size, const std::nothrow_t&)noexcept{ return allocationCounter::allocateNoThrow(size); }
+void operator delete(void* p)noexcept{ allocationCounter::deallocate(p); }
+void operator delete[](void* p)noexcept{ allocationCounter::deallocate(p); }
+void operator delete(void* p, std::size_t)noexcept{ allocationCounter::deallocate(p); }
+void operator delete[](void* p, std::size_t)noexcept{ allocationCounter::deallocate(p); }
+void operator delete(void* p, const std::nothrow_t&)noexcept{ allocationCounter::deallocate(p); }
+void operator delete[](void* p, const std::nothrow_t&)noexcept{ allocationCounter::deallocate(p); }
+
+#ifdef __cpp_aligned_new
+// Over-aligned types, e.g. Vec3 with USE_SIMD_VEC3, allocate through these.
+void* operator new(std::size_t size, std::align_val_t alignment){
+    return allocationCounter::allocate(size, static_cast<std::size_t>(alignment));
+}
+void* operator new[](std::size_t size, std::align_val_t alignment){
+    return allocationCounter::allocate(size, static_cast<std::size_t>(alignment));
+}
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&)noexcept{
+    return allocationCounter::allocateNoThrow(size, static_cast<std::size_t>(alignment));
+}
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&)noexcept{
+    return allocationCounter::allocateNoThrow(size, static_cast<std::size_t>(alignment));
+}
+void operator delete(void* p, std::align_val_t alignment)noexcept{
+    allocationCounter::deallocate(p, static_cast<std::size_t>(alignment));
+}
+void operator delete[](void* p, std::align_val_t alignment)noexcept{
+    allocationCounter::deallocate(p, static_cast<std::size_t>(alignment));
+}
+void operator delete(void* p, std::size_t, std::align_val_t alignment)noexcept{
+    allocationCounter::deallocate(p, static_cast<std::size_t>(alignment));
+}
+void operator delete[](void* p, std::size_t, std::align_val_t alignment)noexcept{
+    allocationCounter::deallocate(p, static_cast<std::size_t>(alignment));
+}
+void operator delete(void* p, std::align_val_t alignment, const std::nothrow_t&)noexcept{
+    allocationCounter::deallocate(p, static_cast<std::size_t>(alignment));
+}
+void operator delete[](void* p, std::align_val_t alignment, const std::nothrow_t&)noexcept{
+    allocationCounter::deallocate(p, static_cast<std::size_t>(alignment));
+}
+#endif
+
+#endif
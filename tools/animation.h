@@ -0,0 +1,128 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include "camera.h"
+#include "transform.h"
+#include "objects/object.h"
+#include "objects/instance.h"
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <utility>
+
+using std::shared_ptr;
+
+// Values at key times, linearly interpolated in between and held before
+// the first and after the last key. Keys must be added in time order.
+template<typename T>
+class Track{
+public:
+    void addKey(Real time, const T& value){
+        times.push_back(time);
+        values.push_back(value);
+    }
+    bool empty()const{ return times.empty(); }
+
+    T at(Real time)const{
+        if(time <= times.front()){
+            return values.front();
+        }
+        if(time >= times.back()){
+            return values.back();
+        }
+        int i = static_cast<int>(std::upper_bound(times.begin(), times.end(), time) - times.begin()) - 1;
+        Real t = (time - times[i]) / (times[i + 1] - times[i]);
+        return (1 - t) * values[i] + t * values[i + 1];
+    }
+protected:
+    std::vector<Real> times;
+    std::vector<T> values;
+};
+
+// Keyframed placement of an instance: scale, then rotation in degrees around
+// x, y and z in that order, then translation. Each part is interpolated on
+// its own, so rotations should be keyed less than half a turn apart.
+class TransformTrack{
+public:
+    void addKey(Real time, const Point3& position, const Vec3& degrees = Vec3(0, 0, 0), const Vec3& factor = Vec3(1, 1, 1)){
+        translation.addKey(time, position);
+        rotation.addKey(time, degrees);
+        scale.addKey(time, factor);
+    }
+    bool empty()const{ return translation.empty(); }
+
+    Transform at(Real time)const{
+        Vec3 degrees = rotation.at(time);
+        return Transform::translate(translation.at(time))
+            * Transform::rotate(Vec3(0, 0, 1), degrees.z())
+            * Transform::rotate(Vec3(0, 1, 0), degrees.y())
+            * Transform::rotate(Vec3(1, 0, 0), degrees.x())
+            * Transform::scale(scale.at(time));
+    }
+protected:
+    Track<Point3> translation;
+    Track<Vec3> rotation, scale;
+};
+
+// Keyframed camera, object positions and instance placements. Plain objects
+// only move, instances also turn and scale.
+class Animation{
+public:
+    Animation(const Vec3& up = Vec3(0, 1, 0), Real aspectRatio = 16.0/9.0, Real aperture = 0, Real focusDist = 1.0)
+            :up(up), aspectRatio(aspectRatio), aperture(aperture), focusDist(focusDist){}
+
+    void addCameraKey(Real time, const Point3& pos, const Point3& lookAt, Real vfov){
+        cameraPos.addKey(time, pos);
+        cameraLookAt.addKey(time, lookAt);
+        cameraFov.addKey(time, vfov);
+    }
+    // Keys of the same object must go into one track, in time order.
+    Track<Point3>& objectTrack(shared_ptr<Object> object){
+        for(auto& objectTrack: objectTracks){
+            if(objectTrack.first == object){
+                return objectTrack.second;
+            }
+        }
+        objectTracks.push_back(std::make_pair(object, Track<Point3>()));
+        return objectTracks.back().second;
+    }
+    // Keys of the same instance must go into one track, in time order.
+    TransformTrack& instanceTrack(shared_ptr<Instance> instance){
+        for(auto& instanceTrack: instanceTracks){
+            if(instanceTrack.first == instance){
+                return instanceTrack.second;
+            }
+        }
+        instanceTracks.push_back(std::make_pair(instance, TransformTrack()));
+        return instanceTracks.back().second;
+    }
+
+    Camera cameraAt(Real time)const{
+        return Camera(cameraPos.at(time), cameraLookAt.at(time), up, cameraFov.at(time),
+            aspectRatio, aperture, focusDist);
+    }
+    // Moves the animated objects and instances to where they are at time.
+    // Acceleration structures holding them must be refit afterwards.
+    void apply(Real time)const{
+        for(const auto& objectTrack: objectTracks){
+            if(!objectTrack.second.empty()){
+                objectTrack.first->moveTo(objectTrack.second.at(time));
+            }
+        }
+        for(const auto& instanceTrack: instanceTracks){
+            if(!instanceTrack.second.empty()){
+                instanceTrack.first->setTransform(instanceTrack.second.at(time));
+            }
+        }
+    }
+
+protected:
+    Track<Point3> cameraPos, cameraLookAt;
+    Track<Real> cameraFov;
+    std::vector<std::pair<shared_ptr<Object>, Track<Point3> > > objectTracks;
+    std::vector<std::pair<shared_ptr<Instance>, TransformTrack> > instanceTracks;
+    Vec3 up;
+    Real aspectRatio, aperture, focusDist;
+};
+
+#endif
@@ -0,0 +1,169 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+#include <cstdint>
+#include <algorithm>
+#include <new>
+#include <utility>
+
+// Memory for the objects and materials of a scene, taken from large blocks
+// in order of creation, so a scene of a million spheres is a few hundred
+// allocations instead of a million and the objects lie next to each other.
+// make returns an ordinary shared_ptr: the control block lies in the arena
+// next to the object, and the object is destroyed as usual when its last
+// pointer goes. The blocks are only freed all at once, when the arena and
+// every object made in it are gone, so the scene can outlive the arena.
+// Making objects is not thread-safe, sharing them is.
+class SceneArena{
+public:
+    // Blocks are aligned to their size.
+    static const std::size_t BLOCK_SIZE = 1 << 20;
+
+    SceneArena():storagePtr(new Storage()){}
+    ~SceneArena(){ storagePtr->release(); }
+    SceneArena(const SceneArena&) = delete;
+    SceneArena& operator=(const SceneArena&) = delete;
+
+    template<typename T, typename... Args>
+    std::shared_ptr<T> make(Args&&... args){
+        Storage*& current = currentStorage();
+        Storage* previous = current;
+        current = storagePtr;
+        std::shared_ptr<T> ptr;
+        try{
+            ptr = std::allocate_shared<T>(Allocator<T>(), std::forward<Args>(args)...);
+        }
+        catch(...){
+            current = previous;
+            throw;
+        }
+        current = previous;
+        return ptr;
+    }
+
+    // Bytes handed out and bytes of the blocks taken from the heap.
+    std::size_t bytesUsed()const{ return storagePtr->used; }
+    std::size_t bytesReserved()const{ return storagePtr->reserved; }
+    int blockCount()const{ return static_cast<int>(storagePtr->blocks.size()); }
+
+protected:
+    struct Storage;
+    // Every block starts with its storage, so deallocate finds the storage
+    // from the address alone.
+    struct alignas(16) BlockHeader{
+        Storage* storagePtr;
+    };
+
+    struct Storage{
+        Storage()
+                :current(nullptr), end(nullptr), used(0), reserved(0), references(1){}
+        ~Storage(){
+            for(void* block: blocks){
+#ifdef _WIN32
+                _aligned_free(block);
+#else
+                std::free(block);
+#endif
+            }
+        }
+
+        void* allocate(std::size_t bytes, std::size_t alignment){
+            // Large requests get blocks of their own, which start with the
+            // object, and small ones go on in the current block.
+            if(sizeof(BlockHeader) + bytes + alignment > BLOCK_SIZE){
+                std::size_t size = (sizeof(BlockHeader) + bytes + alignment + BLOCK_SIZE - 1) & ~(BLOCK_SIZE - 1);
+                char* block = newBlock(size);
+                return take(alignUp(block + sizeof(BlockHeader), alignment), bytes);
+            }
+            std::uintptr_t start = alignUp(current, alignment);
+            if(current == nullptr || start + bytes > reinterpret_cast<std::uintptr_t>(end)){
+                char* block = newBlock(BLOCK_SIZE);
+                current = block + sizeof(BlockHeader);
+                end = block + BLOCK_SIZE;
+                start = alignUp(current, alignment);
+            }
+            current = reinterpret_cast<char*>(start + bytes);
+            return take(start, bytes);
+        }
+        static std::uintptr_t alignUp(const char* p, std::size_t alignment){
+            return (reinterpret_cast<std::uintptr_t>(p) + alignment - 1) & ~(alignment - 1);
+        }
+        char* newBlock(std::size_t size){
+            char* block = static_cast<char*>(alignedMalloc(size));
+            if(block == nullptr){
+                throw std::bad_alloc();
+            }
+            new(block) BlockHeader{this};
+            blocks.push_back(block);
+            reserved += size;
+            return block;
+        }
+        void* take(std::uintptr_t start, std::size_t bytes){
+            used += bytes;
+            references.fetch_add(1, std::memory_order_relaxed);
+            return reinterpret_cast<void*>(start);
+        }
+        static void* alignedMalloc(std::size_t size){
+#ifdef _WIN32
+            return _aligned_malloc(size, BLOCK_SIZE);
+#else
+            void* block = nullptr;
+            return posix_memalign(&block, BLOCK_SIZE, size) == 0 ? block : nullptr;
+#endif
+        }
+        // Each allocation and the arena hold a reference.
+        void release(){
+            if(references.fetch_sub(1, std::memory_order_acq_rel) == 1){
+                delete this;
+            }
+        }
+
+        std::vector<char*> blocks;
+        char* current;
+        char* end;
+        std::size_t used, reserved;
+        std::atomic<long> references;
+    };
+
+    // The arena of the make call running on this thread.
+    static Storage*& currentStorage(){
+        thread_local Storage* storagePtr = nullptr;
+        return storagePtr;
+    }
+
+    // Empty, so control blocks do not store it.
+    template<typename T>
+    struct Allocator{
+        typedef T value_type;
+
+        Allocator(){}
+        template<typename U>
+        Allocator(const Allocator<U>&){}
+
+        T* allocate(std::size_t n){
+            return static_cast<T*>(currentStorage()->allocate(n * sizeof(T), alignof(T)));
+        }
+        void deallocate(T* p, std::size_t){
+            // Objects start in the first BLOCK_SIZE bytes of their block.
+            std::uintptr_t block = reinterpret_cast<std::uintptr_t>(p) & ~std::uintptr_t(BLOCK_SIZE - 1);
+            reinterpret_cast<const BlockHeader*>(block)->storagePtr->release();
+        }
+
+        template<typename U>
+        bool operator==(const Allocator<U>&)const{ return true; }
+        template<typename U>
+        bool operator!=(const Allocator<U>&)const{ return false; }
+    };
+
+    Storage* storagePtr;
+};
+
+#endif
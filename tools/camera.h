@@ -2,6 +2,7 @@
 #define CAMERA_H
 
 #include "ray.h"
+#include "rayPacket.h"
 
 class Camera{
 public:
@@ -15,16 +16,18 @@ public:
         pos = Point3(0.0, 0.0, 0.0);
         lensRadius = 0;
         center = lowerLeftCorner + 0.5*horizontal + 0.5*vertical;
+        shutterOpen = shutterClose = 0;
     }
     
     Camera(const Point3& pos, const Vec3& horizontal, const Vec3& vertical, 
-            const Point3& lowerLeftCorner, double aperture = 0)
+            const Point3& lowerLeftCorner, Real aperture = 0)
             :lowerLeftCorner(lowerLeftCorner),
             horizontal(horizontal),
             vertical(vertical),
             pos(pos),
             lensRadius(aperture*0.5),
-            center(lowerLeftCorner + 0.5*horizontal + 0.5*vertical)
+            center(lowerLeftCorner + 0.5*horizontal + 0.5*vertical),
+            shutterOpen(0), shutterClose(0)
             {
         xAxis = normalize(horizontal);
         yAxis = normalize(vertical);
@@ -32,9 +35,9 @@ public:
     }
             
     Camera(const Point3& pos, const Point3& lookAt, const Vec3& up,
-            double vfov, double aspectRatio, 
-            double aperture = 0, double focusDist = 1.0)
-            :pos(pos), lensRadius(aperture*0.5){
+            Real vfov, Real aspectRatio, 
+            Real aperture = 0, Real focusDist = 1.0)
+            :pos(pos), lensRadius(aperture*0.5), shutterOpen(0), shutterClose(0){
         auto theta = degrees2radians(vfov);
         auto halfHeight = tan(theta*0.5);
         auto halfWidth = aspectRatio * halfHeight;
@@ -55,9 +58,24 @@ public:
             vertical(camera.vertical),
             pos(camera.pos),
             lensRadius(camera.lensRadius),
-            center(camera.center){}
+            center(camera.center),
+            xAxis(camera.xAxis),
+            yAxis(camera.yAxis),
+            zAxis(camera.zAxis),
+            shutterOpen(camera.shutterOpen),
+            shutterClose(camera.shutterClose){}
     
-    Ray getRayUV(double u, double v)const{
+    // Rays get a time uniform in [open, close], moving objects are where
+    // they are at that time. Both default to 0, no motion blur.
+    void setShutter(Real open, Real close){
+        shutterOpen = open;
+        shutterClose = close;
+    }
+    Real rayTime()const{
+        return shutterOpen < shutterClose ? randomDouble(shutterOpen, shutterClose) : shutterOpen;
+    }
+    
+    Ray getRayUV(Real u, Real v)const{
         if(lensRadius > 0){
             Vec3 randomDisk = //Vec3::randomVectorCircle(randomDouble(0, lensRadius));
                 Vec3::randomVectorInDisk(lensRadius);
@@ -65,18 +83,50 @@ public:
             //Vec3 offset = xAxis * (u*2-1) + yAxis* (v*2-1);
             return Ray(
                 pos + offset, 
-                lowerLeftCorner + u*horizontal + v*vertical - pos - offset);
+                lowerLeftCorner + u*horizontal + v*vertical - pos - offset,
+                rayTime());
         }
-        return Ray(pos, lowerLeftCorner + u*horizontal + v*vertical - pos);
+        return Ray(pos, lowerLeftCorner + u*horizontal + v*vertical - pos, rayTime());
     }
     
-    Ray getRayXY(double x, double y)const{
+    Ray getRayXY(Real x, Real y)const{
         return getRayUV(x*0.5 + 0.5, y*0.5 + 0.5);
     }
+    
+    // dx and dy are the pixel spacing in x and y, e.g. 2 / imageWidth.
+    // All three rays go through the same lens point.
+    RayDifferential getRayDifferentialXY(Real x, Real y, Real dx, Real dy)const{
+        Real u = x*0.5 + 0.5, v = y*0.5 + 0.5;
+        Vec3 offset;
+        if(lensRadius > 0){
+            Vec3 randomDisk = Vec3::randomVectorInDisk(lensRadius);
+            offset = xAxis*randomDisk.x() + yAxis*randomDisk.y();
+        }
+        Point3 origin = pos + offset;
+        Point3 target = lowerLeftCorner + u*horizontal + v*vertical;
+        RayDifferential ray(Ray(origin, target - origin, rayTime()));
+        ray.rxPos = origin;
+        ray.ryPos = origin;
+        ray.rxDir = target + (dx*0.5)*horizontal - origin;
+        ray.ryDir = target + (dy*0.5)*vertical - origin;
+        ray.hasDifferentials = true;
+        return ray;
+    }
+    
+    // Rays of a pinhole camera share their origin, which makes packets coherent.
+    bool isPinhole()const{ return lensRadius <= 0; }
+    
+    void getRayPacketXY(const double* x, const double* y, int n, RayPacket& packet)const{
+        packet.size = n;
+        for(int i = 0; i < n; ++i){
+            packet.setRay(i, getRayXY(x[i], y[i]));
+        }
+    }
 protected:
     Point3 pos, lowerLeftCorner, center;
     Vec3 horizontal, vertical, xAxis, yAxis, zAxis;
-    double lensRadius;
+    Real lensRadius;
+    Real shutterOpen, shutterClose;
 };
 
 #endif
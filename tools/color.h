@@ -15,6 +15,32 @@ public:
     virtual RGB operator()(double x, double y) = 0;
 };
 
+class PacketPixelCallback: public PixelCallback{
+public:
+    // Shade n <= MAX_PACKET_SIZE neighboring samples together, x, y in [-1, 1]
+    virtual void operator()(const double* x, const double* y, int n, RGB* colors) = 0;
+    using PixelCallback::operator();
+};
+
+// What a sample saw at its first (diffuse) hit, for denoising, compositing
+// and debugging. depth is 0, normal is zero and the ids are -1 when the
+// sample hit nothing.
+struct FeatureSample{
+    RGB albedo;
+    Vec3 normal;
+    Real depth;
+    // materialId numbers the materials of the scene, materialType is the kind.
+    int objectIndex, materialId, materialType;
+    FeatureSample():albedo(1, 1, 1), normal(0, 0, 0), depth(0), objectIndex(-1), materialId(-1), materialType(-1){}
+};
+
+class FeaturePixelCallback: public PixelCallback{
+public:
+    // Like operator()(x, y), also filling the features of the sample.
+    virtual RGB operator()(double x, double y, FeatureSample& feature) = 0;
+    using PixelCallback::operator();
+};
+
 bool writeRGB(std::ostream &out, const RGB& pixelRGB, bool verbose = true) {
     // Write the translated [0,255] value of each color component.
     int r = static_cast<int>(255.999 * pixelRGB.r());
@@ -0,0 +1,84 @@
+#ifndef CURVE_ORDER_H
+#define CURVE_ORDER_H
+
+#include <vector>
+#include <cstdint>
+#include <utility>
+
+// Orders to visit the cells of a grid in. Along a space-filling curve,
+// consecutive cells are neighbours in both directions, so their rays touch
+// the same parts of the scene while they are still in the caches. Hilbert
+// cells are always adjacent, Morton (Z order) jumps at block boundaries
+// but is cheaper to compute.
+enum PixelOrder{
+    ORDER_SCANLINE,
+    ORDER_MORTON,
+    ORDER_HILBERT
+};
+
+// The x and y of the d-th cell along the Morton curve: the even and the odd
+// bits of d.
+inline void mortonToXY(std::uint32_t d, int& x, int& y){
+    auto compact = [](std::uint32_t v){
+        v &= 0x55555555u;
+        v = (v | (v >> 1)) & 0x33333333u;
+        v = (v | (v >> 2)) & 0x0f0f0f0fu;
+        v = (v | (v >> 4)) & 0x00ff00ffu;
+        v = (v | (v >> 8)) & 0x0000ffffu;
+        return v;
+    };
+    x = static_cast<int>(compact(d));
+    y = static_cast<int>(compact(d >> 1));
+}
+
+// The x and y of the d-th cell along the Hilbert curve over an n x n grid,
+// n a power of two.
+inline void hilbertToXY(int n, std::uint32_t d, int& x, int& y){
+    x = y = 0;
+    for(int s = 1; s < n; s *= 2){
+        int rx = 1 & (d / 2), ry = 1 & (d ^ rx);
+        if(ry == 0){
+            if(rx == 1){
+                x = s - 1 - x;
+                y = s - 1 - y;
+            }
+            std::swap(x, y);
+        }
+        x += s * rx;
+        y += s * ry;
+        d /= 4;
+    }
+}
+
+// Cells of a width x height grid as y * width + x, in the given order. The
+// curves run over the enclosing power of two square and skip the cells
+// outside the grid.
+inline std::vector<int> curveOrder(PixelOrder order, int width, int height){
+    std::vector<int> cells;
+    cells.reserve(width * height);
+    if(order == ORDER_SCANLINE){
+        for(int i = 0; i < width * height; ++i){
+            cells.push_back(i);
+        }
+        return cells;
+    }
+    int n = 1;
+    while(n < width || n < height){
+        n *= 2;
+    }
+    for(std::uint32_t d = 0; d < std::uint32_t(n) * n; ++d){
+        int x, y;
+        if(order == ORDER_MORTON){
+            mortonToXY(d, x, y);
+        }
+        else{
+            hilbertToXY(n, d, x, y);
+        }
+        if(x < width && y < height){
+            cells.push_back(y * width + x);
+        }
+    }
+    return cells;
+}
+
+#endif
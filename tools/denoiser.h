@@ -0,0 +1,115 @@
+#ifndef DENOISER_H
+#define DENOISER_H
+
+#include "ppm.h"
+#include "featureBuffer.h"
+#include "parallel.h"
+#include "trace.h"
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <cstdlib>
+
+// Edge-avoiding a-trous wavelet filter (Dammertz et al. 2010). Each pass
+// applies a 5x5 B3-spline kernel with holes, its taps 2^pass pixels apart,
+// and weights every tap by how close its color, normal, depth and albedo
+// are to the center pixel's. The color is divided by the albedo before
+// filtering and multiplied back after, so texture detail is kept.
+class Denoiser{
+public:
+    Denoiser(int iterations = 5, Real sigmaColor = 0.5, Real sigmaNormal = 0.3,
+            Real sigmaDepth = 0.1, Real sigmaAlbedo = 0.3, int nThreads = 0)
+            :iterations(iterations), sigmaColor(sigmaColor), sigmaNormal(sigmaNormal),
+            sigmaDepth(sigmaDepth), sigmaAlbedo(sigmaAlbedo), nThreads(nThreads){}
+
+    void apply(PPM& image, const FeatureBuffer& features)const{
+        TraceScope scope("denoise", "post");
+        int width = image.imageWidth(), height = image.imageHeight();
+        std::vector<RGB> current(static_cast<std::size_t>(width) * height), next(current.size());
+        for(int h = 0; h < height; ++h){
+            for(int w = 0; w < width; ++w){
+                int i = features.index(h, w);
+                current[i] = demodulate(image.pixel(h, w), features.albedo[i]);
+            }
+        }
+        for(int pass = 0; pass < iterations; ++pass){
+            TraceScope passScope(Trace::enabled() ? "a-trous pass " + std::to_string(pass) : std::string(), "post");
+            int step = 1 << pass;
+            // Later passes average over larger areas, so they must stop at smaller differences.
+            Real colorScale = 1 / (sigmaColor * sigmaColor / Real(1 << (2 * pass)));
+            parallelFor(0, height, [&](int h){
+                filterRow(h, step, colorScale, width, height, features, current, next);
+            }, 4, nThreads);
+            current.swap(next);
+        }
+        for(int h = 0; h < height; ++h){
+            for(int w = 0; w < width; ++w){
+                int i = features.index(h, w);
+                image.setPixel(h, w, remodulate(current[i], features.albedo[i]));
+            }
+        }
+    }
+
+protected:
+    void filterRow(int h, int step, Real colorScale, int width, int height, const FeatureBuffer& features,
+            const std::vector<RGB>& input, std::vector<RGB>& output)const{
+        static const Real kernel[5] = {1.0/16, 1.0/4, 3.0/8, 1.0/4, 1.0/16};
+        Real normalScale = 1 / (sigmaNormal * sigmaNormal), albedoScale = 1 / (sigmaAlbedo * sigmaAlbedo);
+        for(int w = 0; w < width; ++w){
+            int p = features.index(h, w);
+            const RGB& colorP = input[p];
+            const Vec3& normalP = features.normal[p];
+            const RGB& albedoP = features.albedo[p];
+            Real depthP = features.depth[p];
+            RGB sum;
+            Real weightSum = 0;
+            for(int dy = -2; dy <= 2; ++dy){
+                int hq = h + dy * step;
+                if(hq < 0 || hq >= height){
+                    continue;
+                }
+                for(int dx = -2; dx <= 2; ++dx){
+                    int wq = w + dx * step;
+                    if(wq < 0 || wq >= width){
+                        continue;
+                    }
+                    int q = features.index(hq, wq);
+                    Real depthQ = features.depth[q];
+                    // Depth differences are relative to the nearer pixel and the tap distance,
+                    // a pixel that hit nothing never mixes with one that hit something.
+                    Real nearer = std::max(std::min(depthP, depthQ), Real(TINY));
+                    Real exponent = (colorP - input[q]).lengthSquared() * colorScale
+                        + (normalP - features.normal[q]).lengthSquared() * normalScale
+                        + (albedoP - features.albedo[q]).lengthSquared() * albedoScale
+                        + std::fabs(depthP - depthQ) / (sigmaDepth * nearer * step * std::max(std::abs(dx), std::abs(dy)) + TINY);
+                    Real weight = kernel[dx + 2] * kernel[dy + 2] * std::exp(-exponent);
+                    sum += weight * input[q];
+                    weightSum += weight;
+                }
+            }
+            output[p] = sum / weightSum;
+        }
+    }
+
+    // Channels with (almost) no albedo are left as they are.
+    static RGB demodulate(const RGB& color, const RGB& albedo){
+        return RGB(
+            albedo.r() > ALBEDO_EPSILON ? color.r() / albedo.r() : color.r(),
+            albedo.g() > ALBEDO_EPSILON ? color.g() / albedo.g() : color.g(),
+            albedo.b() > ALBEDO_EPSILON ? color.b() / albedo.b() : color.b());
+    }
+    static RGB remodulate(const RGB& color, const RGB& albedo){
+        return RGB(
+            albedo.r() > ALBEDO_EPSILON ? color.r() * albedo.r() : color.r(),
+            albedo.g() > ALBEDO_EPSILON ? color.g() * albedo.g() : color.g(),
+            albedo.b() > ALBEDO_EPSILON ? color.b() * albedo.b() : color.b());
+    }
+
+    static constexpr Real ALBEDO_EPSILON = 1e-3;
+
+    int iterations;
+    Real sigmaColor, sigmaNormal, sigmaDepth, sigmaAlbedo;
+    int nThreads;
+};
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef DISTRIBUTION_H
+#define DISTRIBUTION_H
+
+#include "util.h"
+#include <vector>
+#include <algorithm>
+
+// Piecewise-constant distribution over [0, 1] with n pieces. Only the CDF
+// is stored (in float), the function is recovered from its differences.
+class Distribution1D{
+public:
+    Distribution1D():integral(0){}
+    Distribution1D(const float* func, int n){ build(func, n); }
+
+    void build(const float* func, int n){
+        cdf.resize(n + 1);
+        cdf[0] = 0;
+        double sum = 0;
+        for(int i = 0; i < n; ++i){
+            sum += std::max(func[i], 0.0f);
+            cdf[i + 1] = static_cast<float>(sum);
+        }
+        integral = sum / n;
+        for(int i = 1; i <= n; ++i){
+            cdf[i] = sum > 0 ? static_cast<float>(cdf[i] / sum) : float(i) / n;
+        }
+        cdf[n] = 1;
+    }
+
+    int count()const{ return static_cast<int>(cdf.size()) - 1; }
+    double functionIntegral()const{ return integral; }
+
+    // Density of piece i, relative to the uniform density on [0, 1].
+    Real pdf(int i)const{
+        return (cdf[i + 1] - cdf[i]) * count();
+    }
+
+    // Maps u in [0, 1) to [0, 1) following the function, with its piece and density.
+    Real sample(Real u, Real& pdfValue, int& piece)const{
+        int n = count();
+        piece = static_cast<int>(std::upper_bound(cdf.begin(), cdf.end(), static_cast<float>(u)) - cdf.begin()) - 1;
+        piece = clamp(piece, 0, n - 1);
+        Real width = cdf[piece + 1] - cdf[piece];
+        Real du = width > 0 ? (u - cdf[piece]) / width : 0;
+        pdfValue = width * n;
+        return clamp((piece + du) / n, Real(0), Real(1) - std::numeric_limits<Real>::epsilon());
+    }
+
+protected:
+    std::vector<float> cdf;
+    double integral;
+};
+
+// Piecewise-constant distribution over [0, 1]^2 from a width x height
+// function (row major): a marginal over the rows and a conditional per row.
+class Distribution2D{
+public:
+    Distribution2D(){}
+    Distribution2D(const float* func, int width, int height){ build(func, width, height); }
+
+    void build(const float* func, int width, int height){
+        conditional.resize(height);
+        std::vector<float> rowIntegrals(height);
+        for(int v = 0; v < height; ++v){
+            conditional[v].build(func + static_cast<std::size_t>(v) * width, width);
+            rowIntegrals[v] = static_cast<float>(conditional[v].functionIntegral());
+        }
+        marginal.build(rowIntegrals.data(), height);
+    }
+
+    bool empty()const{ return conditional.empty(); }
+
+    // Returns (u, v) in [0, 1)^2 and the density with respect to area in [0, 1]^2.
+    void sample(Real u0, Real u1, Real& u, Real& v, Real& pdfValue)const{
+        Real pdfMarginal, pdfConditional;
+        int row, column;
+        v = marginal.sample(u1, pdfMarginal, row);
+        u = conditional[row].sample(u0, pdfConditional, column);
+        pdfValue = pdfMarginal * pdfConditional;
+    }
+
+    Real pdf(Real u, Real v)const{
+        int width = conditional[0].count(), height = marginal.count();
+        int column = clamp(static_cast<int>(u * width), 0, width - 1);
+        int row = clamp(static_cast<int>(v * height), 0, height - 1);
+        return marginal.pdf(row) * conditional[row].pdf(column);
+    }
+
+protected:
+    std::vector<Distribution1D> conditional;
+    Distribution1D marginal;
+};
+
+#endif
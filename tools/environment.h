@@ -0,0 +1,128 @@
+#ifndef ENVIRONMENT_H
+#define ENVIRONMENT_H
+
+#include "image.h"
+#include "distribution.h"
+#include "vec3.h"
+#include "util.h"
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// Equirectangular environment light, u follows the azimuth around +y and
+// v goes from +y (top row) to -y. Texels are kept as 4-byte RGBE and the
+// sampling distribution as float CDFs, about 8 bytes per texel in total.
+class EnvironmentMap{
+public:
+    EnvironmentMap():width(0), height(0), scale(1){}
+
+    // Loads a .hdr (or any format stb_image reads) with an intensity scale.
+    bool load(const std::string& fname, Real scale = 1){
+        int w, h, channels;
+        float* data = stbi_loadf(fname.c_str(), &w, &h, &channels, 3);
+        if(!data){
+            return false;
+        }
+        setPixels(data, w, h, scale);
+        stbi_image_free(data);
+        return true;
+    }
+
+    // rgb has 3 floats per texel, top row first.
+    void setPixels(const float* rgb, int w, int h, Real scale = 1){
+        width = w;
+        height = h;
+        this->scale = scale;
+        texels.resize(static_cast<std::size_t>(w) * h);
+        std::vector<float> luminance(texels.size());
+        for(std::size_t i = 0; i < texels.size(); ++i){
+            texels[i] = encodeRGBE(rgb[3*i], rgb[3*i + 1], rgb[3*i + 2]);
+            float r, g, b;
+            decodeRGBE(texels[i], r, g, b);
+            luminance[i] = 0.2126f*r + 0.7152f*g + 0.0722f*b;
+        }
+        // lookup blends each texel with its neighbours, so a dark texel next
+        // to a bright one still shines and needs a nonzero pdf: the largest
+        // luminance around each texel, weighted by sin(theta), the area of
+        // the row on the sphere.
+        std::vector<float> importance(texels.size());
+        for(int v = 0; v < h; ++v){
+            float sinTheta = static_cast<float>(std::sin(PI * (v + 0.5) / h));
+            for(int u = 0; u < w; ++u){
+                float largest = 0;
+                for(int dv = -1; dv <= 1; ++dv){
+                    int row = std::min(std::max(v + dv, 0), h - 1);
+                    for(int du = -1; du <= 1; ++du){
+                        int column = (u + du + w) % w;
+                        largest = std::max(largest, luminance[static_cast<std::size_t>(row) * w + column]);
+                    }
+                }
+                importance[static_cast<std::size_t>(v) * w + u] = largest * sinTheta;
+            }
+        }
+        distribution.build(importance.data(), w, h);
+    }
+
+    bool empty()const{ return texels.empty(); }
+    int imageWidth()const{ return width; }
+    int imageHeight()const{ return height; }
+
+    // Bilinear lookup in direction dir.
+    RGB lookup(const Vec3& dir)const{
+        if(empty()){
+            return RGB();
+        }
+        Real u, v;
+        directionToUV(normalize(dir), u, v);
+        Real x = u * width - Real(0.5), y = clamp(v * height - Real(0.5), Real(0), Real(height - 1));
+        int x0 = static_cast<int>(std::floor(x)), y0 = static_cast<int>(y);
+        Real fx = x - x0, fy = y - y0;
+        int y1 = std::min(y0 + 1, height - 1);
+        x0 = (x0 + width) % width;
+        int x1 = (x0 + 1) % width;
+        RGB color = (1 - fy) * ((1 - fx) * texel(x0, y0) + fx * texel(x1, y0))
+            + fy * ((1 - fx) * texel(x0, y1) + fx * texel(x1, y1));
+        return scale * color;
+    }
+
+    // Importance-samples a direction, pdf is per solid angle.
+    Vec3 sample(Real& pdf)const{
+        Real u, v, pdfUV;
+        distribution.sample(randomDouble(), randomDouble(), u, v, pdfUV);
+        Real theta = v * PI, phi = u * 2 * PI;
+        Real sinTheta = std::sin(theta);
+        pdf = sinTheta > 0 ? pdfUV / (2 * PI * PI * sinTheta) : 0;
+        return Vec3(sinTheta * std::cos(phi), std::cos(theta), sinTheta * std::sin(phi));
+    }
+
+    Real pdf(const Vec3& dir)const{
+        Vec3 d = normalize(dir);
+        Real u, v;
+        directionToUV(d, u, v);
+        Real sinTheta = std::sqrt(std::max(Real(0), 1 - d.y()*d.y()));
+        return sinTheta > 0 ? distribution.pdf(u, v) / (2 * PI * PI * sinTheta) : 0;
+    }
+
+protected:
+    static void directionToUV(const Vec3& d, Real& u, Real& v){
+        Real phi = std::atan2(d.z(), d.x());
+        if(phi < 0){
+            phi += 2 * PI;
+        }
+        u = phi / (2 * PI);
+        v = std::acos(clamp(d.y(), Real(-1), Real(1))) / PI;
+    }
+
+    RGB texel(int x, int y)const{
+        float r, g, b;
+        decodeRGBE(texels[static_cast<std::size_t>(y) * width + x], r, g, b);
+        return RGB(r, g, b);
+    }
+
+    int width, height;
+    Real scale;
+    std::vector<RGBE> texels;
+    Distribution2D distribution;
+};
+
+#endif
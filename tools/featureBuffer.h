@@ -0,0 +1,70 @@
+#ifndef FEATURE_BUFFER_H
+#define FEATURE_BUFFER_H
+
+#include "vec3.h"
+#include "pfm.h"
+#include <vector>
+#include <string>
+
+// Per-pixel output variables next to the color, row h = 0 is the bottom as
+// in PPM. albedo, normal and depth average the FeatureSamples, the ids and
+// material type come from the first sample. sampleCount is the number of
+// samples accumulated, variance is the variance of the pixel's mean color.
+class FeatureBuffer{
+public:
+    FeatureBuffer(int width = 0, int height = 0){ resize(width, height); }
+    
+    void resize(int width, int height){
+        this->width = width;
+        this->height = height;
+        std::size_t n = static_cast<std::size_t>(width) * height;
+        albedo.assign(n, RGB());
+        normal.assign(n, Vec3(0, 0, 0));
+        depth.assign(n, 0);
+        objectIndex.assign(n, -1);
+        materialId.assign(n, -1);
+        materialType.assign(n, -1);
+        sampleCount.assign(n, 0);
+        variance.assign(n, RGB());
+    }
+    int imageWidth()const{ return width; }
+    int imageHeight()const{ return height; }
+    int index(int h, int w)const{ return h * width + w; }
+    
+    // Writes every plane to prefix + name + ".pfm", e.g. prefixAlbedo.pfm.
+    bool writeFiles(const std::string& prefix)const{
+        return writePlane(prefix + "Albedo.pfm", albedo)
+            && writePlane(prefix + "Normal.pfm", normal)
+            && writePlane(prefix + "Variance.pfm", variance)
+            && writePlane(prefix + "Depth.pfm", depth)
+            && writePlane(prefix + "ObjectIndex.pfm", objectIndex)
+            && writePlane(prefix + "MaterialId.pfm", materialId)
+            && writePlane(prefix + "MaterialType.pfm", materialType)
+            && writePlane(prefix + "SampleCount.pfm", sampleCount);
+    }
+    
+    std::vector<RGB> albedo;
+    std::vector<Vec3> normal;
+    std::vector<Real> depth;
+    std::vector<int> objectIndex, materialId, materialType, sampleCount;
+    std::vector<RGB> variance;
+protected:
+    bool writePlane(const std::string& fname, const std::vector<Vec3>& plane)const{
+        std::vector<float> data(3 * plane.size());
+        for(std::size_t i = 0; i < plane.size(); ++i){
+            for(int c = 0; c < 3; ++c){
+                data[3 * i + c] = static_cast<float>(plane[i][c]);
+            }
+        }
+        return writePFM(fname, data, width, height, 3);
+    }
+    template<typename T>
+    bool writePlane(const std::string& fname, const std::vector<T>& plane)const{
+        std::vector<float> data(plane.begin(), plane.end());
+        return writePFM(fname, data, width, height, 1);
+    }
+    
+    int width, height;
+};
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+// The one place that compiles stb_image, include this instead of stb_image.h.
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include <string>
+#include <fstream>
+#include <cmath>
+#include <algorithm>
+
+// Shared-exponent RGB in 4 bytes, as in Radiance .hdr files.
+struct RGBE{
+    unsigned char r, g, b, e;
+};
+
+inline RGBE encodeRGBE(float r, float g, float b){
+    RGBE rgbe = {0, 0, 0, 0};
+    float maxComponent = std::max(std::max(r, g), b);
+    if(maxComponent < 1e-32f){
+        return rgbe;
+    }
+    int exponent;
+    float scale = std::frexp(maxComponent, &exponent) * 256.0f / maxComponent;
+    rgbe.r = static_cast<unsigned char>(std::max(r, 0.0f) * scale);
+    rgbe.g = static_cast<unsigned char>(std::max(g, 0.0f) * scale);
+    rgbe.b = static_cast<unsigned char>(std::max(b, 0.0f) * scale);
+    rgbe.e = static_cast<unsigned char>(exponent + 128);
+    return rgbe;
+}
+
+inline void decodeRGBE(const RGBE& rgbe, float& r, float& g, float& b){
+    if(rgbe.e == 0){
+        r = g = b = 0;
+        return;
+    }
+    float scale = std::ldexp(1.0f, rgbe.e - (128 + 8));
+    r = (rgbe.r + 0.5f) * scale;
+    g = (rgbe.g + 0.5f) * scale;
+    b = (rgbe.b + 0.5f) * scale;
+}
+
+// Writes rgb (3 floats per pixel, top row first) as an uncompressed Radiance .hdr.
+inline bool writeHDRImage(const std::string& fname, const float* rgb, int width, int height){
+    std::ofstream out(fname, std::ios::binary);
+    if(!out){
+        return false;
+    }
+    out << "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y " << height << " +X " << width << "\n";
+    for(int i = 0; i < width * height; ++i){
+        RGBE rgbe = encodeRGBE(rgb[3*i], rgb[3*i + 1], rgb[3*i + 2]);
+        out.write(reinterpret_cast<const char*>(&rgbe), 4);
+    }
+    return static_cast<bool>(out);
+}
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef IMAGE_COMPARE_H
+#define IMAGE_COMPARE_H
+
+#include "ppm.h"
+#include "pfm.h"
+#include "util.h"
+#include <vector>
+#include <string>
+#include <cmath>
+#include <algorithm>
+
+// A Monte Carlo estimate of an image: the mean of the samples of every
+// pixel and the variance of that mean, per channel, rows bottom first.
+// The files do not keep the sample count, set it after read.
+struct EstimatedImage{
+    int width, height, samples;
+    std::vector<float> mean, variance;
+
+    EstimatedImage(int width = 0, int height = 0, int samples = 0)
+            :width(width), height(height), samples(samples), mean(3 * width * height), variance(3 * width * height){}
+
+    bool write(const std::string& prefix)const{
+        return writePFM(prefix + ".pfm", mean, width, height, 3)
+            && writePFM(prefix + ".var.pfm", variance, width, height, 3);
+    }
+    bool read(const std::string& prefix){
+        int w, h, channels, wv, hv, channelsVariance;
+        if(!readPFM(prefix + ".pfm", mean, w, h, channels) || !readPFM(prefix + ".var.pfm", variance, wv, hv, channelsVariance)
+                || channels != 3 || channelsVariance != 3 || w != wv || h != hv){
+            return false;
+        }
+        width = w;
+        height = h;
+        return true;
+    }
+};
+
+// Renders nSample independent samples per pixel, each at a random position
+// inside the pixel, on the calling thread.
+inline EstimatedImage estimateImage(PixelCallback* callbackPtr, int width, int height, int nSample){
+    EstimatedImage image(width, height, nSample);
+    for(int h = 0; h < height; ++h){
+        for(int w = 0; w < width; ++w){
+            // Welford's running mean and sum of squared deviations.
+            RGB mean, squaredDeviations;
+            for(int i = 0; i < nSample; ++i){
+                double x = (w + randomDouble()) / width * 2 - 1, y = (h + randomDouble()) / height * 2 - 1;
+                RGB color = (*callbackPtr)(x, y);
+                RGB delta = color - mean;
+                mean += delta / Real(i + 1);
+                squaredDeviations += delta * (color - mean);
+            }
+            int index = 3 * (h * width + w);
+            for(int c = 0; c < 3; ++c){
+                image.mean[index + c] = static_cast<float>(mean[c]);
+                image.variance[index + c] = nSample > 1 ? static_cast<float>(squaredDeviations[c] / (Real(nSample) * (nSample - 1))) : 0.0f;
+            }
+        }
+    }
+    return image;
+}
+
+inline double rmse(const EstimatedImage& a, const EstimatedImage& b){
+    double sum = 0;
+    for(std::size_t i = 0; i < a.mean.size(); ++i){
+        double d = a.mean[i] - b.mean[i];
+        sum += d * d;
+    }
+    return std::sqrt(sum / std::max<std::size_t>(a.mean.size(), 1));
+}
+
+// Squared error relative to the reference, so dark pixels count as much as
+// bright ones.
+inline double relativeMSE(const EstimatedImage& image, const EstimatedImage& reference){
+    double sum = 0;
+    for(std::size_t i = 0; i < image.mean.size(); ++i){
+        double d = image.mean[i] - reference.mean[i];
+        sum += d * d / (double(reference.mean[i]) * reference.mean[i] + 1e-2);
+    }
+    return sum / std::max<std::size_t>(image.mean.size(), 1);
+}
+
+// Tests that an estimate and an independent reference with many more
+// samples have the same expected value. Each channel of each pixel gives
+// z = (a - b) / sqrt(varA + varB), which is about standard normal if they
+// agree. A bias shifts the mean of z away from 0, local errors show as too
+// many pixels with a large |z|. varA is predicted from the reference's
+// variance and the sample counts: the estimate's own variance goes up and
+// down with its mean for skewed sample distributions, which biases z.
+struct ConvergenceTest{
+    double meanZ, outlierFraction;
+    double meanZLimit, outlierLimit;
+    int values;
+
+    bool biased()const{ return std::fabs(meanZ) > meanZLimit; }
+    bool tooManyOutliers()const{ return outlierFraction > outlierLimit; }
+    bool passed()const{ return !biased() && !tooManyOutliers(); }
+};
+
+// |z| above outlierZ happens for 0.1% of the values by chance. Monte Carlo
+// estimates have heavier tails than a normal distribution, so outlierLimit
+// is a few times that. z is clamped to maxZ for the mean, so a few fireflies
+// do not look like a bias.
+inline ConvergenceTest convergenceTest(const EstimatedImage& image, const EstimatedImage& reference,
+        double sigmas = 5, double outlierZ = 3.29, double outlierLimit = 0.005, double maxZ = 5){
+    ConvergenceTest test;
+    double sumZ = 0;
+    int outliers = 0, n = 0;
+    for(std::size_t i = 0; i < image.mean.size(); ++i){
+        double d = double(image.mean[i]) - reference.mean[i];
+        double variance = double(reference.variance[i]) * (1 + double(reference.samples) / image.samples);
+        double z;
+        if(variance > 0){
+            z = d / std::sqrt(variance);
+        }
+        else{
+            // Noise-free pixels must match.
+            z = std::fabs(d) <= 1e-6 ? 0 : (d > 0 ? maxZ : -maxZ);
+        }
+        outliers += std::fabs(z) > outlierZ;
+        sumZ += clamp(z, -maxZ, maxZ);
+        ++n;
+    }
+    test.values = n;
+    test.meanZ = n > 0 ? sumZ / n : 0;
+    test.outlierFraction = n > 0 ? double(outliers) / n : 0;
+    // The clamped z still have a standard deviation of about 1.
+    test.meanZLimit = n > 0 ? sigmas / std::sqrt(double(n)) : 0;
+    test.outlierLimit = outlierLimit;
+    return test;
+}
+
+#endif
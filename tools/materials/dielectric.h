@@ -6,7 +6,7 @@
 #include "../objects/object.h"
 
 
-double schlick(double cosTheta, double refIdx) {
+Real schlick(Real cosTheta, Real refIdx) {
     auto r0 = (1-refIdx) / (1+refIdx);
     r0 = r0*r0;
     return r0 + (1-r0)*pow((1 - cosTheta),5);
@@ -15,9 +15,9 @@ double schlick(double cosTheta, double refIdx) {
 class Dielectric: public Material{
 public:
     Dielectric():albedo{0,0,0}, fuzzRate(0), refIdx(1.0){} 
-    Dielectric(const RGB& albedo, double fuzzRate = 0, double refIdx = 1.0)
+    Dielectric(const RGB& albedo, Real fuzzRate = 0, Real refIdx = 1.0)
             :albedo(albedo), fuzzRate(fuzzRate), refIdx(refIdx){
-        double etaRelative;
+        Real etaRelative;
         if(refIdx < 1.0){
             fullReflectionAtBack = false;
             etaRelative = refIdx;
@@ -32,27 +32,30 @@ public:
     virtual bool scatter(const Ray& ray, const HitRecord& hitRecord, 
             RGB& attenuation, Ray& scattered)const{
         attenuation = albedo / PI;
-        double etaiOverEtat = hitRecord.front ? 1.0 / refIdx : refIdx;
-        double cosTheta = dot(normalize(ray.direction()), -hitRecord.normal);
-        double reflectProb = schlick(cosTheta, etaiOverEtat);
+        Real etaiOverEtat = hitRecord.front ? 1.0 / refIdx : refIdx;
+        Real cosTheta = dot(normalize(ray.direction()), -hitRecord.normal);
+        Real reflectProb = schlick(cosTheta, etaiOverEtat);
         if((fullReflectionAtBack ^ hitRecord.front) && cosTheta <= minCosTheta
                 || randomDouble() < reflectProb){
             Vec3 scatterDir = Vec3::reflect(ray.direction(), hitRecord.normal);
             if(fuzzRate > 0){
                 scatterDir += fuzzRate * Vec3::randomVectorSphere(1.0);
             }
-            scattered = Ray(hitRecord.pos, scatterDir);
+            scattered = Ray(offsetRayOrigin(hitRecord.pos, hitRecord.normal, scatterDir), scatterDir, ray.time());
             return true;//dot(scattered.direction(), hitRecord.normal) >= 0;
         }
         Vec3 scatterDir = Vec3::refract(ray.direction(), hitRecord.normal, etaiOverEtat);
-        scattered = Ray(hitRecord.pos, scatterDir);
+        scattered = Ray(offsetRayOrigin(hitRecord.pos, hitRecord.normal, scatterDir), scatterDir, ray.time());
         return true;//dot(scattered.direction(), hitRecord.normal) >= 0;
     }
     
+    virtual MaterialType type()const{ return MATERIAL_DIELECTRIC; }
+    
+    virtual RGB reflectance(const HitRecord& hitRecord)const{ return albedo / PI; }
     
 protected:
     RGB albedo;
-    double refIdx, fuzzRate, minCosTheta;
+    Real refIdx, fuzzRate, minCosTheta;
     bool fullReflectionAtBack;
 };
 
@@ -0,0 +1,32 @@
+#ifndef DIFFUSE_LIGHT_H
+#define DIFFUSE_LIGHT_H
+
+#include "material.h"
+#include "../util.h"
+#include "../objects/object.h"
+
+// Emits emit to the front side (both sides if twoSided) and absorbs all light.
+class DiffuseLight: public Material{
+public:
+    DiffuseLight():emit{0,0,0}, twoSided(false){}
+    DiffuseLight(const RGB& emit, bool twoSided = false):emit(emit), twoSided(twoSided){}
+    
+    virtual bool scatter(const Ray& ray, const HitRecord& hitRecord, 
+            RGB& attenuation, Ray& scattered)const{
+        return false;
+    }
+    
+    virtual RGB emitted(const HitRecord& hitRecord)const{
+        return hitRecord.front || twoSided ? emit : RGB();
+    }
+    
+    virtual bool isEmissive()const{ return true; }
+    
+    virtual MaterialType type()const{ return MATERIAL_EMISSIVE; }
+    
+protected:
+    RGB emit;
+    bool twoSided;
+};
+
+#endif
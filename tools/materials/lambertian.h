@@ -4,24 +4,46 @@
 #include "material.h"
 #include "../util.h"
 #include "../objects/object.h"
+#include "../textures/texture.h"
 
 class Lambertian: public Material{
 public:
     Lambertian():albedo{0,0,0}{} 
     Lambertian(const RGB& albedo):albedo(albedo){}
+    // The texture color is multiplied by albedo.
+    Lambertian(shared_ptr<Texture> texturePtr, const RGB& albedo = RGB(PI, PI, PI))
+            :albedo(albedo), texturePtr(texturePtr){}
 
     virtual bool scatter(const Ray& ray, const HitRecord& hitRecord, 
             RGB& attenuation, Ray& scattered)const{
         Vec3 scatterDir = Vec3::randomVectorHemisphere(1.0, hitRecord.normal);
             //hitRecord.normal + Vec3::randomVectorSphere(0.999);
             //hitRecord.normal + Vec3::randomVectorPillar(0.999);
-        scattered = Ray(hitRecord.pos, scatterDir);
-        attenuation = albedo / PI;
+        scattered = Ray(offsetRayOrigin(hitRecord.pos, hitRecord.normal, scatterDir), scatterDir, ray.time());
+        attenuation = albedoAt(hitRecord) / PI;
         return true;
     }
     
+    virtual MaterialType type()const{ return MATERIAL_LAMBERTIAN; }
+    
+    virtual bool isDiffuse()const{ return true; }
+    // scatter samples the hemisphere uniformly (pdf 1 / (2 PI)) with attenuation albedo / PI.
+    virtual RGB scatterValue(const HitRecord& hitRecord, const Vec3& in, const Vec3& out)const{
+        if(dot(out, hitRecord.normal) <= 0){
+            return RGB();
+        }
+        return albedoAt(hitRecord) / (2 * PI * PI);
+    }
+    
+    virtual RGB reflectance(const HitRecord& hitRecord)const{ return albedoAt(hitRecord) / PI; }
+    
 protected:
+    RGB albedoAt(const HitRecord& hitRecord)const{
+        return texturePtr ? albedo * texturePtr->value(hitRecord) : albedo;
+    }
+    
     RGB albedo;
+    shared_ptr<Texture> texturePtr;
 };
 
 #endif
@@ -5,9 +5,33 @@
 
 class HitRecord;
 
+// Lets integrators group rays hitting the same kind of material.
+enum MaterialType{
+    MATERIAL_OTHER,
+    MATERIAL_LAMBERTIAN,
+    MATERIAL_METAL,
+    MATERIAL_DIELECTRIC,
+    MATERIAL_EMISSIVE,
+    MATERIAL_TYPE_COUNT
+};
+
 class Material{
 public:
+    virtual ~Material(){}
     virtual bool scatter(const Ray& ray, const HitRecord& hitRecord, RGB& attenuation, Ray& scattered)const = 0;
+    virtual MaterialType type()const{ return MATERIAL_OTHER; }
+    
+    virtual RGB emitted(const HitRecord& hitRecord)const{ return RGB(); }
+    virtual bool isEmissive()const{ return false; }
+    
+    // Diffuse materials can be lit by sampling the lights directly. For them 
+    // scatterValue(in, out) / pdf(out) equals the attenuation that scatter
+    // returns when it samples out, so both estimators agree.
+    virtual bool isDiffuse()const{ return false; }
+    virtual RGB scatterValue(const HitRecord& hitRecord, const Vec3& in, const Vec3& out)const{ return RGB(); }
+    
+    // The color scattered light is multiplied by, e.g. as a denoising guide.
+    virtual RGB reflectance(const HitRecord& hitRecord)const{ return RGB(1, 1, 1); }
 };
 
 #endif
@@ -8,7 +8,7 @@
 class Metal: public Material{
 public:
     Metal():albedo{0,0,0}, fuzzRate(0){} 
-    Metal(const RGB& albedo, double fuzzRate = 0)
+    Metal(const RGB& albedo, Real fuzzRate = 0)
             :albedo(albedo), fuzzRate(fuzzRate < 1.0 ? fuzzRate : 1.0){}
 
     virtual bool scatter(const Ray& ray, const HitRecord& hitRecord, 
@@ -17,14 +17,18 @@ public:
         if(fuzzRate > 0){
             scatterDir += fuzzRate * Vec3::randomVectorSphere(1.0);
         }
-        scattered = Ray(hitRecord.pos, scatterDir);
+        scattered = Ray(offsetRayOrigin(hitRecord.pos, hitRecord.normal, scatterDir), scatterDir, ray.time());
         attenuation = albedo / PI;
         return dot(scattered.direction(), hitRecord.normal) >= 0;
     }
     
+    virtual MaterialType type()const{ return MATERIAL_METAL; }
+    
+    virtual RGB reflectance(const HitRecord& hitRecord)const{ return albedo / PI; }
+    
 protected:
     RGB albedo;
-    double fuzzRate;
+    Real fuzzRate;
 };
 
 #endif
@@ -0,0 +1,101 @@
+#ifndef AABB_H
+#define AABB_H
+
+#include "../ray.h"
+#include "../util.h"
+#include <algorithm>
+
+class AABB{
+public:
+    // An empty box, which expands to anything.
+    AABB():minPoint(INF, INF, INF), maxPoint(-INF, -INF, -INF){}
+    AABB(const Point3& a, const Point3& b)
+            :minPoint(std::min(a.x(), b.x()), std::min(a.y(), b.y()), std::min(a.z(), b.z())),
+            maxPoint(std::max(a.x(), b.x()), std::max(a.y(), b.y()), std::max(a.z(), b.z())){}
+
+    Point3 min()const{ return minPoint; }
+    Point3 max()const{ return maxPoint; }
+    Point3 centroid()const{ return 0.5 * (minPoint + maxPoint); }
+    Vec3 extent()const{ return maxPoint - minPoint; }
+    bool empty()const{ return minPoint.x() > maxPoint.x(); }
+
+    void expand(const Point3& p){
+        minPoint = Point3(std::min(minPoint.x(), p.x()), std::min(minPoint.y(), p.y()), std::min(minPoint.z(), p.z()));
+        maxPoint = Point3(std::max(maxPoint.x(), p.x()), std::max(maxPoint.y(), p.y()), std::max(maxPoint.z(), p.z()));
+    }
+    void expand(const AABB& box){
+        if(box.empty()){
+            return;
+        }
+        expand(box.minPoint);
+        expand(box.maxPoint);
+    }
+
+    int longestAxis()const{
+        Vec3 e = extent();
+        if(e.x() >= e.y() && e.x() >= e.z()){
+            return 0;
+        }
+        return e.y() >= e.z() ? 1 : 2;
+    }
+
+    Real surfaceArea()const{
+        if(empty()){
+            return 0;
+        }
+        Vec3 e = extent();
+        return 2 * (e.x()*e.y() + e.y()*e.z() + e.z()*e.x());
+    }
+
+    // Slab test, invDir holds the reciprocals of the ray direction.
+    bool hit(const Point3& origin, const Vec3& invDir, Real tMin, Real tMax)const{
+        for(int a = 0; a < 3; ++a){
+            Real t0 = (minPoint[a] - origin[a]) * invDir[a];
+            Real t1 = (maxPoint[a] - origin[a]) * invDir[a];
+            if(invDir[a] < 0){
+                std::swap(t0, t1);
+            }
+            tMin = t0 > tMin ? t0 : tMin;
+            tMax = t1 < tMax ? t1 : tMax;
+            if(tMax < tMin){
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool hit(const Ray& ray, Real tMin, Real tMax)const{
+        Vec3 dir = ray.direction();
+        return hit(ray.position(), Vec3(1 / dir.x(), 1 / dir.y(), 1 / dir.z()), tMin, tMax);
+    }
+
+    static AABB lerp(const AABB& a, const AABB& b, Real t){
+        AABB box;
+        box.minPoint = (1 - t) * a.minPoint + t * b.minPoint;
+        box.maxPoint = (1 - t) * a.maxPoint + t * b.maxPoint;
+        return box;
+    }
+
+    static AABB merge(const AABB& a, const AABB& b){
+        AABB box(a);
+        box.expand(b);
+        return box;
+    }
+
+    // Empty if they do not overlap.
+    static AABB intersect(const AABB& a, const AABB& b){
+        AABB box;
+        for(int i = 0; i < 3; ++i){
+            box.minPoint[i] = std::max(a.minPoint[i], b.minPoint[i]);
+            box.maxPoint[i] = std::min(a.maxPoint[i], b.maxPoint[i]);
+            if(box.minPoint[i] > box.maxPoint[i]){
+                return AABB();
+            }
+        }
+        return box;
+    }
+protected:
+    Point3 minPoint, maxPoint;
+};
+
+#endif
@@ -0,0 +1,924 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include "objectList.h"
+#include "aabb.h"
+#include "../rayPacket.h"
+#include "../trace.h"
+#include "../parallel.h"
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <cstdint>
+
+// Nodes are stored in one array. Children of an inner node are allocated
+// as a pair, so the right child is leftOrFirst + 1 and children always
+// come after their parent.
+struct BVHNode{
+    AABB box;
+    int leftOrFirst;    // left child for inner nodes, first primitive for leaves
+    int count;          // number of primitives of a leaf, 0 for inner nodes
+    int axis;           // split axis of inner nodes, for front-to-back order
+
+    BVHNode():leftOrFirst(0), count(0), axis(0){}
+    bool isLeaf()const{ return count > 0; }
+};
+
+// How build splits the primitives. All make the same node layout.
+enum BVHBuilder{
+    // Median on the longest centroid axis.
+    BVH_MEDIAN,
+    // The cheapest of 16 bins per axis under the surface area heuristic.
+    BVH_SAH,
+    // Splits at the highest differing bit of the primitives' Morton codes,
+    // sorted in linear time. The fastest build and the slowest tree, for
+    // previews.
+    BVH_LBVH,
+    // BVH_SAH that also splits space where the children of the best object
+    // split would overlap: primitives crossing the plane go to both sides,
+    // each bounded by its part on that side (Object::clippedBox). Leaves
+    // may share primitives. For long or large primitives whose boxes
+    // overlap. Refit bounds whole primitives again.
+    BVH_SBVH
+};
+
+class BVH: public ObjectList{
+public:
+    BVH(int maxLeafSize = 4, BVHBuilder builder = BVH_SAH)
+            :maxLeafSize(maxLeafSize), builder(builder), buildThreads(0), spatialSplitBudget(0.5),
+            hasMotion(false), useMotionBoxes(true){}
+    BVH(const ObjectList& list, int maxLeafSize = 4, BVHBuilder builder = BVH_SAH)
+            :maxLeafSize(maxLeafSize), builder(builder), buildThreads(0), spatialSplitBudget(0.5),
+            hasMotion(false), useMotionBoxes(true){
+        for(int i = 0; i < list.size(); ++i){
+            add(list[i]);
+        }
+        build();
+    }
+    virtual ~BVH(){}
+
+    // For the next build, on nThreads threads (all cores if 0). Large
+    // ranges are binned in parallel and the two subtrees of large nodes are
+    // built by different threads.
+    void setBuilder(BVHBuilder builder, int nThreads = 0){
+        this->builder = builder;
+        buildThreads = nThreads;
+    }
+    // BVH_SBVH stops splitting space once the leaves would reference this
+    // fraction of the primitives more than once.
+    void setSpatialSplitBudget(Real extraReferences){ spatialSplitBudget = extraReferences; }
+
+    // Must be called after the objects are added and before tracing.
+    virtual void build(){
+        TraceScope scope("BVH build", "build");
+        int n = size();
+        BuildState state(buildThreads > 0 ? buildThreads : defaultThreadCount());
+        nodes.clear();
+        primIndices.resize(n);
+        primBoxes.resize(n);
+        forChunks(state, 0, n, [&](int first, int last){
+            for(int i = first; i < last; ++i){
+                primIndices[i] = i;
+                objects[i]->boundingBox(primBoxes[i]);
+            }
+        });
+        if(n == 0){
+            return;
+        }
+        // A binary tree with leaves of at least one primitive.
+        if(builder == BVH_SBVH){
+            buildSpatial(state);
+        }
+        else if(builder == BVH_LBVH){
+            nodes.resize(2 * n - 1);
+            buildLBVH(state);
+        }
+        else{
+            nodes.resize(2 * n - 1);
+            buildRecursive(state, 0, 0, n, 0);
+        }
+        nodes.resize(state.nodeCount.load());
+        nodes.shrink_to_fit();
+        primIndices.shrink_to_fit();
+        updateMotionBoxes();
+    }
+
+    // With moving objects, nodes also keep their boxes at time 0 and 1 and
+    // single rays test the box interpolated to their time, which is much
+    // tighter than the box swept over the whole shutter. Ray times must be
+    // in [0, 1]. Switched off, every ray tests the swept box.
+    void switchMotionBoxes(bool useMotionBoxes){ this->useMotionBoxes = useMotionBoxes; }
+    bool moving()const{ return hasMotion; }
+
+    virtual bool hit(const Ray& ray, HitRecord* hitRecordPtr = nullptr, Real tMin = 0.0, Real tMax = std::numeric_limits<Real>::max()){
+        if(nodes.empty()){
+            return false;
+        }
+        Point3 origin = ray.position();
+        Vec3 dir = ray.direction();
+        Vec3 invDir(1 / dir.x(), 1 / dir.y(), 1 / dir.z());
+        bool hitAnything = false;
+        HitRecord tempHitRecord(tMax);
+        auto currentClosest = tMax;
+        int closest = -1;
+        bool motion = hasMotion && useMotionBoxes;
+        int stack[STACK_SIZE];
+        int stackSize = 0;
+        stack[stackSize++] = 0;
+        while(stackSize > 0){
+            int nodeIndex = stack[--stackSize];
+            const BVHNode& node = nodes[nodeIndex];
+            STAT_INC(STAT_BVH_NODES);
+            if(!(motion ? motionBox(nodeIndex, ray.time()) : node.box).hit(origin, invDir, tMin, currentClosest)){
+                continue;
+            }
+            if(node.isLeaf()){
+                for(int i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i){
+                    if(objects[primIndices[i]]->hit(ray, &tempHitRecord, tMin, currentClosest)){
+                        hitAnything = true;
+                        currentClosest = tempHitRecord.t;
+                        closest = primIndices[i];
+                        if(hitRecordPtr){
+                            hitRecordPtr->copy(tempHitRecord);
+                        }
+                    }
+                }
+                continue;
+            }
+            // Push the far child first so the near one is visited first.
+            bool leftFirst = dir[node.axis] >= 0;
+            stack[stackSize++] = leftFirst ? node.leftOrFirst + 1 : node.leftOrFirst;
+            stack[stackSize++] = leftFirst ? node.leftOrFirst : node.leftOrFirst + 1;
+        }
+        if(hitRecordPtr && closest >= 0){
+            hitRecordPtr->objectIndex = closest;
+            objects[closest]->surfaceCoordinates(*hitRecordPtr);
+            identifyMaterial(*hitRecordPtr);
+        }
+        return hitAnything;
+    }
+
+    virtual bool occluded(const Ray& ray, Real tMin = 0.0, Real tMax = std::numeric_limits<Real>::max()){
+        if(nodes.empty()){
+            return false;
+        }
+        Point3 origin = ray.position();
+        Vec3 dir = ray.direction();
+        Vec3 invDir(1 / dir.x(), 1 / dir.y(), 1 / dir.z());
+        bool motion = hasMotion && useMotionBoxes;
+        int stack[STACK_SIZE];
+        int stackSize = 0;
+        stack[stackSize++] = 0;
+        while(stackSize > 0){
+            int nodeIndex = stack[--stackSize];
+            const BVHNode& node = nodes[nodeIndex];
+            STAT_INC(STAT_BVH_NODES);
+            if(!(motion ? motionBox(nodeIndex, ray.time()) : node.box).hit(origin, invDir, tMin, tMax)){
+                continue;
+            }
+            if(node.isLeaf()){
+                for(int i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i){
+                    if(objects[primIndices[i]]->occluded(ray, tMin, tMax)){
+                        return true;
+                    }
+                }
+                continue;
+            }
+            stack[stackSize++] = node.leftOrFirst + 1;
+            stack[stackSize++] = node.leftOrFirst;
+        }
+        return false;
+    }
+
+    // Lanes may have different times, packets test the swept boxes.
+    virtual void hitPacket(RayPacket& packet, Real tMin = 0.0){
+        if(nodes.empty()){
+            return;
+        }
+        packet.prepare();
+        bool laneMask[MAX_PACKET_SIZE];
+        int stack[STACK_SIZE];
+        int stackSize = 0;
+        stack[stackSize++] = 0;
+        while(stackSize > 0){
+            const BVHNode& node = nodes[stack[--stackSize]];
+            STAT_INC(STAT_BVH_NODES);
+            if(packet.missesBox(node.box, tMin, packet.maxT())){
+                continue;
+            }
+            if(packet.hitBox(node.box, tMin, laneMask) == 0){
+                continue;
+            }
+            if(node.isLeaf()){
+                for(int i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i){
+                    objects[primIndices[i]]->hitPacket(packet, primIndices[i], tMin);
+                }
+                continue;
+            }
+            bool leftFirst = packet.dx[0] >= 0;
+            if(node.axis == 1){
+                leftFirst = packet.dy[0] >= 0;
+            }
+            else if(node.axis == 2){
+                leftFirst = packet.dz[0] >= 0;
+            }
+            stack[stackSize++] = leftFirst ? node.leftOrFirst + 1 : node.leftOrFirst;
+            stack[stackSize++] = leftFirst ? node.leftOrFirst : node.leftOrFirst + 1;
+        }
+    }
+
+    virtual bool boundingBox(AABB& box)const{
+        if(nodes.empty()){
+            return false;
+        }
+        box = nodes[0].box;
+        return true;
+    }
+
+    int nodeCount()const{ return static_cast<int>(nodes.size()); }
+    // Depth of the deepest leaf, 0 if the root is a leaf.
+    int depth()const{
+        std::vector<int> depths(nodes.size(), 0);
+        int deepest = 0;
+        for(int i = 0; i < nodeCount(); ++i){
+            if(nodes[i].isLeaf()){
+                deepest = std::max(deepest, depths[i]);
+            }
+            else{
+                depths[nodes[i].leftOrFirst] = depths[nodes[i].leftOrFirst + 1] = depths[i] + 1;
+            }
+        }
+        return deepest;
+    }
+    // Primitives in the leaves, more than size() after spatial splits.
+    int referenceCount()const{ return static_cast<int>(primIndices.size()); }
+    // Bytes of the tree and the object pointers, not of the objects.
+    std::size_t memoryBytes()const{
+        return nodes.capacity() * sizeof(BVHNode) + primIndices.capacity() * sizeof(int)
+            + (primBoxes.capacity() + nodeBoxes0.capacity() + nodeBoxes1.capacity()) * sizeof(AABB)
+            + objects.capacity() * sizeof(shared_ptr<Object>);
+    }
+
+    // Updates every box bottom-up after objects moved, keeping the tree and
+    // its memory. Returns false without changing anything if objects were
+    // added or removed since build. The tree stays correct but gets slower
+    // the further objects move from where it was built, see sahCost.
+    virtual bool refit(){
+        int n = size();
+        if(n != static_cast<int>(primBoxes.size()) || nodes.empty()){
+            return false;
+        }
+        for(int i = 0; i < n; ++i){
+            objects[i]->boundingBox(primBoxes[i]);
+        }
+        // Children come after their parent.
+        for(int i = nodeCount() - 1; i >= 0; --i){
+            BVHNode& node = nodes[i];
+            if(node.isLeaf()){
+                node.box = AABB();
+                for(int j = node.leftOrFirst; j < node.leftOrFirst + node.count; ++j){
+                    node.box.expand(primBoxes[primIndices[j]]);
+                }
+            }
+            else{
+                node.box = AABB::merge(nodes[node.leftOrFirst].box, nodes[node.leftOrFirst + 1].box);
+            }
+        }
+        updateMotionBoxes();
+        return true;
+    }
+
+    // Expected cost of a random ray under the surface area heuristic, in
+    // units of one primitive test, with a box test costing 1 as well.
+    Real sahCost()const{
+        if(nodes.empty() || nodes[0].box.surfaceArea() <= 0){
+            return 0;
+        }
+        Real cost = 0;
+        for(const BVHNode& node: nodes){
+            cost += node.box.surfaceArea() * (node.isLeaf() ? node.count : 1);
+        }
+        return cost / nodes[0].box.surfaceArea();
+    }
+
+protected:
+    static const int STACK_SIZE = 64;
+    // Leaves lie at most this deep, so traversal stays within STACK_SIZE.
+    static const int MAX_DEPTH = STACK_SIZE - 8;
+
+    static const int BIN_COUNT = 16;
+    // Ranges at least this large are split over threads.
+    static const int PARALLEL_SIZE = 1 << 12;
+    // BVH_SBVH only tries spatial splits where the children of the object
+    // split overlap by this fraction of the root's surface area.
+    static constexpr Real SPATIAL_OVERLAP = 1e-5;
+
+    struct BuildState{
+        BuildState(int maxThreads)
+                :nodeCount(1), activeThreads(1), maxThreads(maxThreads), references(0), placed(0), maxReferences(0){}
+        // Takes a thread if fewer than maxThreads are building.
+        bool spawn(){
+            int active = activeThreads.load();
+            while(active < maxThreads){
+                if(activeThreads.compare_exchange_weak(active, active + 1)){
+                    return true;
+                }
+            }
+            return false;
+        }
+        std::atomic<int> nodeCount, activeThreads;
+        int maxThreads;
+        // BVH_SBVH: references made and put into leaves so far.
+        std::atomic<int> references, placed;
+        int maxReferences;
+    };
+
+    struct Bin{
+        AABB box;
+        int count;
+        Bin():count(0){}
+    };
+
+    // A primitive, or its part inside a node after spatial splits.
+    struct Reference{
+        AABB box;
+        int prim;
+    };
+
+    // Bins of a spatial split count the references starting and ending in
+    // them, and bound the parts of the references inside them.
+    struct SpatialBin{
+        AABB box;
+        int entries, exits;
+        SpatialBin():entries(0), exits(0){}
+    };
+
+    // body(first, last) over chunks of [begin, end), in parallel for large
+    // ranges.
+    template<typename Body>
+    static void forChunks(const BuildState& state, int begin, int end, const Body& body){
+        int chunks = std::min(state.maxThreads, (end - begin) / PARALLEL_SIZE);
+        if(chunks <= 1){
+            body(begin, end);
+            return;
+        }
+        parallelFor(0, chunks, [&](int chunk){
+            body(begin + static_cast<int>(static_cast<long long>(end - begin) * chunk / chunks),
+                begin + static_cast<int>(static_cast<long long>(end - begin) * (chunk + 1) / chunks));
+        }, 1, chunks);
+    }
+
+    // Builds the two children, the left one on another thread for large
+    // ranges while threads are free.
+    template<typename Left, typename Right>
+    static void buildChildren(BuildState& state, int count, const Left& buildLeft, const Right& buildRight){
+        if(count >= PARALLEL_SIZE && state.spawn()){
+            std::thread leftThread([&](){
+                buildLeft();
+                --state.activeThreads;
+            });
+            buildRight();
+            leftThread.join();
+        }
+        else{
+            buildLeft();
+            buildRight();
+        }
+    }
+
+    void bounds(const BuildState& state, int first, int count, AABB& box, AABB& centroidBox)const{
+        box = centroidBox = AABB();
+        int chunks = std::min(state.maxThreads, count / PARALLEL_SIZE);
+        if(chunks <= 1){
+            for(int i = first; i < first + count; ++i){
+                box.expand(primBoxes[primIndices[i]]);
+                centroidBox.expand(primBoxes[primIndices[i]].centroid());
+            }
+            return;
+        }
+        std::vector<AABB> boxes(chunks), centroidBoxes(chunks);
+        std::atomic<int> next(0);
+        forChunks(state, first, first + count, [&](int begin, int end){
+            int chunk = next++;
+            for(int i = begin; i < end; ++i){
+                boxes[chunk].expand(primBoxes[primIndices[i]]);
+                centroidBoxes[chunk].expand(primBoxes[primIndices[i]].centroid());
+            }
+        });
+        for(int c = 0; c < chunks; ++c){
+            box.expand(boxes[c]);
+            centroidBox.expand(centroidBoxes[c]);
+        }
+    }
+
+    static int binIndex(Real centroid, Real low, Real scale){
+        int bin = static_cast<int>((centroid - low) * scale);
+        return bin < 0 ? 0 : (bin >= BIN_COUNT ? BIN_COUNT - 1 : bin);
+    }
+
+    // The cheapest boundary between bins under the surface area heuristic,
+    // bestAxis stays -1 if there is none.
+    static void bestBinSplit(const Bin* bins, const Vec3& extent, Real& bestCost, int& bestAxis, int& bestSplit){
+        for(int a = 0; a < 3; ++a){
+            if(extent[a] <= 0){
+                continue;
+            }
+            const Bin* axisBins = bins + a * BIN_COUNT;
+            Real rightArea[BIN_COUNT];
+            int rightCount[BIN_COUNT];
+            AABB box;
+            int n = 0;
+            for(int i = BIN_COUNT - 1; i > 0; --i){
+                box.expand(axisBins[i].box);
+                n += axisBins[i].count;
+                rightArea[i] = box.surfaceArea();
+                rightCount[i] = n;
+            }
+            box = AABB();
+            n = 0;
+            for(int i = 0; i < BIN_COUNT - 1; ++i){
+                box.expand(axisBins[i].box);
+                n += axisBins[i].count;
+                if(n == 0 || rightCount[i + 1] == 0){
+                    continue;
+                }
+                Real cost = box.surfaceArea() * n + rightArea[i + 1] * rightCount[i + 1];
+                if(cost < bestCost){
+                    bestCost = cost;
+                    bestAxis = a;
+                    bestSplit = i + 1;
+                }
+            }
+        }
+    }
+
+    // Partitions the range at the cheapest bin boundary under the surface
+    // area heuristic and returns the first index of the right side, or -1
+    // if every centroid falls into one bin.
+    int sahPartition(const BuildState& state, int first, int count, const AABB& centroidBox, int& axis){
+        Vec3 extent = centroidBox.extent();
+        Point3 low = centroidBox.min();
+        Vec3 scale;
+        for(int a = 0; a < 3; ++a){
+            scale[a] = extent[a] > 0 ? BIN_COUNT / extent[a] : 0;
+        }
+        auto binRange = [&](int begin, int end, Bin* bins){
+            for(int i = begin; i < end; ++i){
+                const AABB& box = primBoxes[primIndices[i]];
+                Point3 centroid = box.centroid();
+                for(int a = 0; a < 3; ++a){
+                    Bin& bin = bins[a * BIN_COUNT + binIndex(centroid[a], low[a], scale[a])];
+                    bin.box.expand(box);
+                    ++bin.count;
+                }
+            }
+        };
+        Bin bins[3 * BIN_COUNT];
+        int chunks = std::min(state.maxThreads, count / PARALLEL_SIZE);
+        if(chunks <= 1){
+            binRange(first, first + count, bins);
+        }
+        else{
+            std::vector<Bin> partial(chunks * 3 * BIN_COUNT);
+            std::atomic<int> next(0);
+            forChunks(state, first, first + count, [&](int begin, int end){
+                binRange(begin, end, &partial[3 * BIN_COUNT * next++]);
+            });
+            for(int c = 0; c < chunks; ++c){
+                for(int i = 0; i < 3 * BIN_COUNT; ++i){
+                    bins[i].box.expand(partial[c * 3 * BIN_COUNT + i].box);
+                    bins[i].count += partial[c * 3 * BIN_COUNT + i].count;
+                }
+            }
+        }
+        Real bestCost = INF;
+        int bestAxis = -1, bestSplit = 0;
+        bestBinSplit(bins, extent, bestCost, bestAxis, bestSplit);
+        if(bestAxis < 0){
+            return -1;
+        }
+        axis = bestAxis;
+        auto middle = std::partition(primIndices.begin() + first, primIndices.begin() + first + count, [&](int p){
+            return binIndex(primBoxes[p].centroid()[axis], low[axis], scale[axis]) < bestSplit;
+        });
+        return static_cast<int>(middle - primIndices.begin());
+    }
+
+    void makeLeaf(int nodeIndex, int first, int count){
+        nodes[nodeIndex].leftOrFirst = first;
+        nodes[nodeIndex].count = count;
+    }
+    int makeInner(BuildState& state, int nodeIndex, int axis){
+        int left = state.nodeCount.fetch_add(2);
+        nodes[nodeIndex].leftOrFirst = left;
+        nodes[nodeIndex].count = 0;
+        nodes[nodeIndex].axis = axis;
+        return left;
+    }
+
+    // Median splits halve the count, so a node at depth d whose subtree is
+    // built by median splits has no leaf deeper than d + ceil(log2(count)).
+    // Other splits are only made while that stays within MAX_DEPTH for the
+    // children, so every tree keeps its leaves within MAX_DEPTH.
+    static bool nearMaxDepth(int depth, int count){
+        int bits = 0;
+        while((1LL << bits) < count){
+            ++bits;
+        }
+        return depth + 1 + bits > MAX_DEPTH;
+    }
+
+    // Splits with the surface area heuristic or at the median, see
+    // BVHBuilder.
+    void buildRecursive(BuildState& state, int nodeIndex, int first, int count, int depth){
+        AABB box, centroidBox;
+        bounds(state, first, count, box, centroidBox);
+        nodes[nodeIndex].box = box;
+        int axis = centroidBox.longestAxis();
+        if(count <= maxLeafSize || centroidBox.extent()[axis] <= 0){
+            makeLeaf(nodeIndex, first, count);
+            return;
+        }
+        int mid = builder == BVH_SAH && !nearMaxDepth(depth, count) ? sahPartition(state, first, count, centroidBox, axis) : -1;
+        if(mid <= first || mid >= first + count){
+            mid = first + count / 2;
+            std::nth_element(primIndices.begin() + first, primIndices.begin() + mid,
+                primIndices.begin() + first + count, [&](int a, int b){
+                    return primBoxes[a].centroid()[axis] < primBoxes[b].centroid()[axis];
+                });
+        }
+        int left = makeInner(state, nodeIndex, axis);
+        auto buildLeft = [&](){ buildRecursive(state, left, first, mid - first, depth + 1); };
+        auto buildRight = [&](){ buildRecursive(state, left + 1, mid, first + count - mid, depth + 1); };
+        buildChildren(state, count, buildLeft, buildRight);
+    }
+
+    // BVH_SBVH. primIndices gets room for every reference the budget
+    // allows and is cut to those in leaves.
+    void buildSpatial(BuildState& state){
+        int n = size();
+        std::vector<Reference> references(n);
+        AABB box;
+        for(int i = 0; i < n; ++i){
+            references[i].box = primBoxes[i];
+            references[i].prim = i;
+            box.expand(primBoxes[i]);
+        }
+        state.references = n;
+        state.maxReferences = n + static_cast<int>(n * spatialSplitBudget);
+        nodes.resize(2 * state.maxReferences - 1);
+        primIndices.resize(state.maxReferences);
+        buildSpatialNode(state, 0, references, box, box.surfaceArea(), 0);
+        primIndices.resize(state.placed.load());
+    }
+
+    // Frees references before building the children.
+    void buildSpatialNode(BuildState& state, int nodeIndex, std::vector<Reference>& references, const AABB& box,
+            Real rootArea, int depth){
+        nodes[nodeIndex].box = box;
+        int count = static_cast<int>(references.size());
+        if(count <= maxLeafSize){
+            spatialLeaf(state, nodeIndex, references);
+            return;
+        }
+        AABB centroidBox;
+        for(const Reference& reference: references){
+            centroidBox.expand(reference.box.centroid());
+        }
+        Vec3 extent = centroidBox.extent();
+        Point3 low = centroidBox.min();
+        Vec3 scale;
+        for(int a = 0; a < 3; ++a){
+            scale[a] = extent[a] > 0 ? BIN_COUNT / extent[a] : 0;
+        }
+        Bin bins[3 * BIN_COUNT];
+        for(const Reference& reference: references){
+            Point3 centroid = reference.box.centroid();
+            for(int a = 0; a < 3; ++a){
+                Bin& bin = bins[a * BIN_COUNT + binIndex(centroid[a], low[a], scale[a])];
+                bin.box.expand(reference.box);
+                ++bin.count;
+            }
+        }
+        Real objectCost = INF;
+        int objectAxis = -1, objectSplit = 0;
+        bool deep = nearMaxDepth(depth, count);
+        if(!deep){
+            bestBinSplit(bins, extent, objectCost, objectAxis, objectSplit);
+        }
+        auto leftOfObjectSplit = [&](const Reference& reference){
+            return binIndex(reference.box.centroid()[objectAxis], low[objectAxis], scale[objectAxis]) < objectSplit;
+        };
+
+        Real spatialCost = INF;
+        int spatialAxis = -1, spatialSplit = 0;
+        bool trySpatial = !deep && state.references.load() < state.maxReferences;
+        if(trySpatial && objectAxis >= 0){
+            AABB leftBox, rightBox;
+            for(const Reference& reference: references){
+                (leftOfObjectSplit(reference) ? leftBox : rightBox).expand(reference.box);
+            }
+            trySpatial = AABB::intersect(leftBox, rightBox).surfaceArea() > SPATIAL_OVERLAP * rootArea;
+        }
+        if(trySpatial){
+            bestSpatialSplit(references, box, spatialCost, spatialAxis, spatialSplit);
+        }
+
+        std::vector<Reference> left, right;
+        int axis = objectAxis;
+        if(spatialCost < objectCost && splitSpace(state, references, box, spatialAxis, spatialSplit, left, right)){
+            axis = spatialAxis;
+        }
+        else if(objectAxis >= 0){
+            for(const Reference& reference: references){
+                (leftOfObjectSplit(reference) ? left : right).push_back(reference);
+            }
+        }
+        else if(extent[centroidBox.longestAxis()] > 0){
+            axis = centroidBox.longestAxis();
+            int mid = count / 2;
+            std::nth_element(references.begin(), references.begin() + mid, references.end(),
+                [&](const Reference& a, const Reference& b){
+                    return a.box.centroid()[axis] < b.box.centroid()[axis];
+                });
+            left.assign(references.begin(), references.begin() + mid);
+            right.assign(references.begin() + mid, references.end());
+        }
+        else{
+            spatialLeaf(state, nodeIndex, references);
+            return;
+        }
+        std::vector<Reference>().swap(references);
+        AABB leftBox, rightBox;
+        for(const Reference& reference: left){
+            leftBox.expand(reference.box);
+        }
+        for(const Reference& reference: right){
+            rightBox.expand(reference.box);
+        }
+        int child = makeInner(state, nodeIndex, axis);
+        auto buildLeft = [&](){ buildSpatialNode(state, child, left, leftBox, rootArea, depth + 1); };
+        auto buildRight = [&](){ buildSpatialNode(state, child + 1, right, rightBox, rootArea, depth + 1); };
+        buildChildren(state, count, buildLeft, buildRight);
+    }
+
+    void spatialLeaf(BuildState& state, int nodeIndex, const std::vector<Reference>& references){
+        int count = static_cast<int>(references.size());
+        int first = state.placed.fetch_add(count);
+        for(int i = 0; i < count; ++i){
+            primIndices[first + i] = references[i].prim;
+        }
+        makeLeaf(nodeIndex, first, count);
+    }
+
+    // The part of box between boundaries from and to of its BIN_COUNT slabs
+    // along axis.
+    static AABB slab(const AABB& box, int axis, int from, int to){
+        Point3 low = box.min(), high = box.max();
+        Real width = box.extent()[axis] / BIN_COUNT;
+        if(from > 0){
+            low[axis] = box.min()[axis] + from * width;
+        }
+        if(to < BIN_COUNT){
+            high[axis] = box.min()[axis] + to * width;
+        }
+        return AABB(low, high);
+    }
+
+    AABB clipReference(const Reference& reference, const AABB& clip)const{
+        return objects[reference.prim]->clippedBox(AABB::intersect(reference.box, clip));
+    }
+
+    // The cheapest boundary between the BIN_COUNT slabs of box, with the
+    // references crossing it on both sides.
+    void bestSpatialSplit(const std::vector<Reference>& references, const AABB& box,
+            Real& bestCost, int& bestAxis, int& bestSplit)const{
+        Vec3 extent = box.extent();
+        Point3 low = box.min();
+        for(int a = 0; a < 3; ++a){
+            if(extent[a] <= 0){
+                continue;
+            }
+            Real scale = BIN_COUNT / extent[a];
+            SpatialBin bins[BIN_COUNT];
+            for(const Reference& reference: references){
+                int first = binIndex(reference.box.min()[a], low[a], scale);
+                int last = binIndex(reference.box.max()[a], low[a], scale);
+                for(int b = first; b <= last; ++b){
+                    bins[b].box.expand(first == last ? reference.box : clipReference(reference, slab(box, a, b, b + 1)));
+                }
+                ++bins[first].entries;
+                ++bins[last].exits;
+            }
+            Real rightArea[BIN_COUNT];
+            int rightCount[BIN_COUNT];
+            AABB side;
+            int n = 0;
+            for(int i = BIN_COUNT - 1; i > 0; --i){
+                side.expand(bins[i].box);
+                n += bins[i].exits;
+                rightArea[i] = side.surfaceArea();
+                rightCount[i] = n;
+            }
+            side = AABB();
+            n = 0;
+            for(int i = 0; i < BIN_COUNT - 1; ++i){
+                side.expand(bins[i].box);
+                n += bins[i].entries;
+                if(n == 0 || rightCount[i + 1] == 0){
+                    continue;
+                }
+                Real cost = side.surfaceArea() * n + rightArea[i + 1] * rightCount[i + 1];
+                if(cost < bestCost){
+                    bestCost = cost;
+                    bestAxis = a;
+                    bestSplit = i + 1;
+                }
+            }
+        }
+    }
+
+    // Fills left and right with the references on either side of the
+    // boundary, clipping those that cross it. Returns false with both empty
+    // if the crossing references exceed the budget or a side stays empty.
+    bool splitSpace(BuildState& state, const std::vector<Reference>& references, const AABB& box, int axis, int split,
+            std::vector<Reference>& left, std::vector<Reference>& right)const{
+        Real low = box.min()[axis], scale = BIN_COUNT / box.extent()[axis];
+        int crossing = 0;
+        for(const Reference& reference: references){
+            crossing += binIndex(reference.box.min()[axis], low, scale) < split
+                && binIndex(reference.box.max()[axis], low, scale) >= split;
+        }
+        if(state.references.fetch_add(crossing) + crossing > state.maxReferences){
+            state.references -= crossing;
+            return false;
+        }
+        AABB leftSlab = slab(box, axis, 0, split), rightSlab = slab(box, axis, split, BIN_COUNT);
+        for(const Reference& reference: references){
+            if(binIndex(reference.box.max()[axis], low, scale) < split){
+                left.push_back(reference);
+            }
+            else if(binIndex(reference.box.min()[axis], low, scale) >= split){
+                right.push_back(reference);
+            }
+            else{
+                Reference part = reference;
+                part.box = clipReference(reference, leftSlab);
+                if(!part.box.empty()){
+                    left.push_back(part);
+                }
+                part.box = clipReference(reference, rightSlab);
+                if(!part.box.empty()){
+                    right.push_back(part);
+                }
+            }
+        }
+        int added = static_cast<int>(left.size() + right.size() - references.size());
+        state.references -= crossing - added;
+        if(left.empty() || right.empty()){
+            state.references -= added;
+            left.clear();
+            right.clear();
+            return false;
+        }
+        return true;
+    }
+
+    // Spreads the low 10 bits of v to every third bit.
+    static std::uint32_t expandBits(std::uint32_t v){
+        v = (v * 0x00010001u) & 0xFF0000FFu;
+        v = (v * 0x00000101u) & 0x0F00F00Fu;
+        v = (v * 0x00000011u) & 0xC30C30C3u;
+        v = (v * 0x00000005u) & 0x49249249u;
+        return v;
+    }
+
+    // Sorts the primitives by the 30 bit Morton codes of their centroids in
+    // the centroid box, with x in the highest bit of every triple.
+    void buildLBVH(BuildState& state){
+        int n = size();
+        AABB box, centroidBox;
+        bounds(state, 0, n, box, centroidBox);
+        Point3 low = centroidBox.min();
+        Vec3 extent = centroidBox.extent();
+        std::vector<std::uint32_t> codes(n), sortedCodes(n);
+        std::vector<int> sortedIndices(n);
+        forChunks(state, 0, n, [&](int first, int last){
+            for(int i = first; i < last; ++i){
+                Point3 c = primBoxes[i].centroid();
+                std::uint32_t q[3];
+                for(int a = 0; a < 3; ++a){
+                    Real t = extent[a] > 0 ? (c[a] - low[a]) / extent[a] : 0;
+                    q[a] = static_cast<std::uint32_t>(clamp(t * 1024, Real(0), Real(1023)));
+                }
+                codes[i] = expandBits(q[0]) << 2 | expandBits(q[1]) << 1 | expandBits(q[2]);
+            }
+        });
+        // Radix sort, 8 bits per pass.
+        for(int shift = 0; shift < 32; shift += 8){
+            int offsets[257] = {0};
+            for(int i = 0; i < n; ++i){
+                ++offsets[(codes[primIndices[i]] >> shift & 0xFF) + 1];
+            }
+            for(int b = 0; b < 256; ++b){
+                offsets[b + 1] += offsets[b];
+            }
+            for(int i = 0; i < n; ++i){
+                sortedIndices[offsets[codes[primIndices[i]] >> shift & 0xFF]++] = primIndices[i];
+            }
+            primIndices.swap(sortedIndices);
+        }
+        for(int i = 0; i < n; ++i){
+            sortedCodes[i] = codes[primIndices[i]];
+        }
+        buildLBVHNode(state, sortedCodes, 0, 0, n, 0);
+    }
+
+    void buildLBVHNode(BuildState& state, const std::vector<std::uint32_t>& codes, int nodeIndex, int first, int count, int depth){
+        if(count <= maxLeafSize){
+            AABB box;
+            for(int i = first; i < first + count; ++i){
+                box.expand(primBoxes[primIndices[i]]);
+            }
+            nodes[nodeIndex].box = box;
+            makeLeaf(nodeIndex, first, count);
+            return;
+        }
+        std::uint32_t difference = nearMaxDepth(depth, count) ? 0 : codes[first] ^ codes[first + count - 1];
+        int mid = first + count / 2, axis = 0;
+        if(difference != 0){
+            int bit = 31;
+            while(!(difference >> bit & 1)){
+                --bit;
+            }
+            // The codes share the bits above, so those with the bit set
+            // come last.
+            mid = static_cast<int>(std::partition_point(codes.begin() + first, codes.begin() + first + count,
+                [&](std::uint32_t code){ return !(code >> bit & 1); }) - codes.begin());
+            axis = 2 - bit % 3;
+        }
+        int left = makeInner(state, nodeIndex, axis);
+        auto buildLeft = [&](){ buildLBVHNode(state, codes, left, first, mid - first, depth + 1); };
+        auto buildRight = [&](){ buildLBVHNode(state, codes, left + 1, mid, first + count - mid, depth + 1); };
+        buildChildren(state, count, buildLeft, buildRight);
+        nodes[nodeIndex].box = AABB::merge(nodes[left].box, nodes[left + 1].box);
+        if(difference == 0){
+            nodes[nodeIndex].axis = nodes[nodeIndex].box.longestAxis();
+        }
+    }
+
+    AABB motionBox(int nodeIndex, Real time)const{
+        return AABB::lerp(nodeBoxes0[nodeIndex], nodeBoxes1[nodeIndex], time);
+    }
+
+    // Fills nodeBoxes0 and nodeBoxes1 bottom-up from the objects' motion
+    // boxes. The interpolated parent box contains the interpolated child boxes.
+    void updateMotionBoxes(){
+        int n = size();
+        hasMotion = false;
+        for(int i = 0; i < n && !hasMotion; ++i){
+            hasMotion = objects[i]->isMoving();
+        }
+        if(!hasMotion){
+            nodeBoxes0.clear();
+            nodeBoxes1.clear();
+            return;
+        }
+        std::vector<AABB> primBoxes0(n), primBoxes1(n);
+        for(int i = 0; i < n; ++i){
+            objects[i]->motionBoxes(primBoxes0[i], primBoxes1[i]);
+        }
+        nodeBoxes0.resize(nodes.size());
+        nodeBoxes1.resize(nodes.size());
+        for(int i = nodeCount() - 1; i >= 0; --i){
+            const BVHNode& node = nodes[i];
+            AABB box0, box1;
+            if(node.isLeaf()){
+                for(int j = node.leftOrFirst; j < node.leftOrFirst + node.count; ++j){
+                    box0.expand(primBoxes0[primIndices[j]]);
+                    box1.expand(primBoxes1[primIndices[j]]);
+                }
+            }
+            else{
+                box0 = AABB::merge(nodeBoxes0[node.leftOrFirst], nodeBoxes0[node.leftOrFirst + 1]);
+                box1 = AABB::merge(nodeBoxes1[node.leftOrFirst], nodeBoxes1[node.leftOrFirst + 1]);
+            }
+            nodeBoxes0[i] = box0;
+            nodeBoxes1[i] = box1;
+        }
+    }
+
+    int maxLeafSize;
+    BVHBuilder builder;
+    int buildThreads;
+    Real spatialSplitBudget;
+    std::vector<BVHNode> nodes;
+    std::vector<int> primIndices;
+    std::vector<AABB> primBoxes;
+    // Node boxes at time 0 and 1, only with moving objects.
+    std::vector<AABB> nodeBoxes0, nodeBoxes1;
+    bool hasMotion, useMotionBoxes;
+};
+
+#endif
@@ -0,0 +1,385 @@
+#ifndef COMPRESSED_BVH_H
+#define COMPRESSED_BVH_H
+
+#include "bvh.h"
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+
+// One inner node with the boxes of both children, 36 bytes. The boxes lie
+// on a grid of 256 steps per axis over the node's own box: the grid starts
+// at origin and its step is 2^exponent. Children boxes are rounded outwards
+// to the grid, so they only grow.
+struct CompressedBVHNode{
+    float origin[3];
+    std::int8_t exponent[3];
+    // 4 bits per child, child 0 low: 0 an inner node, LEAF_MAX + 1 no
+    // child, else the primitive count of a leaf.
+    std::uint8_t counts;
+    std::uint8_t lo[2][3], hi[2][3];
+    // The node index of an inner child, the first primitive of a leaf.
+    std::int32_t child[2];
+
+    static const int LEAF_MAX = 14;
+    static const int EMPTY = LEAF_MAX + 1;
+
+    int count(int c)const{ return c == 0 ? counts & 15 : counts >> 4; }
+};
+
+// A BVH whose nodes keep 8 bit child boxes relative to their parent, about
+// a quarter of the memory of BVHNode with doubles, so more of the tree stays
+// in the caches. build makes the full tree first and replaces it by the
+// compressed one. Moving objects are tested with their boxes over the
+// whole shutter, and refit is not supported, build again instead.
+class CompressedBVH: public BVH{
+public:
+    CompressedBVH(int maxLeafSize = 4, BVHBuilder builder = BVH_SAH):BVH(maxLeafSize, builder){}
+    CompressedBVH(const ObjectList& list, int maxLeafSize = 4, BVHBuilder builder = BVH_SAH):BVH(maxLeafSize, builder){
+        for(int i = 0; i < list.size(); ++i){
+            add(list[i]);
+        }
+        build();
+    }
+    virtual ~CompressedBVH(){}
+
+    virtual void build(){
+        BVH::build();
+        TraceScope scope("BVH compress", "build");
+        compressed.clear();
+        rootBox = AABB();
+        if(!nodes.empty()){
+            rootBox = nodes[0].box;
+            compressed.reserve(nodes.size() / 2 + 1);
+            if(nodes[0].isLeaf() && nodes[0].count > CompressedBVHNode::LEAF_MAX){
+                splitLeaf(nodes[0].leftOrFirst, nodes[0].count);
+            }
+            else if(nodes[0].isLeaf()){
+                // A single leaf becomes the only child of the root.
+                CompressedBVHNode& root = emplaceNode(rootBox);
+                quantize(root, 0, rootBox);
+                root.counts = static_cast<std::uint8_t>(nodes[0].count | CompressedBVHNode::EMPTY << 4);
+                root.child[0] = nodes[0].leftOrFirst;
+            }
+            else{
+                compressInner(0);
+            }
+        }
+        compressed.shrink_to_fit();
+        // Only the compressed tree is traversed.
+        std::vector<BVHNode>().swap(nodes);
+        std::vector<AABB>().swap(primBoxes);
+        std::vector<AABB>().swap(nodeBoxes0);
+        std::vector<AABB>().swap(nodeBoxes1);
+    }
+
+    virtual bool hit(const Ray& ray, HitRecord* hitRecordPtr = nullptr, Real tMin = 0.0, Real tMax = std::numeric_limits<Real>::max()){
+        if(compressed.empty()){
+            return false;
+        }
+        Point3 origin = ray.position();
+        Vec3 dir = ray.direction();
+        Vec3 invDir(1 / dir.x(), 1 / dir.y(), 1 / dir.z());
+        if(!rootBox.hit(origin, invDir, tMin, tMax)){
+            return false;
+        }
+        bool hitAnything = false;
+        HitRecord tempHitRecord(tMax);
+        auto currentClosest = tMax;
+        int closest = -1;
+        int stack[STACK_SIZE];
+        int stackSize = 0;
+        stack[stackSize++] = 0;
+        while(stackSize > 0){
+            const CompressedBVHNode& node = compressed[stack[--stackSize]];
+            STAT_INC(STAT_BVH_NODES);
+            Real tNear[2];
+            bool hitChild[2];
+            for(int c = 0; c < 2; ++c){
+                hitChild[c] = node.count(c) != CompressedBVHNode::EMPTY && childHit(node, c, origin, invDir, tMin, currentClosest, tNear[c]);
+            }
+            // The nearer child first.
+            int first = hitChild[1] && (!hitChild[0] || tNear[1] < tNear[0]) ? 1 : 0;
+            int order[2] = {first, 1 - first};
+            for(int c: order){
+                if(!hitChild[c] || node.count(c) == 0){
+                    continue;
+                }
+                for(int i = node.child[c]; i < node.child[c] + node.count(c); ++i){
+                    if(objects[primIndices[i]]->hit(ray, &tempHitRecord, tMin, currentClosest)){
+                        hitAnything = true;
+                        currentClosest = tempHitRecord.t;
+                        closest = primIndices[i];
+                        if(hitRecordPtr){
+                            hitRecordPtr->copy(tempHitRecord);
+                        }
+                    }
+                }
+            }
+            // Push the far child first so the near one is visited first.
+            for(int k = 1; k >= 0; --k){
+                int c = order[k];
+                if(hitChild[c] && node.count(c) == 0 && tNear[c] <= currentClosest){
+                    stack[stackSize++] = node.child[c];
+                }
+            }
+        }
+        if(hitRecordPtr && closest >= 0){
+            hitRecordPtr->objectIndex = closest;
+            objects[closest]->surfaceCoordinates(*hitRecordPtr);
+            identifyMaterial(*hitRecordPtr);
+        }
+        return hitAnything;
+    }
+
+    virtual bool occluded(const Ray& ray, Real tMin = 0.0, Real tMax = std::numeric_limits<Real>::max()){
+        if(compressed.empty()){
+            return false;
+        }
+        Point3 origin = ray.position();
+        Vec3 dir = ray.direction();
+        Vec3 invDir(1 / dir.x(), 1 / dir.y(), 1 / dir.z());
+        if(!rootBox.hit(origin, invDir, tMin, tMax)){
+            return false;
+        }
+        int stack[STACK_SIZE];
+        int stackSize = 0;
+        stack[stackSize++] = 0;
+        while(stackSize > 0){
+            const CompressedBVHNode& node = compressed[stack[--stackSize]];
+            STAT_INC(STAT_BVH_NODES);
+            for(int c = 0; c < 2; ++c){
+                Real tNear;
+                int count = node.count(c);
+                if(count == CompressedBVHNode::EMPTY || !childHit(node, c, origin, invDir, tMin, tMax, tNear)){
+                    continue;
+                }
+                if(count == 0){
+                    stack[stackSize++] = node.child[c];
+                    continue;
+                }
+                for(int i = node.child[c]; i < node.child[c] + count; ++i){
+                    if(objects[primIndices[i]]->occluded(ray, tMin, tMax)){
+                        return true;
+                    }
+                }
+            }
+        }
+        return false;
+    }
+
+    virtual void hitPacket(RayPacket& packet, Real tMin = 0.0){
+        if(compressed.empty()){
+            return;
+        }
+        packet.prepare();
+        bool laneMask[MAX_PACKET_SIZE];
+        if(packet.hitBox(rootBox, tMin, laneMask) == 0){
+            return;
+        }
+        int stack[STACK_SIZE];
+        int stackSize = 0;
+        stack[stackSize++] = 0;
+        while(stackSize > 0){
+            const CompressedBVHNode& node = compressed[stack[--stackSize]];
+            STAT_INC(STAT_BVH_NODES);
+            for(int c = 1; c >= 0; --c){
+                int count = node.count(c);
+                if(count == CompressedBVHNode::EMPTY){
+                    continue;
+                }
+                AABB box = childBox(node, c);
+                if(packet.missesBox(box, tMin, packet.maxT()) || packet.hitBox(box, tMin, laneMask) == 0){
+                    continue;
+                }
+                if(count == 0){
+                    stack[stackSize++] = node.child[c];
+                    continue;
+                }
+                for(int i = node.child[c]; i < node.child[c] + count; ++i){
+                    objects[primIndices[i]]->hitPacket(packet, primIndices[i], tMin);
+                }
+            }
+        }
+    }
+
+    virtual bool boundingBox(AABB& box)const{
+        if(compressed.empty()){
+            return false;
+        }
+        box = rootBox;
+        return true;
+    }
+
+    virtual bool refit(){ return false; }
+
+    int nodeCount()const{ return static_cast<int>(compressed.size()); }
+    std::size_t memoryBytes()const{
+        return compressed.capacity() * sizeof(CompressedBVHNode) + primIndices.capacity() * sizeof(int)
+            + objects.capacity() * sizeof(shared_ptr<Object>);
+    }
+    // Like BVH::sahCost with the rounded boxes, to see what they cost.
+    Real sahCost()const{
+        if(compressed.empty() || rootBox.surfaceArea() <= 0){
+            return 0;
+        }
+        Real cost = rootBox.surfaceArea();
+        for(const CompressedBVHNode& node: compressed){
+            for(int c = 0; c < 2; ++c){
+                int count = node.count(c);
+                if(count != CompressedBVHNode::EMPTY){
+                    cost += childBox(node, c).surfaceArea() * (count == 0 ? 1 : count);
+                }
+            }
+        }
+        return cost / rootBox.surfaceArea();
+    }
+
+    // The box of child c as traversal sees it.
+    static AABB childBox(const CompressedBVHNode& node, int c){
+        Point3 lo, hi;
+        for(int a = 0; a < 3; ++a){
+            Real step = powerOfTwo(node.exponent[a]);
+            lo[a] = node.origin[a] + node.lo[c][a] * step;
+            hi[a] = node.origin[a] + node.hi[c][a] * step;
+        }
+        return AABB(lo, hi);
+    }
+
+protected:
+    // 2^e from the bits, without ldexp.
+    static Real powerOfTwo(int e){
+        std::uint64_t bits = static_cast<std::uint64_t>(e + 1023) << 52;
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return static_cast<Real>(value);
+    }
+
+    // Slab test of child c, with the entry distance.
+    static bool childHit(const CompressedBVHNode& node, int c, const Point3& origin, const Vec3& invDir,
+            Real tMin, Real tMax, Real& tNear){
+        for(int a = 0; a < 3; ++a){
+            Real step = powerOfTwo(node.exponent[a]);
+            Real t0 = (node.origin[a] + node.lo[c][a] * step - origin[a]) * invDir[a];
+            Real t1 = (node.origin[a] + node.hi[c][a] * step - origin[a]) * invDir[a];
+            if(invDir[a] < 0){
+                std::swap(t0, t1);
+            }
+            tMin = t0 > tMin ? t0 : tMin;
+            tMax = t1 < tMax ? t1 : tMax;
+            if(tMax < tMin){
+                return false;
+            }
+        }
+        tNear = tMin;
+        return true;
+    }
+
+    // Sets the grid of node to cover box: the origin rounded down to a
+    // float, and the smallest power of two step with 255 steps reaching the
+    // maximum.
+    static void setGrid(CompressedBVHNode& node, const AABB& box){
+        for(int a = 0; a < 3; ++a){
+            Real low = box.min()[a], high = box.max()[a];
+            float origin = static_cast<float>(low);
+            if(origin > low){
+                origin = std::nextafter(origin, -std::numeric_limits<float>::infinity());
+            }
+            int e = -100;
+            if(high > origin){
+                std::frexp((high - origin) / 255, &e);
+                e = std::max(e, -100);
+            }
+            while(e < 100 && origin + 255 * powerOfTwo(e) < high){
+                ++e;
+            }
+            node.origin[a] = origin;
+            node.exponent[a] = static_cast<std::int8_t>(e);
+        }
+    }
+
+    // Child c's box on the node's grid, rounded outwards.
+    static void quantize(CompressedBVHNode& node, int c, const AABB& box){
+        for(int a = 0; a < 3; ++a){
+            Real step = powerOfTwo(node.exponent[a]);
+            Real low = (box.min()[a] - node.origin[a]) / step, high = (box.max()[a] - node.origin[a]) / step;
+            int lo = clamp(static_cast<int>(std::floor(low)), 0, 255);
+            int hi = clamp(static_cast<int>(std::ceil(high)), 0, 255);
+            // Guard against rounding in the decoding.
+            while(lo > 0 && node.origin[a] + lo * step > box.min()[a]){
+                --lo;
+            }
+            while(hi < 255 && node.origin[a] + hi * step < box.max()[a]){
+                ++hi;
+            }
+            node.lo[c][a] = static_cast<std::uint8_t>(lo);
+            node.hi[c][a] = static_cast<std::uint8_t>(hi);
+        }
+    }
+
+    CompressedBVHNode& emplaceNode(const AABB& box){
+        compressed.push_back(CompressedBVHNode());
+        CompressedBVHNode& node = compressed.back();
+        setGrid(node, box);
+        node.counts = 0;
+        node.child[0] = node.child[1] = 0;
+        return node;
+    }
+
+    // Compresses the subtree of the inner BVH node and returns its index.
+    // Children are compressed depth first after their parent.
+    int compressInner(int nodeIndex){
+        int index = static_cast<int>(compressed.size());
+        emplaceNode(nodes[nodeIndex].box);
+        for(int c = 0; c < 2; ++c){
+            const BVHNode& child = nodes[nodes[nodeIndex].leftOrFirst + c];
+            int reference, count;
+            if(child.isLeaf() && child.count <= CompressedBVHNode::LEAF_MAX){
+                reference = child.leftOrFirst;
+                count = child.count;
+            }
+            else if(child.isLeaf()){
+                reference = splitLeaf(child.leftOrFirst, child.count);
+                count = 0;
+            }
+            else{
+                reference = compressInner(nodes[nodeIndex].leftOrFirst + c);
+                count = 0;
+            }
+            // The vector may have grown.
+            CompressedBVHNode& node = compressed[index];
+            quantize(node, c, child.box);
+            node.child[c] = reference;
+            node.counts |= static_cast<std::uint8_t>(count << (4 * c));
+        }
+        return index;
+    }
+
+    // Leaves too large for 4 bits, where centroids coincide, become inner
+    // nodes over halves.
+    int splitLeaf(int first, int count){
+        AABB box;
+        for(int i = first; i < first + count; ++i){
+            box.expand(primBoxes[primIndices[i]]);
+        }
+        int index = static_cast<int>(compressed.size());
+        emplaceNode(box);
+        int firsts[2] = {first, first + count / 2}, counts[2] = {count / 2, count - count / 2};
+        for(int c = 0; c < 2; ++c){
+            AABB childBox;
+            for(int i = firsts[c]; i < firsts[c] + counts[c]; ++i){
+                childBox.expand(primBoxes[primIndices[i]]);
+            }
+            int reference = counts[c] <= CompressedBVHNode::LEAF_MAX ? firsts[c] : splitLeaf(firsts[c], counts[c]);
+            CompressedBVHNode& node = compressed[index];
+            quantize(node, c, childBox);
+            node.child[c] = reference;
+            node.counts |= static_cast<std::uint8_t>((counts[c] <= CompressedBVHNode::LEAF_MAX ? counts[c] : 0) << (4 * c));
+        }
+        return index;
+    }
+
+    std::vector<CompressedBVHNode> compressed;
+    AABB rootBox;
+};
+
+#endif
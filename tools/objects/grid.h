@@ -0,0 +1,401 @@
+#ifndef GRID_H
+#define GRID_H
+
+#include "objectList.h"
+#include "aabb.h"
+#include "../trace.h"
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+// A uniform grid over the objects, walked cell by cell along the ray with a
+// 3D-DDA, stopping at the first cell that contains the closest hit so far.
+// It builds in linear time and suits many small objects spread evenly over
+// the scene. With twoLevel, cells holding more than maxCellObjects objects
+// get a finer grid of their own, for scenes with dense clusters. Objects
+// whose box spans at least half the scene on every axis, like a ground
+// sphere, or that have no box are kept out of the grid and tested by every
+// ray first.
+class Grid: public ObjectList{
+public:
+    // density is the number of cells per object.
+    Grid(Real density = 2, bool twoLevel = true, int maxCellObjects = 8)
+            :density(density), twoLevel(twoLevel), maxCellObjects(maxCellObjects){}
+    Grid(const ObjectList& list, Real density = 2, bool twoLevel = true, int maxCellObjects = 8)
+            :density(density), twoLevel(twoLevel), maxCellObjects(maxCellObjects){
+        for(int i = 0; i < list.size(); ++i){
+            add(list[i]);
+        }
+        build();
+    }
+    virtual ~Grid(){}
+
+    // Must be called after the objects are added and before tracing.
+    virtual void build(){
+        TraceScope scope("Grid build", "build");
+        int n = size();
+        std::vector<AABB> boxes(n);
+        std::vector<bool> bounded(n);
+        bounds = AABB();
+        for(int i = 0; i < n; ++i){
+            bounded[i] = objects[i]->boundingBox(boxes[i]);
+            bounds.expand(boxes[i]);
+        }
+        Vec3 extent = bounds.extent();
+        std::vector<int> members;
+        largeObjects.clear();
+        AABB box;
+        for(int i = 0; i < n; ++i){
+            Vec3 objectExtent = boxes[i].extent();
+            bool large = !bounded[i];
+            if(bounded[i] && n > 1){
+                large = true;
+                for(int a = 0; a < 3; ++a){
+                    large = large && (extent[a] <= 0 || objectExtent[a] >= 0.5 * extent[a]);
+                }
+            }
+            if(large){
+                largeObjects.push_back(i);
+            }
+            else{
+                members.push_back(i);
+                box.expand(boxes[i]);
+            }
+        }
+        subgrids.clear();
+        topSubgrid.clear();
+        top = Level();
+        if(members.empty()){
+            return;
+        }
+        fill(top, box, members, boxes, MAX_RESOLUTION);
+        topSubgrid.assign(top.cellStart.size() - 1, -1);
+        if(!twoLevel){
+            return;
+        }
+        for(int cell = 0; cell + 1 < static_cast<int>(top.cellStart.size()); ++cell){
+            int first = top.cellStart[cell], last = top.cellStart[cell + 1];
+            if(last - first <= maxCellObjects){
+                continue;
+            }
+            std::vector<int> cellMembers(top.cellObjects.begin() + first, top.cellObjects.begin() + last);
+            AABB cellBox = top.cellBox(cell), subBox;
+            for(int i: cellMembers){
+                subBox.expand(AABB::intersect(boxes[i], cellBox));
+            }
+            topSubgrid[cell] = static_cast<int>(subgrids.size());
+            subgrids.push_back(Level());
+            fill(subgrids.back(), subBox, cellMembers, boxes, MAX_SUB_RESOLUTION);
+        }
+    }
+
+    virtual bool hit(const Ray& ray, HitRecord* hitRecordPtr = nullptr, Real tMin = 0.0, Real tMax = std::numeric_limits<Real>::max()){
+        Point3 origin = ray.position();
+        Vec3 dir = ray.direction();
+        Vec3 invDir(1 / dir.x(), 1 / dir.y(), 1 / dir.z());
+        bool hitAnything = false;
+        HitRecord tempHitRecord(tMax);
+        auto currentClosest = tMax;
+        int closest = -1;
+        Mailbox mailbox;
+        auto test = [&](int i){
+            if(objects[i]->hit(ray, &tempHitRecord, tMin, currentClosest)){
+                hitAnything = true;
+                currentClosest = tempHitRecord.t;
+                closest = i;
+                if(hitRecordPtr){
+                    hitRecordPtr->copy(tempHitRecord);
+                }
+            }
+        };
+        for(int i: largeObjects){
+            test(i);
+        }
+        auto visitSub = [&](const Level& level, int cell, Real tExit){
+            for(int k = level.cellStart[cell]; k < level.cellStart[cell + 1]; ++k){
+                if(!mailbox.seen(level.cellObjects[k])){
+                    test(level.cellObjects[k]);
+                }
+            }
+            // Objects reaching into later cells may be hit beyond tExit.
+            return currentClosest <= tExit;
+        };
+        auto visitTop = [&](const Level& level, int cell, Real tEnter, Real tExit){
+            if(topSubgrid[cell] >= 0){
+                walk(subgrids[topSubgrid[cell]], origin, dir, invDir, tEnter, tExit,
+                    [&](const Level& sub, int subCell, Real, Real subExit){ return visitSub(sub, subCell, subExit); });
+                return currentClosest <= tExit;
+            }
+            return visitSub(level, cell, tExit);
+        };
+        if(!topSubgrid.empty()){
+            walk(top, origin, dir, invDir, tMin, currentClosest, visitTop);
+        }
+        if(hitRecordPtr && closest >= 0){
+            hitRecordPtr->objectIndex = closest;
+            objects[closest]->surfaceCoordinates(*hitRecordPtr);
+            identifyMaterial(*hitRecordPtr);
+        }
+        return hitAnything;
+    }
+
+    virtual bool occluded(const Ray& ray, Real tMin = 0.0, Real tMax = std::numeric_limits<Real>::max()){
+        for(int i: largeObjects){
+            if(objects[i]->occluded(ray, tMin, tMax)){
+                return true;
+            }
+        }
+        if(topSubgrid.empty()){
+            return false;
+        }
+        Point3 origin = ray.position();
+        Vec3 dir = ray.direction();
+        Vec3 invDir(1 / dir.x(), 1 / dir.y(), 1 / dir.z());
+        Mailbox mailbox;
+        auto visitSub = [&](const Level& level, int cell, Real, Real){
+            for(int k = level.cellStart[cell]; k < level.cellStart[cell + 1]; ++k){
+                int i = level.cellObjects[k];
+                if(!mailbox.seen(i) && objects[i]->occluded(ray, tMin, tMax)){
+                    return true;
+                }
+            }
+            return false;
+        };
+        return walk(top, origin, dir, invDir, tMin, tMax, [&](const Level& level, int cell, Real tEnter, Real tExit){
+            if(topSubgrid[cell] >= 0){
+                return walk(subgrids[topSubgrid[cell]], origin, dir, invDir, tEnter, tExit, visitSub);
+            }
+            return visitSub(level, cell, tEnter, tExit);
+        });
+    }
+
+    // Walks the grid for each lane.
+    virtual void hitPacket(RayPacket& packet, Real tMin = 0.0){
+        HitRecord hitRecord;
+        for(int i = 0; i < packet.size; ++i){
+            if(hit(packet.ray(i), &hitRecord, tMin, packet.tMax[i])){
+                packet.tMax[i] = hitRecord.t;
+                packet.hitIndex[i] = hitRecord.objectIndex;
+            }
+        }
+    }
+
+    virtual bool boundingBox(AABB& box)const{
+        box = bounds;
+        return !bounds.empty();
+    }
+
+    // Cells of the top grid and of the finer grids.
+    int cellCount()const{
+        int cells = static_cast<int>(topSubgrid.size());
+        for(const Level& level: subgrids){
+            cells += static_cast<int>(level.cellStart.size()) - 1;
+        }
+        return cells;
+    }
+    int subgridCount()const{ return static_cast<int>(subgrids.size()); }
+    int largeObjectCount()const{ return static_cast<int>(largeObjects.size()); }
+    // Bytes of the grids and the object pointers, not of the objects.
+    std::size_t memoryBytes()const{
+        std::size_t bytes = top.memoryBytes() + topSubgrid.capacity() * sizeof(int)
+            + largeObjects.capacity() * sizeof(int) + objects.capacity() * sizeof(shared_ptr<Object>);
+        for(const Level& level: subgrids){
+            bytes += sizeof(Level) + level.memoryBytes();
+        }
+        return bytes;
+    }
+
+protected:
+    static const int MAX_RESOLUTION = 128;
+    static const int MAX_SUB_RESOLUTION = 16;
+
+    struct Level{
+        AABB box;
+        int resolution[3];
+        Vec3 cellSize, invCellSize;
+        // The objects of cell c are cellObjects[cellStart[c]] up to
+        // cellObjects[cellStart[c + 1]], with cells in x, then y, then z
+        // order.
+        std::vector<int> cellStart, cellObjects;
+
+        int cellIndex(int x, int y, int z)const{ return x + resolution[0] * (y + resolution[1] * z); }
+        int cellOf(Real value, int axis)const{
+            int cell = static_cast<int>((value - box.min()[axis]) * invCellSize[axis]);
+            return cell < 0 ? 0 : (cell >= resolution[axis] ? resolution[axis] - 1 : cell);
+        }
+        AABB cellBox(int cell)const{
+            int coords[3] = {cell % resolution[0], cell / resolution[0] % resolution[1], cell / (resolution[0] * resolution[1])};
+            Point3 low = box.min(), high = box.max();
+            for(int a = 0; a < 3; ++a){
+                if(resolution[a] > 1){
+                    low[a] = box.min()[a] + coords[a] * cellSize[a];
+                    high[a] = coords[a] + 1 == resolution[a] ? box.max()[a] : box.min()[a] + (coords[a] + 1) * cellSize[a];
+                }
+            }
+            return AABB(low, high);
+        }
+        std::size_t memoryBytes()const{
+            return (cellStart.capacity() + cellObjects.capacity()) * sizeof(int);
+        }
+    };
+
+    // The last objects a ray tested, so objects in several cells are
+    // usually tested once.
+    struct Mailbox{
+        static const int SIZE = 8;
+        int ids[SIZE];
+        int next;
+        Mailbox():next(0){
+            std::fill(ids, ids + SIZE, -1);
+        }
+        // Records i and returns whether it was recorded already.
+        bool seen(int i){
+            for(int k = 0; k < SIZE; ++k){
+                if(ids[k] == i){
+                    return true;
+                }
+            }
+            ids[next] = i;
+            next = (next + 1) % SIZE;
+            return false;
+        }
+    };
+
+    // About density cells per member, as close to cubes as the box allows.
+    // Objects spanning several cells are left out of the cells their
+    // clipped box misses (Object::clippedBox). The cells are sorted by
+    // counting, so the fill is linear in the number of entries.
+    void fill(Level& level, const AABB& box, const std::vector<int>& members, const std::vector<AABB>& boxes, int maxResolution){
+        level.box = box;
+        Vec3 extent = box.extent();
+        Real maxExtent = std::max(extent.x(), std::max(extent.y(), extent.z()));
+        Real volume = 1;
+        int dimensions = 0;
+        for(int a = 0; a < 3; ++a){
+            if(extent[a] > 1e-6 * maxExtent){
+                volume *= extent[a];
+                ++dimensions;
+            }
+        }
+        Real cells = density * members.size();
+        Real side = dimensions > 0 ? std::pow(volume / cells, Real(1) / dimensions) : 1;
+        for(int a = 0; a < 3; ++a){
+            int resolution = extent[a] > 1e-6 * maxExtent ? static_cast<int>(std::ceil(extent[a] / side)) : 1;
+            level.resolution[a] = std::max(1, std::min(resolution, maxResolution));
+            level.cellSize[a] = extent[a] / level.resolution[a];
+            level.invCellSize[a] = extent[a] > 0 ? level.resolution[a] / extent[a] : 0;
+        }
+        int cellTotal = level.resolution[0] * level.resolution[1] * level.resolution[2];
+        std::vector<int> entryCells, entryObjects;
+        for(int i: members){
+            int low[3], high[3];
+            for(int a = 0; a < 3; ++a){
+                low[a] = level.cellOf(boxes[i].min()[a], a);
+                high[a] = level.cellOf(boxes[i].max()[a], a);
+            }
+            bool single = low[0] == high[0] && low[1] == high[1] && low[2] == high[2];
+            for(int z = low[2]; z <= high[2]; ++z){
+                for(int y = low[1]; y <= high[1]; ++y){
+                    for(int x = low[0]; x <= high[0]; ++x){
+                        int cell = level.cellIndex(x, y, z);
+                        if(single || !objects[i]->clippedBox(level.cellBox(cell)).empty()){
+                            entryCells.push_back(cell);
+                            entryObjects.push_back(i);
+                        }
+                    }
+                }
+            }
+        }
+        level.cellStart.assign(cellTotal + 1, 0);
+        for(int cell: entryCells){
+            ++level.cellStart[cell + 1];
+        }
+        for(int cell = 0; cell < cellTotal; ++cell){
+            level.cellStart[cell + 1] += level.cellStart[cell];
+        }
+        level.cellObjects.resize(entryCells.size());
+        std::vector<int> offsets(level.cellStart.begin(), level.cellStart.end() - 1);
+        for(std::size_t e = 0; e < entryCells.size(); ++e){
+            level.cellObjects[offsets[entryCells[e]]++] = entryObjects[e];
+        }
+    }
+
+    // Calls visit(level, cell, tEnter, tExit) for the cells the ray passes
+    // in [tMin, tMax], in order, until it returns true, and returns whether
+    // it did.
+    template<typename Visit>
+    static bool walk(const Level& level, const Point3& origin, const Vec3& dir, const Vec3& invDir,
+            Real tMin, Real tMax, const Visit& visit){
+        Point3 low = level.box.min(), high = level.box.max();
+        for(int a = 0; a < 3; ++a){
+            if(dir[a] == 0){
+                if(origin[a] < low[a] || origin[a] > high[a]){
+                    return false;
+                }
+                continue;
+            }
+            Real t0 = (low[a] - origin[a]) * invDir[a];
+            Real t1 = (high[a] - origin[a]) * invDir[a];
+            if(invDir[a] < 0){
+                std::swap(t0, t1);
+            }
+            tMin = t0 > tMin ? t0 : tMin;
+            tMax = t1 < tMax ? t1 : tMax;
+        }
+        if(tMax < tMin){
+            return false;
+        }
+        Point3 start = origin + tMin * dir;
+        int cell[3], step[3], end[3];
+        Real tNext[3], tDelta[3];
+        for(int a = 0; a < 3; ++a){
+            cell[a] = level.cellOf(start[a], a);
+            if(dir[a] == 0 || level.resolution[a] == 1){
+                step[a] = 0;
+                end[a] = -1;
+                tNext[a] = tDelta[a] = INF;
+            }
+            else if(dir[a] > 0){
+                step[a] = 1;
+                end[a] = level.resolution[a];
+                tNext[a] = (low[a] + (cell[a] + 1) * level.cellSize[a] - origin[a]) * invDir[a];
+                tDelta[a] = level.cellSize[a] * invDir[a];
+            }
+            else{
+                step[a] = -1;
+                end[a] = -1;
+                tNext[a] = (low[a] + cell[a] * level.cellSize[a] - origin[a]) * invDir[a];
+                tDelta[a] = -level.cellSize[a] * invDir[a];
+            }
+        }
+        Real tEnter = tMin;
+        while(true){
+            int axis = tNext[0] < tNext[1] ? (tNext[0] < tNext[2] ? 0 : 2) : (tNext[1] < tNext[2] ? 1 : 2);
+            Real tExit = std::min(tNext[axis], tMax);
+            if(visit(level, level.cellIndex(cell[0], cell[1], cell[2]), tEnter, tExit)){
+                return true;
+            }
+            if(tNext[axis] >= tMax){
+                return false;
+            }
+            cell[axis] += step[axis];
+            if(cell[axis] == end[axis]){
+                return false;
+            }
+            tEnter = tNext[axis];
+            tNext[axis] += tDelta[axis];
+        }
+    }
+
+    Real density;
+    bool twoLevel;
+    int maxCellObjects;
+    AABB bounds;
+    Level top;
+    // The finer grid of each top cell, -1 if none.
+    std::vector<int> topSubgrid;
+    std::vector<Level> subgrids;
+    std::vector<int> largeObjects;
+};
+
+#endif
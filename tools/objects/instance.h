@@ -0,0 +1,100 @@
+#ifndef INSTANCE_H
+#define INSTANCE_H
+
+#include "object.h"
+#include "bvh.h"
+#include "../transform.h"
+
+// A placed copy of shared geometry, so the memory of repeated objects grows
+// with the number of unique meshes. A BVH over instances and one BVH per
+// geometry make a two-level acceleration structure. Rays are moved into the
+// geometry's space instead of the geometry into world space. Instances of
+// instances are not supported.
+class Instance: public Object{
+public:
+    // A material replaces the geometry's own. motion is the translation from
+    // time 0 to time 1, for motion blur.
+    Instance(shared_ptr<BVH> geometryPtr, const Transform& transform, shared_ptr<Material> matPtr = nullptr,
+            const Vec3& motion = Vec3(0, 0, 0))
+            :Object(transform.translation(), matPtr), geometryPtr(geometryPtr), transform(transform), motion(motion){}
+    virtual ~Instance(){}
+
+    virtual void moveTo(const Point3& newPos){
+        transform.setTranslation(newPos);
+        pos = newPos;
+    }
+    // Replaces the whole placement, containing BVHs must be refit afterwards.
+    void setTransform(const Transform& newTransform){
+        transform = newTransform;
+        pos = transform.translation();
+    }
+    const Transform& getTransform()const{ return transform; }
+
+    virtual bool hit(const Ray& ray, HitRecord* hitRecordPtr = nullptr, Real tMin = 0.0, Real tMax = std::numeric_limits<Real>::max())const{
+        STAT_INC(STAT_INSTANCE_TESTS);
+        if(!geometryPtr->hit(localRay(ray), hitRecordPtr, tMin, tMax)){
+            return false;
+        }
+        if(hitRecordPtr){
+            // The local record is complete, aggregates keep u, v, dpdu and
+            // dpdv of instances as hit leaves them.
+            Vec3 offset = ray.time() * motion;
+            hitRecordPtr->pos = transform.point(hitRecordPtr->pos) + offset;
+            hitRecordPtr->normal = normalize(transform.normal(hitRecordPtr->normal));
+            hitRecordPtr->dpdu = transform.vector(hitRecordPtr->dpdu);
+            hitRecordPtr->dpdv = transform.vector(hitRecordPtr->dpdv);
+            if(matPtr){
+                hitRecordPtr->matPtr = matPtr;
+            }
+        }
+        return true;
+    }
+    virtual bool occluded(const Ray& ray, Real tMin = 0.0, Real tMax = std::numeric_limits<Real>::max())const{
+        STAT_INC(STAT_INSTANCE_TESTS);
+        return geometryPtr->occluded(localRay(ray), tMin, tMax);
+    }
+    virtual bool boundingBox(AABB& box)const{
+        AABB box0, box1;
+        if(!motionBoxes(box0, box1)){
+            return false;
+        }
+        box = AABB::merge(box0, box1);
+        return true;
+    }
+    virtual bool motionBoxes(AABB& box0, AABB& box1)const{
+        AABB local;
+        if(!geometryPtr->boundingBox(local)){
+            return false;
+        }
+        box0 = transform.box(local);
+        box1 = AABB(box0.min() + motion, box0.max() + motion);
+        return true;
+    }
+    virtual bool isMoving()const{ return motion.lengthSquared() > 0; }
+    // Filled by hit.
+    virtual void surfaceCoordinates(HitRecord& hitRecord)const{}
+
+    virtual void collectMaterials(std::vector<const Material*>& materials)const{
+        if(matPtr){
+            materials.push_back(matPtr.get());
+        }
+        else{
+            geometryPtr->collectMaterials(materials);
+        }
+    }
+
+    shared_ptr<BVH> geometry()const{ return geometryPtr; }
+
+protected:
+    // The direction is not normalized, so t is the same in both spaces.
+    Ray localRay(const Ray& ray)const{
+        return Ray(transform.inversePoint(ray.position() - ray.time() * motion),
+            transform.inverseVector(ray.direction()), ray.time());
+    }
+
+    shared_ptr<BVH> geometryPtr;
+    Transform transform;
+    Vec3 motion;
+};
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef MOVING_SPHERE_H
+#define MOVING_SPHERE_H
+
+#include "sphere.h"
+
+// A sphere whose center moves linearly from center0 at time0 to center1 at
+// time1, for motion blur. Rays outside [time0, time1] see it extrapolated.
+class MovingSphere: public Sphere{
+public:
+    MovingSphere(const Point3& center0, const Point3& center1, Real radius,
+            shared_ptr<Material> matPtr = nullptr, Real time0 = 0, Real time1 = 1)
+            :Sphere(center0, radius, matPtr), center1(center1), time0(time0), time1(time1){}
+    virtual ~MovingSphere(){}
+
+    Point3 center(Real time)const{
+        return pos + ((time - time0) / (time1 - time0)) * (center1 - pos);
+    }
+
+    virtual bool hit(const Ray& ray, HitRecord* hitRecordPtr = nullptr, Real tMin = 0.0, Real tMax = std::numeric_limits<Real>::max())const{
+        return hitAt(center(ray.time()), ray, hitRecordPtr, tMin, tMax);
+    }
+    virtual bool occluded(const Ray& ray, Real tMin = 0.0, Real tMax = std::numeric_limits<Real>::max())const{
+        return occludedAt(center(ray.time()), ray, tMin, tMax);
+    }
+    // The lanes of a packet may have different times.
+    virtual void hitPacket(RayPacket& packet, int index, Real tMin = 0.0)const{
+        Object::hitPacket(packet, index, tMin);
+    }
+    // Everything the sphere sweeps over during the shutter.
+    virtual bool boundingBox(AABB& box)const{
+        AABB box0, box1;
+        motionBoxes(box0, box1);
+        box = AABB::merge(box0, box1);
+        return true;
+    }
+    virtual bool motionBoxes(AABB& box0, AABB& box1)const{
+        Point3 c0 = center(0), c1 = center(1);
+        box0 = AABB(c0 - radius, c0 + radius);
+        box1 = AABB(c1 - radius, c1 + radius);
+        return true;
+    }
+    virtual bool isMoving()const{ return true; }
+    virtual AABB clippedBox(const AABB& clip)const{
+        return Object::clippedBox(clip);
+    }
+    // Moves the whole path, keeping its direction and length.
+    virtual void moveTo(const Point3& newPos){
+        center1 += newPos - pos;
+        pos = newPos;
+    }
+    // Light sampling would need the time of the shading ray.
+    virtual bool sampleDirection(const Point3& ref, Vec3& dir, HitRecord& lightRecord, Real& pdf)const{
+        return false;
+    }
+
+protected:
+    Point3 center1;
+    Real time0, time1;
+};
+
+#endif
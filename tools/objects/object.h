@@ -2,9 +2,13 @@
 #define OBJECT_H
 
 #include "../ray.h"
+#include "../rayPacket.h"
 #include "../materials/material.h"
+#include "../stats.h"
+#include "aabb.h"
 #include <limits>
 #include <memory>
+#include <vector>
 
 using std::shared_ptr;
 
@@ -12,16 +16,63 @@ struct HitRecord{
     Point3 pos;
     Vec3 normal;
     bool front;
-    double t;
+    Real t;
     shared_ptr<Material> matPtr;
+    // Texture coordinates and their derivatives on the surface.
+    Real u, v;
+    Vec3 dpdu, dpdv;
+    // Change of (u, v) from one pixel to the next, zero without ray differentials.
+    Real dudx, dvdx, dudy, dvdy;
+    // Index of the object in the list or BVH that was hit, -1 if unknown.
+    int objectIndex;
+    // Number of matPtr from ObjectList::numberMaterials, -1 if not numbered.
+    int materialId;
     
-    HitRecord(double t = 0, shared_ptr<Material> matPtr = nullptr):t(t), matPtr(matPtr){}
+    HitRecord(Real t = 0, shared_ptr<Material> matPtr = nullptr)
+            :t(t), matPtr(matPtr), u(0), v(0), dudx(0), dvdx(0), dudy(0), dvdy(0), objectIndex(-1), materialId(-1){}
+    // The fields hit fills, the rest comes from surfaceCoordinates. Instances
+    // fill the surface coordinates in hit already.
     void copy(const HitRecord& hitRecord){
         t = hitRecord.t;
         normal = hitRecord.normal;
         pos = hitRecord.pos;
         front = hitRecord.front;
         matPtr = hitRecord.matPtr;
+        u = hitRecord.u;
+        v = hitRecord.v;
+        dpdu = hitRecord.dpdu;
+        dpdv = hitRecord.dpdv;
+    }
+    
+    // Intersects the neighbouring rays with the tangent plane and solves for
+    // the (u, v) derivatives in the two coordinates the normal is least aligned with.
+    void computeDifferentials(const RayDifferential& ray){
+        dudx = dvdx = dudy = dvdy = 0;
+        if(!ray.hasDifferentials){
+            return;
+        }
+        Real d = dot(normal, pos);
+        Real rxDot = dot(normal, ray.rxDir), ryDot = dot(normal, ray.ryDir);
+        if(rxDot == 0 || ryDot == 0){
+            return;
+        }
+        Point3 px = ray.rxPos + ((d - dot(normal, ray.rxPos)) / rxDot) * ray.rxDir;
+        Point3 py = ray.ryPos + ((d - dot(normal, ray.ryPos)) / ryDot) * ray.ryDir;
+        Vec3 dpdx = px - pos, dpdy = py - pos;
+        int dim0 = 1, dim1 = 2;
+        if(std::fabs(normal.x()) < std::fabs(normal.y()) || std::fabs(normal.x()) < std::fabs(normal.z())){
+            dim0 = 0;
+            dim1 = std::fabs(normal.y()) > std::fabs(normal.z()) ? 2 : 1;
+        }
+        Real a00 = dpdu[dim0], a01 = dpdv[dim0], a10 = dpdu[dim1], a11 = dpdv[dim1];
+        Real det = a00*a11 - a01*a10;
+        if(std::fabs(det) < 1e-12){
+            return;
+        }
+        dudx = (a11*dpdx[dim0] - a01*dpdx[dim1]) / det;
+        dvdx = (a00*dpdx[dim1] - a10*dpdx[dim0]) / det;
+        dudy = (a11*dpdy[dim0] - a01*dpdy[dim1]) / det;
+        dvdy = (a00*dpdy[dim1] - a10*dpdy[dim0]) / det;
     }
 };
 
@@ -31,18 +82,21 @@ public:
     Object(const Object& object):pos(object.pos),matPtr(object.matPtr){}
     Object(const Point3& pos, shared_ptr<Material> matPtr = nullptr):pos(pos), matPtr(matPtr){}
     virtual Vec3 position()const{ return pos; }
+    // Moves the object so position() becomes newPos, for animation.
+    virtual void moveTo(const Point3& newPos){ pos = newPos; }
+    shared_ptr<Material> material()const{ return matPtr; }
     virtual ~Object(){}
-    virtual bool hit(const Ray& ray, HitRecord* hitRecordPtr = nullptr, double tMin = 0.0, double tMax = std::numeric_limits<double>::max())const{
+    virtual bool hit(const Ray& ray, HitRecord* hitRecordPtr = nullptr, Real tMin = 0.0, Real tMax = std::numeric_limits<Real>::max())const{
         Vec3 relativePos = pos - ray.position();
-        double rayLength = ray.direction().length();
-        double distance = relativePos.length();
+        Real rayLength = ray.direction().length();
+        Real distance = relativePos.length();
         Vec3 rayDirNorm = ray.direction() / rayLength;
         Vec3 relativePosNorm = relativePos / distance;
-        double cosTheta = dot(rayDirNorm, relativePosNorm);
+        Real cosTheta = dot(rayDirNorm, relativePosNorm);
         if(cosTheta < 1.0){
             return false;
         }
-        double t = cosTheta * distance / rayLength;
+        Real t = cosTheta * distance / rayLength;
         if(t < tMin || t > tMax){
             return false;
         }
@@ -55,9 +109,63 @@ public:
         }
         return true;
     }
+    // Any hit in [tMin, tMax], without filling a HitRecord, for shadow rays.
+    virtual bool occluded(const Ray& ray, Real tMin = 0.0, Real tMax = std::numeric_limits<Real>::max())const{
+        return hit(ray, nullptr, tMin, tMax);
+    }
+    // Closest hits of the packet lanes, recorded as index into the owning list.
+    virtual void hitPacket(RayPacket& packet, int index, Real tMin = 0.0)const{
+        HitRecord hitRecord;
+        for(int i = 0; i < packet.size; ++i){
+            if(hit(packet.ray(i), &hitRecord, tMin, packet.tMax[i])){
+                packet.tMax[i] = hitRecord.t;
+                packet.hitIndex[i] = index;
+            }
+        }
+    }
+    virtual bool boundingBox(AABB& box)const{
+        box = AABB(pos, pos);
+        return true;
+    }
+    // Boxes at time 0 and 1 for objects that move during the shutter. The
+    // box at time t must lie inside their linear interpolation.
+    virtual bool motionBoxes(AABB& box0, AABB& box1)const{
+        if(!boundingBox(box0)){
+            return false;
+        }
+        box1 = box0;
+        return true;
+    }
+    virtual bool isMoving()const{ return false; }
+    // Bounds of the part of the object inside clip, empty if there is none,
+    // for the spatial splits of BVH_SBVH. The default clips the bounding box.
+    virtual AABB clippedBox(const AABB& clip)const{
+        AABB box;
+        if(!boundingBox(box)){
+            return clip;
+        }
+        return AABB::intersect(box, clip);
+    }
+    // Light sampling: picks a direction from ref towards this object. lightRecord
+    // gets the point reached at lightRecord.t along dir, pdf is per solid angle.
+    virtual bool sampleDirection(const Point3& ref, Vec3& dir, HitRecord& lightRecord, Real& pdf)const{
+        return false;
+    }
     virtual Vec3 normVec(const Point3& hitPoint, bool outside = true)const{
         return Vec3(0,0,0);
     }
+    // Fills u, v, dpdu and dpdv of a hit on this object. Aggregates call it
+    // once for the closest hit, so hit stays cheap for rejected candidates.
+    virtual void surfaceCoordinates(HitRecord& hitRecord)const{
+        hitRecord.u = hitRecord.v = 0;
+        hitRecord.dpdu = hitRecord.dpdv = Vec3(0,0,0);
+    }
+    // Appends the materials hits on this object can report.
+    virtual void collectMaterials(std::vector<const Material*>& materials)const{
+        if(matPtr){
+            materials.push_back(matPtr.get());
+        }
+    }
 protected:
     Point3 pos;
     shared_ptr<Material> matPtr;
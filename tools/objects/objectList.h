@@ -6,6 +6,10 @@
 #include <limits>
 #include <vector>
 #include <memory>
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <utility>
 
 using std::shared_ptr;
 using std::make_shared;
@@ -17,28 +21,130 @@ public:
     
     void clear(){ objects.clear(); }
     void add(shared_ptr<Object> object){ objects.push_back(object); }
-    virtual bool hit(const Ray& ray, HitRecord* hitRecordPtr = nullptr, double tMin = 0.0, double tMax = std::numeric_limits<double>::max()){
+    int size()const{ return static_cast<int>(objects.size()); }
+    shared_ptr<Object> operator[](int i)const{ return objects[i]; }
+    virtual ~ObjectList(){}
+    virtual bool hit(const Ray& ray, HitRecord* hitRecordPtr = nullptr, Real tMin = 0.0, Real tMax = std::numeric_limits<Real>::max()){
         bool hitAnything = false;
         HitRecord tempHitRecord(tMax);
         auto currentClosest = tMax;
-        for(const auto& object: objects){
-            if(object->hit(ray, &tempHitRecord, tMin, currentClosest)){
+        int closest = -1;
+        for(int i = 0; i < size(); ++i){
+            if(objects[i]->hit(ray, &tempHitRecord, tMin, currentClosest)){
                 hitAnything = true;
                 if(currentClosest > tempHitRecord.t){
                     currentClosest = tempHitRecord.t;
+                    closest = i;
                     if(hitRecordPtr){
                         hitRecordPtr->copy(tempHitRecord);
                     }
                 }
             }
         }
+        if(hitRecordPtr && closest >= 0){
+            hitRecordPtr->objectIndex = closest;
+            objects[closest]->surfaceCoordinates(*hitRecordPtr);
+            identifyMaterial(*hitRecordPtr);
+        }
         return hitAnything;
     }
+    // Any hit in (tMin, tMax), for shadow rays. Stops at the first hit found.
+    virtual bool occluded(const Ray& ray, Real tMin = 0.0, Real tMax = std::numeric_limits<Real>::max()){
+        for(const auto& object: objects){
+            if(object->occluded(ray, tMin, tMax)){
+                return true;
+            }
+        }
+        return false;
+    }
+    // Objects with an emissive material, for light sampling.
+    std::vector<shared_ptr<Object> > emissiveObjects()const{
+        std::vector<shared_ptr<Object> > lights;
+        for(const auto& object: objects){
+            if(object->material() && object->material()->isEmissive()){
+                lights.push_back(object);
+            }
+        }
+        return lights;
+    }
+    // Closest hits of all lanes, as indices into this list. Lanes keep their
+    // hitIndex and tMax if nothing closer is found.
+    virtual void hitPacket(RayPacket& packet, Real tMin = 0.0){
+        for(int i = 0; i < size(); ++i){
+            objects[i]->hitPacket(packet, i, tMin);
+        }
+    }
+    // Fill a HitRecord for a lane after hitPacket.
+    bool packetHitRecord(const RayPacket& packet, int lane, HitRecord& hitRecord, Real tMin = 0.0){
+        int index = packet.hitIndex[lane];
+        if(index < 0){
+            return false;
+        }
+        Ray ray = packet.ray(lane);
+        Real t = packet.tMax[lane];
+        // The scalar intersector may round t differently from the packet one.
+        if(objects[index]->hit(ray, &hitRecord, tMin, t + RAY_EPSILON * (1 + t))){
+            hitRecord.objectIndex = index;
+            objects[index]->surfaceCoordinates(hitRecord);
+            identifyMaterial(hitRecord);
+            return true;
+        }
+        return hit(ray, &hitRecord, tMin, INF);
+    }
+    virtual bool boundingBox(AABB& box)const{
+        box = AABB();
+        for(const auto& object: objects){
+            AABB objectBox;
+            if(!object->boundingBox(objectBox)){
+                return false;
+            }
+            box.expand(objectBox);
+        }
+        return !objects.empty();
+    }
     virtual Vec3 normVec(const Point3& hitPoint, bool outside = true){
         return Vec3(0,0,0);
     }
+
+    void collectMaterials(std::vector<const Material*>& materials)const{
+        for(const auto& object: objects){
+            object->collectMaterials(materials);
+        }
+    }
+    // Numbers the distinct materials from 0 in the order their objects were
+    // added, instanced ones included, so the same scene gets the same ids in
+    // any program. Hits on this list then carry them in HitRecord::materialId.
+    // Call it again after adding objects.
+    void numberMaterials(){
+        std::vector<const Material*> materials;
+        collectMaterials(materials);
+        // insert keeps the id of the first use, the map sorts by material.
+        std::map<const Material*, int> ids;
+        for(const Material* material: materials){
+            ids.insert(std::make_pair(material, static_cast<int>(ids.size())));
+        }
+        materialIds.assign(ids.begin(), ids.end());
+    }
+    // -1 for materials that were not numbered.
+    int materialId(const Material* material)const{
+        auto found = std::lower_bound(materialIds.begin(), materialIds.end(), std::make_pair(material, 0), lessMaterial);
+        return found != materialIds.end() && found->first == material ? found->second : -1;
+    }
 protected:
+    static bool lessMaterial(const std::pair<const Material*, int>& a, const std::pair<const Material*, int>& b){
+        return std::less<const Material*>()(a.first, b.first);
+    }
+    // Only lists that numbered their materials look them up, nested ones
+    // leave the id to the outermost.
+    void identifyMaterial(HitRecord& hitRecord)const{
+        if(!materialIds.empty()){
+            hitRecord.materialId = materialId(hitRecord.matPtr.get());
+        }
+    }
+
     std::vector<shared_ptr<Object> > objects;
+    // Sorted by material for lookups.
+    std::vector<std::pair<const Material*, int> > materialIds;
 };
 
 #endif
@@ -2,42 +2,150 @@
 #define SPHERE_H
 
 #include "object.h"
+#include <utility>
+#include <algorithm>
 
 class Sphere: public Object{
 public:
     Sphere():radius(0){}
     Sphere(const Sphere& sphere):Object(sphere.pos), radius(sphere.radius){}
-    Sphere(const Point3& pos, double radius, shared_ptr<Material> matPtr = nullptr):Object(pos, matPtr), radius(radius){}
+    Sphere(const Point3& pos, Real radius, shared_ptr<Material> matPtr = nullptr):Object(pos, matPtr), radius(radius){}
     virtual ~Sphere(){}
-    virtual bool hit(const Ray& ray, HitRecord* hitRecordPtr = nullptr, double tMin = 0.0, double tMax = std::numeric_limits<double>::max())const{
-        Vec3 A = ray.position(), C = pos;
-        Vec3 CtoA = A - C;
-        double a = ray.direction().lengthSquared();
-        double bHalf = dot(ray.direction(), CtoA);
-        double c = CtoA.lengthSquared() - radius*radius;
-        double discriminantQuarter = bHalf*bHalf - a*c;
+    virtual bool hit(const Ray& ray, HitRecord* hitRecordPtr = nullptr, Real tMin = 0.0, Real tMax = std::numeric_limits<Real>::max())const{
+        return hitAt(pos, ray, hitRecordPtr, tMin, tMax);
+    }
+    virtual bool occluded(const Ray& ray, Real tMin = 0.0, Real tMax = std::numeric_limits<Real>::max())const{
+        return occludedAt(pos, ray, tMin, tMax);
+    }
+    virtual void hitPacket(RayPacket& packet, int index, Real tMin = 0.0)const{
+        STAT_ADD(STAT_SPHERE_TESTS, packet.size);
+        Real cx = pos.x(), cy = pos.y(), cz = pos.z(), radius2 = radius*radius;
+        for(int i = 0; i < packet.size; ++i){
+            Real fx = packet.ox[i] - cx, fy = packet.oy[i] - cy, fz = packet.oz[i] - cz;
+            Real dx = packet.dx[i], dy = packet.dy[i], dz = packet.dz[i];
+            Real a = dx*dx + dy*dy + dz*dz;
+            Real bHalf = dx*fx + dy*fy + dz*fz;
+            Real c = fx*fx + fy*fy + fz*fz - radius2;
+            Real s = bHalf / a;
+            Real px = fx - s*dx, py = fy - s*dy, pz = fz - s*dz;
+            Real discriminantQuarter = a * (radius2 - (px*px + py*py + pz*pz));
+            Real sqrtDHalf = sqrt(std::max(discriminantQuarter, Real(0)));
+            Real q = bHalf >= 0 ? -(bHalf + sqrtDHalf) : sqrtDHalf - bHalf;
+            Real t1 = c / q, t2 = q / a;
+            Real tNear = std::min(t1, t2), tFar = std::max(t1, t2);
+            Real t = tNear >= tMin ? tNear : tFar;
+            bool hitLane = discriminantQuarter > 0 && t >= tMin && t <= packet.tMax[i];
+            packet.tMax[i] = hitLane ? t : packet.tMax[i];
+            packet.hitIndex[i] = hitLane ? index : packet.hitIndex[i];
+        }
+    }
+    virtual bool boundingBox(AABB& box)const{
+        box = AABB(pos - radius, pos + radius);
+        return true;
+    }
+    // Bounds of the surface inside clip: none if clip lies inside the ball
+    // or outside it, else on each axis the range of the ball over the part
+    // of clip nearest to the center on the other two. Widened a little for
+    // rounding.
+    virtual AABB clippedBox(const AABB& clip)const{
+        AABB box;
+        boundingBox(box);
+        box = AABB::intersect(box, clip);
+        if(box.empty()){
+            return box;
+        }
+        Point3 low = box.min(), high = box.max();
+        Real gap[3], nearest = 0, farthest = 0;
+        for(int a = 0; a < 3; ++a){
+            Real d = pos[a] < low[a] ? low[a] - pos[a] : (pos[a] > high[a] ? pos[a] - high[a] : 0);
+            gap[a] = d*d;
+            nearest += d*d;
+            farthest += std::max((pos[a] - low[a])*(pos[a] - low[a]), (pos[a] - high[a])*(pos[a] - high[a]));
+        }
+        Real radius2 = radius*radius, tolerance = 1e-6 * radius2;
+        if(nearest > radius2 + tolerance || farthest < radius2 - tolerance){
+            return AABB();
+        }
+        for(int a = 0; a < 3; ++a){
+            Real h = sqrt(std::max(Real(0), radius2 + tolerance - (nearest - gap[a])));
+            low[a] = std::max(low[a], pos[a] - h);
+            high[a] = std::min(high[a], pos[a] + h);
+            if(low[a] > high[a]){
+                return AABB();
+            }
+        }
+        return AABB(low, high);
+    }
+    // Uniform in the cone of directions subtended by the sphere.
+    virtual bool sampleDirection(const Point3& ref, Vec3& dir, HitRecord& lightRecord, Real& pdf)const{
+        Vec3 toCenter = pos - ref;
+        Real distanceSquared = toCenter.lengthSquared();
+        if(distanceSquared <= radius*radius){
+            return false;
+        }
+        Real cosThetaMax = sqrt(std::max(Real(0), 1 - radius*radius / distanceSquared));
+        Real cosTheta = 1 - randomDouble() * (1 - cosThetaMax);
+        Real sinTheta = sqrt(std::max(Real(0), 1 - cosTheta*cosTheta));
+        Real phi = randomDouble(0, 2*PI);
+        Vec3 w = toCenter / sqrt(distanceSquared), u, v;
+        Vec3::orthonormalBasis(w, u, v);
+        dir = sinTheta*cos(phi)*u + sinTheta*sin(phi)*v + cosTheta*w;
+        pdf = 1 / (2*PI*(1 - cosThetaMax));
+        return hit(Ray(ref, dir), &lightRecord, 0, INF);
+    }
+    virtual Vec3 normVec(const Point3& hitPoint, bool outside = true)const{
+        return outside ? (hitPoint - pos) / radius : (pos - hitPoint) / radius;
+    }
+    // u goes around the y axis starting at -x, v from the bottom (-y) to the top.
+    virtual void surfaceCoordinates(HitRecord& hitRecord)const{
+        Vec3 n = hitRecord.front ? hitRecord.normal : -hitRecord.normal;
+        Real theta = acos(clamp(-n.y(), Real(-1), Real(1)));
+        Real phi = atan2(-n.z(), n.x()) + PI;
+        Real sinTheta = sin(theta), cosTheta = cos(theta);
+        Real sinPhi = sin(phi), cosPhi = cos(phi);
+        hitRecord.u = phi / (2*PI);
+        hitRecord.v = theta / PI;
+        hitRecord.dpdu = (2*PI*radius) * Vec3(sinTheta*sinPhi, 0, sinTheta*cosPhi);
+        hitRecord.dpdv = (PI*radius) * Vec3(-cosTheta*cosPhi, sinTheta, cosTheta*sinPhi);
+    }
+protected:
+    // Intersection with this sphere moved to center, shared with MovingSphere.
+    bool hitAt(const Point3& center, const Ray& ray, HitRecord* hitRecordPtr, Real tMin, Real tMax)const{
+        STAT_INC(STAT_SPHERE_TESTS);
+        Vec3 CtoA = ray.position() - center;
+        Real a = ray.direction().lengthSquared();
+        Real bHalf = dot(ray.direction(), CtoA);
+        Real c = CtoA.lengthSquared() - radius*radius;
+        // Use the distance from the center to the ray line instead of bHalf*bHalf - a*c,
+        // which cancels catastrophically for large spheres in single precision.
+        Vec3 perp = CtoA - (bHalf / a) * ray.direction();
+        Real discriminantQuarter = a * (radius*radius - perp.lengthSquared());
         if(discriminantQuarter <= 0){
             return false;
         }
-        double sqrtDHalf = sqrt(discriminantQuarter);
-        double t1 = (-sqrtDHalf - bHalf) / a;
-        bool outside = (pos - ray.position()).lengthSquared() > radius*radius;
+        Real sqrtDHalf = sqrt(discriminantQuarter);
+        // Stable roots: q never subtracts numbers of similar magnitude.
+        Real q = bHalf >= 0 ? -(bHalf + sqrtDHalf) : sqrtDHalf - bHalf;
+        Real t1 = c / q, t2 = q / a;
+        if(t1 > t2){
+            std::swap(t1, t2);
+        }
+        bool outside = c > 0;
         if(t1 >= tMin && t1 <= tMax){
             if(hitRecordPtr){
                 hitRecordPtr->t = t1;
                 hitRecordPtr->pos = ray.at(t1);
-                hitRecordPtr->normal = normVec(hitRecordPtr->pos, outside);
+                hitRecordPtr->normal = (outside ? hitRecordPtr->pos - center : center - hitRecordPtr->pos) / radius;
                 hitRecordPtr->front = outside;
                 hitRecordPtr->matPtr = matPtr;
             }
             return true;
         }
-        double t2 = (sqrtDHalf - bHalf) / a;
         if(t2 >= tMin && t2 <= tMax){
             if(hitRecordPtr){
                 hitRecordPtr->t = t2;
                 hitRecordPtr->pos = ray.at(t2);
-                hitRecordPtr->normal = normVec(hitRecordPtr->pos, outside);
+                hitRecordPtr->normal = (outside ? hitRecordPtr->pos - center : center - hitRecordPtr->pos) / radius;
                 hitRecordPtr->front = outside;
                 hitRecordPtr->matPtr = matPtr;
             }
@@ -45,11 +153,23 @@ public:
         }
         return false;
     }
-    virtual Vec3 normVec(const Point3& hitPoint, bool outside = true)const{
-        return outside ? (hitPoint - pos) / radius : (pos - hitPoint) / radius;
+    bool occludedAt(const Point3& center, const Ray& ray, Real tMin, Real tMax)const{
+        STAT_INC(STAT_SPHERE_TESTS);
+        Vec3 CtoA = ray.position() - center;
+        Real a = ray.direction().lengthSquared();
+        Real bHalf = dot(ray.direction(), CtoA);
+        Vec3 perp = CtoA - (bHalf / a) * ray.direction();
+        Real discriminantQuarter = a * (radius*radius - perp.lengthSquared());
+        if(discriminantQuarter <= 0){
+            return false;
+        }
+        Real sqrtDHalf = sqrt(discriminantQuarter);
+        Real q = bHalf >= 0 ? -(bHalf + sqrtDHalf) : sqrtDHalf - bHalf;
+        Real t1 = (CtoA.lengthSquared() - radius*radius) / q, t2 = q / a;
+        return (t1 >= tMin && t1 <= tMax) || (t2 >= tMin && t2 <= tMax);
     }
-protected:
-    double radius;
+
+    Real radius;
 };
 
 #endif
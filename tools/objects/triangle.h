@@ -0,0 +1,169 @@
+#ifndef TRIANGLE_H
+#define TRIANGLE_H
+
+#include "object.h"
+#include <algorithm>
+
+// The front side is the one cross(v1 - v0, v2 - v0) points to.
+class Triangle: public Object{
+public:
+    Triangle(){}
+    // Texture coordinates are given as (u, v, ignored), by default (u, v) are
+    // the barycentric coordinates of v1 and v2.
+    Triangle(const Point3& v0, const Point3& v1, const Point3& v2, shared_ptr<Material> matPtr = nullptr,
+            const Vec3& uv0 = Vec3(0, 0, 0), const Vec3& uv1 = Vec3(1, 0, 0), const Vec3& uv2 = Vec3(0, 1, 0))
+            :Object((v0 + v1 + v2) / 3, matPtr), v0(v0), v1(v1), v2(v2), uv0(uv0), uv1(uv1), uv2(uv2){
+        Vec3 n = cross(v1 - v0, v2 - v0);
+        doubleArea = n.length();
+        normal = n / doubleArea;
+    }
+    virtual ~Triangle(){}
+    virtual void moveTo(const Point3& newPos){
+        Vec3 offset = newPos - pos;
+        v0 += offset;
+        v1 += offset;
+        v2 += offset;
+        pos = newPos;
+    }
+    // Moller-Trumbore.
+    virtual bool hit(const Ray& ray, HitRecord* hitRecordPtr = nullptr, Real tMin = 0.0, Real tMax = std::numeric_limits<Real>::max())const{
+        STAT_INC(STAT_TRIANGLE_TESTS);
+        Vec3 edge1 = v1 - v0, edge2 = v2 - v0;
+        Vec3 p = cross(ray.direction(), edge2);
+        Real det = dot(edge1, p);
+        if(det == 0){
+            return false;
+        }
+        Real invDet = 1 / det;
+        Vec3 s = ray.position() - v0;
+        Real u = dot(s, p) * invDet;
+        if(u < 0 || u > 1){
+            return false;
+        }
+        Vec3 q = cross(s, edge1);
+        Real v = dot(ray.direction(), q) * invDet;
+        if(v < 0 || u + v > 1){
+            return false;
+        }
+        Real t = dot(edge2, q) * invDet;
+        if(t < tMin || t > tMax){
+            return false;
+        }
+        if(hitRecordPtr){
+            bool outside = dot(ray.direction(), normal) < 0;
+            hitRecordPtr->t = t;
+            hitRecordPtr->pos = ray.at(t);
+            hitRecordPtr->normal = outside ? normal : -normal;
+            hitRecordPtr->front = outside;
+            hitRecordPtr->matPtr = matPtr;
+        }
+        return true;
+    }
+    virtual bool occluded(const Ray& ray, Real tMin = 0.0, Real tMax = std::numeric_limits<Real>::max())const{
+        STAT_INC(STAT_TRIANGLE_TESTS);
+        Vec3 edge1 = v1 - v0, edge2 = v2 - v0;
+        Vec3 p = cross(ray.direction(), edge2);
+        Real det = dot(edge1, p);
+        if(det == 0){
+            return false;
+        }
+        Real invDet = 1 / det;
+        Vec3 s = ray.position() - v0;
+        Real u = dot(s, p) * invDet;
+        Vec3 q = cross(s, edge1);
+        Real v = dot(ray.direction(), q) * invDet;
+        Real t = dot(edge2, q) * invDet;
+        return u >= 0 && v >= 0 && u + v <= 1 && t >= tMin && t <= tMax;
+    }
+    virtual bool boundingBox(AABB& box)const{
+        box = AABB(v0, v1);
+        box.expand(v2);
+        return true;
+    }
+    // Clips the triangle against the six planes of clip in turn, each of
+    // which adds at most one vertex.
+    virtual AABB clippedBox(const AABB& clip)const{
+        Point3 polygon[9] = {v0, v1, v2}, clipped[9];
+        int n = 3;
+        for(int plane = 0; plane < 6; ++plane){
+            int a = plane / 2;
+            bool low = plane % 2 == 0;
+            Real bound = low ? clip.min()[a] : clip.max()[a];
+            int m = 0;
+            for(int i = 0; i < n; ++i){
+                const Point3& p = polygon[i];
+                const Point3& q = polygon[(i + 1) % n];
+                bool pInside = low ? p[a] >= bound : p[a] <= bound;
+                bool qInside = low ? q[a] >= bound : q[a] <= bound;
+                if(pInside){
+                    clipped[m++] = p;
+                }
+                if(pInside != qInside){
+                    Point3 r = p + ((bound - p[a]) / (q[a] - p[a])) * (q - p);
+                    r[a] = bound;
+                    clipped[m++] = r;
+                }
+            }
+            n = m;
+            if(n == 0){
+                return AABB();
+            }
+            std::copy(clipped, clipped + n, polygon);
+        }
+        AABB box;
+        for(int i = 0; i < n; ++i){
+            box.expand(polygon[i]);
+        }
+        return AABB::intersect(box, clip);
+    }
+    // Uniform by area.
+    virtual bool sampleDirection(const Point3& ref, Vec3& dir, HitRecord& lightRecord, Real& pdf)const{
+        Real su = sqrt(randomDouble());
+        Real b0 = 1 - su, b1 = randomDouble() * su;
+        Point3 p = b0 * v0 + b1 * v1 + (1 - b0 - b1) * v2;
+        dir = p - ref;
+        Real distanceSquared = dir.lengthSquared();
+        Real cosLight = std::fabs(dot(normal, dir)) / sqrt(distanceSquared);
+        if(cosLight <= 0){
+            return false;
+        }
+        pdf = distanceSquared / (cosLight * 0.5 * doubleArea);
+        bool outside = dot(dir, normal) < 0;
+        lightRecord.t = 1;
+        lightRecord.pos = p;
+        lightRecord.normal = outside ? normal : -normal;
+        lightRecord.front = outside;
+        lightRecord.matPtr = matPtr;
+        return true;
+    }
+    virtual Vec3 normVec(const Point3& hitPoint, bool outside = true)const{
+        return outside ? normal : -normal;
+    }
+    virtual void surfaceCoordinates(HitRecord& hitRecord)const{
+        Vec3 edge1 = v1 - v0, edge2 = v2 - v0, p = hitRecord.pos - v0;
+        Real d00 = dot(edge1, edge1), d01 = dot(edge1, edge2), d11 = dot(edge2, edge2);
+        Real d20 = dot(p, edge1), d21 = dot(p, edge2);
+        Real denom = d00*d11 - d01*d01;
+        Real b1 = (d11*d20 - d01*d21) / denom, b2 = (d00*d21 - d01*d20) / denom;
+        Vec3 uv = (1 - b1 - b2)*uv0 + b1*uv1 + b2*uv2;
+        hitRecord.u = uv.x();
+        hitRecord.v = uv.y();
+        Vec3 duv02 = uv0 - uv2, duv12 = uv1 - uv2;
+        Vec3 dp02 = v0 - v2, dp12 = v1 - v2;
+        Real det = duv02.x()*duv12.y() - duv02.y()*duv12.x();
+        if(std::fabs(det) < 1e-12){
+            Vec3::orthonormalBasis(normal, hitRecord.dpdu, hitRecord.dpdv);
+            return;
+        }
+        Real invDet = 1 / det;
+        hitRecord.dpdu = (duv12.y()*dp02 - duv02.y()*dp12) * invDet;
+        hitRecord.dpdv = (duv02.x()*dp12 - duv12.x()*dp02) * invDet;
+    }
+protected:
+    Point3 v0, v1, v2;
+    Vec3 uv0, uv1, uv2;
+    Vec3 normal;
+    Real doubleArea;
+};
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+
+inline int defaultThreadCount(){
+    unsigned n = std::thread::hardware_concurrency();
+    return n > 0 ? static_cast<int>(n) : 1;
+}
+
+// Calls body(i) for every i in [begin, end) on nThreads threads (all cores
+// if 0), which take chunks of grain indices from a shared counter. The
+// calling thread works too. Needs -pthread.
+template<typename Body>
+void parallelFor(int begin, int end, const Body& body, int grain = 1, int nThreads = 0){
+    if(nThreads <= 0){
+        nThreads = defaultThreadCount();
+    }
+    grain = std::max(grain, 1);
+    nThreads = std::min(nThreads, (end - begin + grain - 1) / grain);
+    std::atomic<int> next(begin);
+    auto worker = [&](){
+        for(int first = next.fetch_add(grain); first < end; first = next.fetch_add(grain)){
+            int last = std::min(first + grain, end);
+            for(int i = first; i < last; ++i){
+                body(i);
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    for(int t = 1; t < nThreads; ++t){
+        threads.emplace_back(worker);
+    }
+    worker();
+    for(auto& thread: threads){
+        thread.join();
+    }
+}
+
+#endif
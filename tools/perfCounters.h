@@ -0,0 +1,122 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <cstdint>
+#include <cstring>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+// Hardware counters of the calling thread and of the threads it starts
+// while counting, read with perf_event_open on Linux. The generic events
+// have no L2 counter: the last level cache (LLC) is counted, and L1 data
+// cache misses as the closest thing below it. Counters the kernel refuses
+// (no PMU in a VM, perf_event_paranoid above 2, other systems) are not
+// available and read 0.
+class PerfCounters{
+public:
+    enum Event{
+        PERF_CYCLES,
+        PERF_INSTRUCTIONS,
+        PERF_L1D_READ_MISSES,
+        PERF_LLC_REFERENCES,
+        PERF_LLC_MISSES,
+        PERF_EVENTS
+    };
+
+    PerfCounters(){
+        for(int i = 0; i < PERF_EVENTS; ++i){
+            fds[i] = open(Event(i));
+            values[i] = 0;
+        }
+    }
+    ~PerfCounters(){
+#ifdef __linux__
+        for(int i = 0; i < PERF_EVENTS; ++i){
+            if(fds[i] >= 0){
+                close(fds[i]);
+            }
+        }
+#endif
+    }
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool available(Event event)const{ return fds[event] >= 0; }
+
+    void start(){
+#ifdef __linux__
+        for(int i = 0; i < PERF_EVENTS; ++i){
+            if(fds[i] >= 0){
+                ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+                ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+#endif
+    }
+    void stop(){
+#ifdef __linux__
+        for(int i = 0; i < PERF_EVENTS; ++i){
+            if(fds[i] >= 0){
+                ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+                std::uint64_t value = 0;
+                values[i] = read(fds[i], &value, sizeof(value)) == sizeof(value) ? value : 0;
+            }
+        }
+#endif
+    }
+    // Between the last start and stop.
+    std::uint64_t value(Event event)const{ return values[event]; }
+
+    static const char* name(Event event){
+        static const char* names[PERF_EVENTS] = {
+            "cycles", "instructions", "L1D read misses", "LLC references", "LLC misses"};
+        return names[event];
+    }
+
+protected:
+    static int open(Event event){
+#ifdef __linux__
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        switch(event){
+        case PERF_CYCLES:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case PERF_INSTRUCTIONS:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case PERF_L1D_READ_MISSES:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        case PERF_LLC_REFERENCES:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CACHE_REFERENCES;
+            break;
+        default:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CACHE_MISSES;
+            break;
+        }
+        return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#else
+        return -1;
+#endif
+    }
+
+    int fds[PERF_EVENTS];
+    std::uint64_t values[PERF_EVENTS];
+};
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef PFM_H
+#define PFM_H
+
+#include <string>
+#include <fstream>
+#include <vector>
+
+// Portable float map with 1 (Pf) or 3 (PF) channels. data holds the rows
+// bottom first, as PFM stores them. The "-1" scale marks little-endian
+// floats, so this assumes a little-endian machine.
+inline bool writePFM(const std::string& fname, const std::vector<float>& data, int width, int height, int channels){
+    std::ofstream out(fname.c_str(), std::ios::binary);
+    out << (channels == 1 ? "Pf" : "PF") << '\n' << width << ' ' << height << "\n-1\n";
+    out.write(reinterpret_cast<const char*>(data.data()), data.size() * sizeof(float));
+    return out.good();
+}
+
+// Reads what writePFM writes, little-endian only.
+inline bool readPFM(const std::string& fname, std::vector<float>& data, int& width, int& height, int& channels){
+    std::ifstream in(fname.c_str(), std::ios::binary);
+    std::string tag;
+    float scale;
+    if(!(in >> tag >> width >> height >> scale) || (tag != "Pf" && tag != "PF") || scale >= 0){
+        return false;
+    }
+    in.get();
+    channels = tag == "Pf" ? 1 : 3;
+    data.resize(static_cast<std::size_t>(width) * height * channels);
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(data.data()), data.size() * sizeof(float)));
+}
+
+#endif
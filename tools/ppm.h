@@ -4,6 +4,7 @@
 #include <string>
 #include <fstream>
 #include "color.h"
+#include "trace.h"
 
 class PPM{
 public:
@@ -22,7 +23,13 @@ public:
         delete[] pixels;
     }
     
+    int imageWidth()const{ return width; }
+    int imageHeight()const{ return height; }
+    RGB pixel(int h, int w)const{ return pixels[h][w]; }
+    void setPixel(int h, int w, const RGB& color){ pixels[h][w] = color; }
+    
     virtual void shadePerPixel(PixelCallback* callbackPtr, bool verbose = true){
+        TraceScope scope("shadePerPixel");
         int count = 0, total = height * width, verboseStep = 16;
         for(int h = height - 1; h >= 0; --h){
             for(int w = 0; w < width; ++w){
@@ -42,6 +49,7 @@ public:
     }
     
     virtual void writeFile(const std::string& fname, bool verbose = true){
+        TraceScope scope("writeFile " + fname, "output");
         out.open(fname);
         out << "P3\n" << width << ' ' << height << "\n255\n" << std::endl;
         for(int h = height - 1; h >= 0; --h){
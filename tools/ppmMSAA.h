@@ -3,6 +3,15 @@
 
 #include "ppm.h"
 #include "util.h"
+#include "rayPacket.h"
+#include "featureBuffer.h"
+#include "scheduler.h"
+#include "curveOrder.h"
+#include "scratch.h"
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <utility>
 
 enum WriteWay{
     DIRECT,
@@ -12,10 +21,10 @@ enum WriteWay{
 
 class PPMMSAA: public PPM{
 public:
-    PPMMSAA(int width = 256, int height = 256, int nSample = 4, double halfRange = 1.0)
-            :PPM(width, height), nSample(nSample){
-        randx = new double[nSample];
-        randy = new double[nSample];
+    PPMMSAA(int width = 256, int height = 256, int nSample = 4, Real halfRange = 1.0)
+            :PPM(width, height), nSample(nSample), halfRange(halfRange), seed(0), tileOrder(ORDER_SCANLINE), pixelOrder(ORDER_SCANLINE){
+        randx = new Real[nSample];
+        randy = new Real[nSample];
         for(int i = 0; i < nSample; ++i){
             randx[i] = randomDouble(-halfRange, halfRange);
             randy[i] = randomDouble(-halfRange, halfRange);
@@ -28,8 +37,9 @@ public:
     }
     
     virtual void shadePerPixel(PixelCallback* callbackPtr, bool verbose = true){
+        TraceScope scope("shadePerPixel");
         int count = 0, total = height * width * nSample, verboseStep = 16 * nSample;
-        double scale = 1.0 / nSample;
+        Real scale = Real(1) / nSample;
         for(int h = height - 1; h >= 0; --h){
             for(int w = 0; w < width; ++w){
                 pixels[h][w] = RGB();
@@ -51,8 +61,190 @@ public:
         }
     }
     
+    // Like shadePerPixel on nThreads threads (all cores if 0), which start
+    // with equal shares of tileSize x tileSize tiles and steal tiles from
+    // each other when they run out; the last tiles are split into quarters,
+    // so slow tiles at the end of a render are shared (see RegionScheduler).
+    // The callback must be safe to call from several threads at once.
+    // Needs -pthread. schedulerStats tells how busy each thread was.
+    // Every sample draws its random numbers, its offset in the pixel
+    // included, from its own stream (see beginSample), so the image only
+    // depends on the seed: not on the thread count, the order tiles finish
+    // in, or whether they were rendered in one run. What the callback makes
+    // in scratchArena() is freed after each sample. shadeTileRange renders
+    // tiles [first, last) only, numbered in rows from the top left, to
+    // resume a render or split it over machines.
+    void shadeTiles(PixelCallback* callbackPtr, int tileSize = 16, int nThreads = 0, bool verbose = true){
+        shadeTileRange(callbackPtr, tileSize, 0, tileCount(tileSize), nThreads, verbose);
+    }
+    int tileCount(int tileSize)const{
+        return ((width + tileSize - 1) / tileSize) * ((height + tileSize - 1) / tileSize);
+    }
+    void shadeTileRange(PixelCallback* callbackPtr, int tileSize, int first, int last, int nThreads = 0, bool verbose = true){
+        int tilesX = (width + tileSize - 1) / tileSize, tilesY = (height + tileSize - 1) / tileSize;
+        // Regions count rows from the top.
+        std::vector<Region> tiles;
+        int total = 0;
+        for(int tile: curveOrder(tileOrder, tilesX, tilesY)){
+            if(tile < first || tile >= last){
+                continue;
+            }
+            int x0 = (tile % tilesX) * tileSize, y0 = (tile / tilesX) * tileSize;
+            tiles.push_back(Region{x0, y0, std::min(x0 + tileSize, width), std::min(y0 + tileSize, height)});
+            total += tiles.back().area();
+        }
+        std::atomic<int> done(0);
+        int verboseStep = tilesX * tileSize * tileSize;
+        Real scale = Real(1) / nSample;
+        // One order per region size, split regions share theirs.
+        std::map<std::pair<int, int>, std::vector<int> > orders;
+        std::mutex ordersMutex;
+        auto regionOrder = [&](int regionWidth, int regionHeight)->const std::vector<int>&{
+            std::lock_guard<std::mutex> lock(ordersMutex);
+            auto key = std::make_pair(regionWidth, regionHeight);
+            auto found = orders.find(key);
+            if(found == orders.end()){
+                found = orders.insert(std::make_pair(key, curveOrder(pixelOrder, regionWidth, regionHeight))).first;
+            }
+            return found->second;
+        };
+        TraceScope scope("shadeTiles");
+        RegionScheduler scheduler(nThreads);
+        scheduler.run(tiles, [&](const Region& region){
+            TraceScope tileScope(Trace::enabled() ? "tile " + std::to_string(region.x0) + "," + std::to_string(region.y0)
+                + " " + std::to_string(region.x1 - region.x0) + "x" + std::to_string(region.y1 - region.y0) : std::string(), "tile");
+            int regionWidth = region.x1 - region.x0;
+            for(int cell: regionOrder(regionWidth, region.y1 - region.y0)){
+                int w = region.x0 + cell % regionWidth, h = height - 1 - (region.y0 + cell / regionWidth);
+                RGB pixel;
+                for(int i = 0; i < nSample; ++i){
+                    ScratchScope scratch;
+                    beginSample(static_cast<std::uint64_t>(h) * width + w, i, seed);
+                    double x = (w + randomDouble(-halfRange, halfRange)) / (width - 1) * 2 - 1, 
+                        y = (h + randomDouble(-halfRange, halfRange)) / (height - 1) * 2 - 1;
+                    pixel += (*callbackPtr)(x, y);
+                    endSample();
+                }
+                pixels[h][w] = pixel * scale;
+            }
+            int finished = done += region.area();
+            if(verbose && finished / verboseStep != (finished - region.area()) / verboseStep){
+                std::cerr << "\rPixels complete: " << finished << '/' << total << std::flush;
+            }
+        });
+        workerStats = scheduler.workerStats();
+        if(verbose){
+            std::cerr << "\rPixels complete: " << total << '/' << total << std::endl;
+        }
+    }
+    // Orders shadeTiles hands out tiles and renders the pixels of a tile in,
+    // rows from the top left by default. Along a space-filling curve,
+    // consecutive pixels and tiles trace similar paths, which helps the
+    // caches on scenes larger than them.
+    void setOrder(PixelOrder tileOrder, PixelOrder pixelOrder){
+        this->tileOrder = tileOrder;
+        this->pixelOrder = pixelOrder;
+    }
+    // Per thread of the last shadeTiles, the calling thread first.
+    const std::vector<WorkerStats>& schedulerStats()const{ return workerStats; }
+    
+    // Like shadePerPixel, also recording the features of the samples and the
+    // variance of each pixel into features.
+    virtual void shadeWithFeatures(FeaturePixelCallback* callbackPtr, FeatureBuffer& features, bool verbose = true){
+        TraceScope scope("shadeWithFeatures");
+        features.resize(width, height);
+        int count = 0, total = height * width * nSample, verboseStep = 16 * nSample;
+        for(int h = height - 1; h >= 0; --h){
+            for(int w = 0; w < width; ++w){
+                int index = features.index(h, w);
+                // Welford's running mean and sum of squared deviations.
+                RGB mean, squaredDeviations;
+                for(int i = 0; i < nSample; ++i){
+                    double x = (w + randx[i]) / (width - 1) * 2 - 1, 
+                        y = (h + randy[i]) / (height - 1) * 2 - 1;
+                    FeatureSample feature;
+                    RGB color = (*callbackPtr)(x, y, feature);
+                    RGB delta = color - mean;
+                    mean += delta / Real(i + 1);
+                    squaredDeviations += delta * (color - mean);
+                    features.albedo[index] += feature.albedo;
+                    features.normal[index] += feature.normal;
+                    features.depth[index] += feature.depth;
+                    ++features.sampleCount[index];
+                    if(i == 0){
+                        features.objectIndex[index] = feature.objectIndex;
+                        features.materialId[index] = feature.materialId;
+                        features.materialType[index] = feature.materialType;
+                    }
+                    ++count;
+                    if(verbose && count % verboseStep == 1){
+                        std::cerr << "\rShading complete: " << count << '/' << total << std::flush;
+                    }
+                }
+                // The samples actually accumulated into the pixel.
+                int n = features.sampleCount[index];
+                Real scale = n > 0 ? Real(1) / n : 0;
+                pixels[h][w] = mean;
+                features.albedo[index] *= scale;
+                features.normal[index] *= scale;
+                features.depth[index] *= scale;
+                features.variance[index] = n > 1 ? squaredDeviations / Real(n * (n - 1)) : RGB();
+            }
+        }
+        if(verbose){
+            std::cerr << "\rShading complete: " << total << '/' << total << std::endl;
+        }
+    }
+    
+    // Like shadePerPixel, but hands blocks of packetSize (4, 8 or 16) pixels
+    // sharing a sample offset to the callback together.
+    virtual void shadePerPacket(PacketPixelCallback* callbackPtr, int packetSize = 16, bool verbose = true){
+        TraceScope scope("shadePerPacket");
+        int blockWidth = packetSize >= 8 ? 4 : 2;
+        int blockHeight = packetSize / blockWidth;
+        int count = 0, total = height * width * nSample;
+        Real scale = Real(1) / nSample;
+        double x[MAX_PACKET_SIZE], y[MAX_PACKET_SIZE];
+        RGB colors[MAX_PACKET_SIZE];
+        int pixelW[MAX_PACKET_SIZE], pixelH[MAX_PACKET_SIZE];
+        for(int h0 = height - 1; h0 >= 0; h0 -= blockHeight){
+            for(int w0 = 0; w0 < width; w0 += blockWidth){
+                int n = 0;
+                for(int h = h0; h > h0 - blockHeight && h >= 0; --h){
+                    for(int w = w0; w < w0 + blockWidth && w < width; ++w){
+                        pixelW[n] = w;
+                        pixelH[n] = h;
+                        pixels[h][w] = RGB();
+                        ++n;
+                    }
+                }
+                for(int i = 0; i < nSample; ++i){
+                    for(int j = 0; j < n; ++j){
+                        x[j] = (pixelW[j] + randx[i]) / (width - 1) * 2 - 1;
+                        y[j] = (pixelH[j] + randy[i]) / (height - 1) * 2 - 1;
+                    }
+                    (*callbackPtr)(x, y, n, colors);
+                    for(int j = 0; j < n; ++j){
+                        pixels[pixelH[j]][pixelW[j]] += colors[j];
+                    }
+                }
+                for(int j = 0; j < n; ++j){
+                    pixels[pixelH[j]][pixelW[j]] *= scale;
+                }
+                count += n * nSample;
+            }
+            if(verbose){
+                std::cerr << "\rShading complete: " << count << '/' << total << std::flush;
+            }
+        }
+        if(verbose){
+            std::cerr << "\rShading complete: " << total << '/' << total << std::endl;
+        }
+    }
+    
     virtual void writeFile(const std::string& fname, bool verbose = true, 
         WriteWay writeWay = DIRECT, double exposureHDR = 1.0){
+        TraceScope scope("writeFile " + fname, "output");
         out.open(fname);
         out << "P3\n" << width << ' ' << height << "\n255\n" << std::endl;
         for(int h = height - 1; h >= 0; --h){
@@ -81,10 +273,16 @@ public:
             std::cerr << "\nDone." << std::endl;
         out.close();
     }
+    // Seed of the sample streams of shadeTiles.
+    void setSeed(std::uint64_t seed){ this->seed = seed; }
 protected:
     int nSample;
-    double* randx;
-    double* randy;
+    Real* randx;
+    Real* randy;
+    Real halfRange;
+    std::uint64_t seed;
+    PixelOrder tileOrder, pixelOrder;
+    std::vector<WorkerStats> workerStats;
 };
 
 #endif
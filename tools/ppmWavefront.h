@@ -0,0 +1,282 @@
+#ifndef PPM_WAVEFRONT_H
+#define PPM_WAVEFRONT_H
+
+#include "ppmMSAA.h"
+#include "camera.h"
+#include "objects/objectList.h"
+#include "materials/material.h"
+#include <vector>
+#include <algorithm>
+#include <utility>
+
+// Path state of a batch in SoA layout.
+struct PathStates{
+    std::vector<Real> ox, oy, oz, dx, dy, dz, time;
+    std::vector<Real> throughputR, throughputG, throughputB;
+    std::vector<int> pixel, depth;
+    // Intersection results of the extend stage.
+    std::vector<Real> hitT, normalX, normalY, normalZ;
+    std::vector<char> front;
+    std::vector<const Material*> material;
+    // Surface coordinates of the hit and their derivatives, for textures.
+    std::vector<Real> u, v, dudx, dvdx, dudy, dvdy;
+    std::vector<Real> dpduX, dpduY, dpduZ, dpdvX, dpdvY, dpdvZ;
+    // Rays through the neighbouring pixels, only camera rays have them.
+    std::vector<char> hasDifferentials;
+    std::vector<Real> rxOx, rxOy, rxOz, rxDx, rxDy, rxDz;
+    std::vector<Real> ryOx, ryOy, ryOz, ryDx, ryDy, ryDz;
+
+    void resize(int n){
+        ox.resize(n); oy.resize(n); oz.resize(n);
+        dx.resize(n); dy.resize(n); dz.resize(n);
+        time.resize(n);
+        throughputR.resize(n); throughputG.resize(n); throughputB.resize(n);
+        pixel.resize(n); depth.resize(n);
+        hitT.resize(n); normalX.resize(n); normalY.resize(n); normalZ.resize(n);
+        front.resize(n);
+        material.resize(n);
+        u.resize(n); v.resize(n);
+        dudx.resize(n); dvdx.resize(n); dudy.resize(n); dvdy.resize(n);
+        dpduX.resize(n); dpduY.resize(n); dpduZ.resize(n);
+        dpdvX.resize(n); dpdvY.resize(n); dpdvZ.resize(n);
+        hasDifferentials.resize(n);
+        rxOx.resize(n); rxOy.resize(n); rxOz.resize(n);
+        rxDx.resize(n); rxDy.resize(n); rxDz.resize(n);
+        ryOx.resize(n); ryOy.resize(n); ryOz.resize(n);
+        ryDx.resize(n); ryDy.resize(n); ryDz.resize(n);
+    }
+
+    // Copy the ray state of path "from" of other to slot "to".
+    void copy(const PathStates& other, int from, int to){
+        ox[to] = other.ox[from]; oy[to] = other.oy[from]; oz[to] = other.oz[from];
+        dx[to] = other.dx[from]; dy[to] = other.dy[from]; dz[to] = other.dz[from];
+        time[to] = other.time[from];
+        throughputR[to] = other.throughputR[from];
+        throughputG[to] = other.throughputG[from];
+        throughputB[to] = other.throughputB[from];
+        pixel[to] = other.pixel[from];
+        depth[to] = other.depth[from];
+        hasDifferentials[to] = other.hasDifferentials[from];
+        rxOx[to] = other.rxOx[from]; rxOy[to] = other.rxOy[from]; rxOz[to] = other.rxOz[from];
+        rxDx[to] = other.rxDx[from]; rxDy[to] = other.rxDy[from]; rxDz[to] = other.rxDz[from];
+        ryOx[to] = other.ryOx[from]; ryOy[to] = other.ryOy[from]; ryOz[to] = other.ryOz[from];
+        ryDx[to] = other.ryDx[from]; ryDy[to] = other.ryDy[from]; ryDz[to] = other.ryDz[from];
+    }
+
+    Ray ray(int i)const{
+        return Ray(Point3(ox[i], oy[i], oz[i]), Vec3(dx[i], dy[i], dz[i]), time[i]);
+    }
+
+    RayDifferential rayDifferential(int i)const{
+        RayDifferential ray(this->ray(i));
+        ray.hasDifferentials = hasDifferentials[i] != 0;
+        ray.rxPos = Point3(rxOx[i], rxOy[i], rxOz[i]);
+        ray.rxDir = Vec3(rxDx[i], rxDy[i], rxDz[i]);
+        ray.ryPos = Point3(ryOx[i], ryOy[i], ryOz[i]);
+        ray.ryDir = Vec3(ryDx[i], ryDy[i], ryDz[i]);
+        return ray;
+    }
+
+    void setDifferentials(int i, const RayDifferential& ray){
+        hasDifferentials[i] = ray.hasDifferentials;
+        rxOx[i] = ray.rxPos.x(); rxOy[i] = ray.rxPos.y(); rxOz[i] = ray.rxPos.z();
+        rxDx[i] = ray.rxDir.x(); rxDy[i] = ray.rxDir.y(); rxDz[i] = ray.rxDir.z();
+        ryOx[i] = ray.ryPos.x(); ryOy[i] = ray.ryPos.y(); ryOz[i] = ray.ryPos.z();
+        ryDx[i] = ray.ryDir.x(); ryDy[i] = ray.ryDir.y(); ryDz[i] = ray.ryDir.z();
+    }
+
+    void setSurface(int i, const HitRecord& hitRecord){
+        u[i] = hitRecord.u; v[i] = hitRecord.v;
+        dudx[i] = hitRecord.dudx; dvdx[i] = hitRecord.dvdx;
+        dudy[i] = hitRecord.dudy; dvdy[i] = hitRecord.dvdy;
+        dpduX[i] = hitRecord.dpdu.x(); dpduY[i] = hitRecord.dpdu.y(); dpduZ[i] = hitRecord.dpdu.z();
+        dpdvX[i] = hitRecord.dpdv.x(); dpdvY[i] = hitRecord.dpdv.y(); dpdvZ[i] = hitRecord.dpdv.z();
+    }
+
+    void getSurface(int i, HitRecord& hitRecord)const{
+        hitRecord.u = u[i]; hitRecord.v = v[i];
+        hitRecord.dudx = dudx[i]; hitRecord.dvdx = dvdx[i];
+        hitRecord.dudy = dudy[i]; hitRecord.dvdy = dvdy[i];
+        hitRecord.dpdu = Vec3(dpduX[i], dpduY[i], dpduZ[i]);
+        hitRecord.dpdv = Vec3(dpdvX[i], dpdvY[i], dpdvZ[i]);
+    }
+
+    void setRay(int i, const Ray& ray){
+        Point3 p = ray.position();
+        Vec3 d = ray.direction();
+        ox[i] = p.x(); oy[i] = p.y(); oz[i] = p.z();
+        dx[i] = d.x(); dy[i] = d.y(); dz[i] = d.z();
+        time[i] = ray.time();
+    }
+};
+
+// Wavefront path tracer: instead of following one path to its end like
+// PixelShader::shadeByDepth, batches of paths go through the stages
+// generate, extend (intersect), sort by material, shade and compact.
+// Each stage is a loop over the whole batch.
+class PPMWavefront: public PPMMSAA{
+public:
+    PPMWavefront(int width = 256, int height = 256, int nSample = 4, Real halfRange = 1.0, int batchSize = 1 << 18)
+            :PPMMSAA(width, height, nSample, halfRange), batchSize(batchSize), accumulated(width * height){
+        paths.resize(batchSize);
+        compacted.resize(batchSize);
+        order.resize(batchSize);
+    }
+    virtual ~PPMWavefront(){}
+
+    void shadeWavefront(const Camera& camera, ObjectList& world, int maxDepth, bool verbose = true){
+        long long total = static_cast<long long>(width) * height * nSample;
+        std::fill(accumulated.begin(), accumulated.end(), RGB());
+        for(long long first = 0; first < total; first += batchSize){
+            int count = static_cast<int>(std::min<long long>(batchSize, total - first));
+            generate(camera, first, count);
+            while(count > 0){
+                extend(world, count);
+                sortByMaterial(count);
+                shade(maxDepth);
+                count = compact();
+            }
+            if(verbose){
+                std::cerr << "\rShading complete: " << std::min(first + batchSize, total) << '/' << total << std::flush;
+            }
+        }
+        if(verbose){
+            std::cerr << std::endl;
+        }
+        Real scale = Real(1) / nSample;
+        for(int h = 0; h < height; ++h){
+            for(int w = 0; w < width; ++w){
+                pixels[h][w] = scale * accumulated[h * width + w];
+            }
+        }
+    }
+
+protected:
+    // Camera rays of samples [first, first + count), sample index is the
+    // fastest, with the rays through the neighbouring pixels for texture
+    // filtering.
+    void generate(const Camera& camera, long long first, int count){
+        for(int i = 0; i < count; ++i){
+            long long index = first + i;
+            int sample = static_cast<int>(index % nSample);
+            int pixel = static_cast<int>(index / nSample);
+            int h = pixel / width, w = pixel % width;
+            double x = (w + randx[sample]) / (width - 1) * 2 - 1,
+                y = (h + randy[sample]) / (height - 1) * 2 - 1;
+            RayDifferential ray = camera.getRayDifferentialXY(x, y, 2.0 / (width - 1), 2.0 / (height - 1));
+            paths.setRay(i, ray);
+            paths.setDifferentials(i, ray);
+            paths.throughputR[i] = paths.throughputG[i] = paths.throughputB[i] = 1;
+            paths.pixel[i] = pixel;
+            paths.depth[i] = 0;
+        }
+    }
+
+    // Closest hits; escaped paths pick up the background and get no material.
+    void extend(ObjectList& world, int count){
+        HitRecord hitRecord;
+        for(int i = 0; i < count; ++i){
+            RayDifferential ray = paths.rayDifferential(i);
+            if(world.hit(ray, &hitRecord, TINY, INF)){
+                hitRecord.computeDifferentials(ray);
+                paths.setSurface(i, hitRecord);
+                paths.hitT[i] = hitRecord.t;
+                paths.normalX[i] = hitRecord.normal.x();
+                paths.normalY[i] = hitRecord.normal.y();
+                paths.normalZ[i] = hitRecord.normal.z();
+                paths.front[i] = hitRecord.front;
+                paths.material[i] = hitRecord.matPtr.get();
+                // A hit without material absorbs the path.
+                if(!paths.material[i]){
+                    paths.depth[i] = -1;
+                }
+                else if(paths.material[i]->isEmissive()){
+                    accumulated[paths.pixel[i]] +=
+                        RGB(paths.throughputR[i], paths.throughputG[i], paths.throughputB[i]) * paths.material[i]->emitted(hitRecord);
+                }
+            }
+            else{
+                accumulated[paths.pixel[i]] +=
+                    RGB(paths.throughputR[i], paths.throughputG[i], paths.throughputB[i]) * backgroundColor(ray);
+                paths.material[i] = nullptr;
+                paths.depth[i] = -1;
+            }
+        }
+    }
+
+    // Counting sort of the live paths by material type, so the shade stage
+    // runs the same scatter code for long stretches.
+    void sortByMaterial(int count){
+        int offsets[MATERIAL_TYPE_COUNT + 1] = {0};
+        for(int i = 0; i < count; ++i){
+            if(paths.depth[i] >= 0){
+                ++offsets[paths.material[i]->type() + 1];
+            }
+        }
+        for(int t = 0; t < MATERIAL_TYPE_COUNT; ++t){
+            offsets[t + 1] += offsets[t];
+        }
+        liveCount = offsets[MATERIAL_TYPE_COUNT];
+        for(int i = 0; i < count; ++i){
+            if(paths.depth[i] >= 0){
+                order[offsets[paths.material[i]->type()]++] = i;
+            }
+        }
+    }
+
+    void shade(int maxDepth){
+        HitRecord hitRecord;
+        for(int k = 0; k < liveCount; ++k){
+            int i = order[k];
+            Ray ray = paths.ray(i);
+            hitRecord.t = paths.hitT[i];
+            hitRecord.pos = ray.at(paths.hitT[i]);
+            hitRecord.normal = Vec3(paths.normalX[i], paths.normalY[i], paths.normalZ[i]);
+            hitRecord.front = paths.front[i];
+            paths.getSurface(i, hitRecord);
+            Ray scattered;
+            RGB attenuation;
+            if(paths.depth[i] + 1 >= maxDepth ||
+                    !paths.material[i]->scatter(ray, hitRecord, attenuation, scattered)){
+                paths.depth[i] = -1;
+                continue;
+            }
+            paths.setRay(i, scattered);
+            paths.hasDifferentials[i] = 0;
+            paths.throughputR[i] *= attenuation.r();
+            paths.throughputG[i] *= attenuation.g();
+            paths.throughputB[i] *= attenuation.b();
+            ++paths.depth[i];
+        }
+    }
+
+    // Gather the live paths into the front of the other buffer, keeping the
+    // material order, returns their count.
+    int compact(){
+        int live = 0;
+        for(int k = 0; k < liveCount; ++k){
+            int i = order[k];
+            if(paths.depth[i] >= 0){
+                compacted.copy(paths, i, live++);
+            }
+        }
+        std::swap(paths, compacted);
+        return live;
+    }
+
+    RGB backgroundColor(const Ray& r){
+        Vec3 dir = normalize(r.direction());
+        auto t = 0.5 * (dir.y() + 1.0);
+        return interpolate(
+            Color(1.0, 1.0, 1.0),
+            Color(0.5, 0.7, 1.0),
+            t);
+    }
+
+    int batchSize, liveCount;
+    PathStates paths, compacted;
+    std::vector<int> order;
+    std::vector<RGB> accumulated;
+};
+
+#endif
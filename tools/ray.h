@@ -2,23 +2,48 @@
 #define RAY_H
 
 #include "vec3.h"
+#include <algorithm>
 
 class Ray{
 public:
-    Ray(){}
-    Ray(const Point3& pos, const Vec3& dir)
-        :pos(pos), dir(dir){}
+    Ray():tm(0){}
+    Ray(const Point3& pos, const Vec3& dir, Real time = 0)
+        :pos(pos), dir(dir), tm(time){}
     
     Point3 position()const{ return pos;}
     Vec3 direction()const{ return dir;}
+    // When in the shutter interval the ray is traced, for motion blur.
+    Real time()const{ return tm;}
     
-    Point3 at(double t)const{
+    Point3 at(Real t)const{
         return pos + t * dir;
     } 
     
 protected:
     Point3 pos;
     Vec3 dir;
+    Real tm;
 };
 
+// A camera ray with the rays through the next pixel in x and y, which give
+// the footprint of the pixel on a surface for texture filtering.
+class RayDifferential: public Ray{
+public:
+    RayDifferential():hasDifferentials(false){}
+    RayDifferential(const Ray& ray):Ray(ray), hasDifferentials(false){}
+    
+    Point3 rxPos, ryPos;
+    Vec3 rxDir, ryDir;
+    bool hasDifferentials;
+};
+
+// Move a hit point off the surface, to the side of normal that dir leaves through,
+// so the spawned ray does not hit the surface again. The error of a computed hit 
+// position grows with its magnitude, so the offset does too.
+inline Point3 offsetRayOrigin(const Point3& pos, const Vec3& normal, const Vec3& dir){
+    Real magnitude = std::max(std::max(std::fabs(pos.x()), std::fabs(pos.y())), std::fabs(pos.z()));
+    Real offset = RAY_EPSILON * (1 + magnitude);
+    return dot(dir, normal) >= 0 ? pos + offset * normal : pos - offset * normal;
+}
+
 #endif
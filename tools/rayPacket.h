@@ -0,0 +1,126 @@
+#ifndef RAY_PACKET_H
+#define RAY_PACKET_H
+
+#include "ray.h"
+#include "util.h"
+#include "objects/aabb.h"
+#include <algorithm>
+
+const int MAX_PACKET_SIZE = 16;
+
+// Up to MAX_PACKET_SIZE coherent rays in SoA layout, so the per-lane loops
+// of the intersectors compile to SIMD code. Each lane keeps its closest t
+// in tMax and the index of the primitive hit in hitIndex (-1 for a miss).
+class RayPacket{
+public:
+    RayPacket():size(0), coherent(false){}
+
+    void setRay(int lane, const Ray& ray){
+        Point3 p = ray.position();
+        Vec3 d = ray.direction();
+        ox[lane] = p.x(); oy[lane] = p.y(); oz[lane] = p.z();
+        dx[lane] = d.x(); dy[lane] = d.y(); dz[lane] = d.z();
+        time[lane] = ray.time();
+        tMax[lane] = INF;
+        hitIndex[lane] = -1;
+    }
+
+    Ray ray(int lane)const{
+        return Ray(Point3(ox[lane], oy[lane], oz[lane]), Vec3(dx[lane], dy[lane], dz[lane]), time[lane]);
+    }
+
+    // Call after all lanes are set: computes reciprocal directions and the
+    // bounds of origins and reciprocal directions used for interval culling.
+    void prepare(){
+        const Real* o[3] = {ox, oy, oz};
+        const Real* d[3] = {dx, dy, dz};
+        Real* inv[3] = {invx, invy, invz};
+        coherent = size > 0;
+        for(int a = 0; a < 3; ++a){
+            originMin[a] = invMin[a] = INF;
+            originMax[a] = invMax[a] = -INF;
+            int positive = 0, negative = 0;
+            for(int i = 0; i < size; ++i){
+                inv[a][i] = 1 / d[a][i];
+                originMin[a] = std::min(originMin[a], o[a][i]);
+                originMax[a] = std::max(originMax[a], o[a][i]);
+                invMin[a] = std::min(invMin[a], inv[a][i]);
+                invMax[a] = std::max(invMax[a], inv[a][i]);
+                positive += d[a][i] > 0;
+                negative += d[a][i] < 0;
+            }
+            // Interval arithmetic needs finite reciprocals of one sign per axis.
+            if(positive != size && negative != size){
+                coherent = false;
+            }
+        }
+    }
+
+    Real maxT()const{
+        Real t = -INF;
+        for(int i = 0; i < size; ++i){
+            t = std::max(t, tMax[i]);
+        }
+        return t;
+    }
+
+    // Conservative frustum test by interval arithmetic: true only if no ray
+    // of a coherent packet can hit the box within [tMin, tMaxAll].
+    bool missesBox(const AABB& box, Real tMin, Real tMaxAll)const{
+        if(!coherent){
+            return false;
+        }
+        Point3 bmin = box.min(), bmax = box.max();
+        Real tNear = tMin, tFar = tMaxAll;
+        for(int a = 0; a < 3; ++a){
+            Real lo0, hi0, lo1, hi1;
+            intervalMul(bmin[a] - originMax[a], bmin[a] - originMin[a], invMin[a], invMax[a], lo0, hi0);
+            intervalMul(bmax[a] - originMax[a], bmax[a] - originMin[a], invMin[a], invMax[a], lo1, hi1);
+            if(invMin[a] > 0){
+                tNear = std::max(tNear, lo0);
+                tFar = std::min(tFar, hi1);
+            }
+            else{
+                tNear = std::max(tNear, lo1);
+                tFar = std::min(tFar, hi0);
+            }
+        }
+        return tNear > tFar;
+    }
+
+    // Lanes whose ray hits the box before their current tMax, returns the count.
+    int hitBox(const AABB& box, Real tMin, bool* laneMask)const{
+        Point3 bmin = box.min(), bmax = box.max();
+        int count = 0;
+        for(int i = 0; i < size; ++i){
+            Real tx0 = (bmin.x() - ox[i]) * invx[i], tx1 = (bmax.x() - ox[i]) * invx[i];
+            Real ty0 = (bmin.y() - oy[i]) * invy[i], ty1 = (bmax.y() - oy[i]) * invy[i];
+            Real tz0 = (bmin.z() - oz[i]) * invz[i], tz1 = (bmax.z() - oz[i]) * invz[i];
+            Real tNear = std::max(std::max(std::min(tx0, tx1), std::min(ty0, ty1)), std::max(std::min(tz0, tz1), tMin));
+            Real tFar = std::min(std::min(std::max(tx0, tx1), std::max(ty0, ty1)), std::min(std::max(tz0, tz1), tMax[i]));
+            laneMask[i] = tNear <= tFar;
+            count += laneMask[i];
+        }
+        return count;
+    }
+
+    int size;
+    alignas(64) Real ox[MAX_PACKET_SIZE], oy[MAX_PACKET_SIZE], oz[MAX_PACKET_SIZE];
+    alignas(64) Real dx[MAX_PACKET_SIZE], dy[MAX_PACKET_SIZE], dz[MAX_PACKET_SIZE];
+    alignas(64) Real invx[MAX_PACKET_SIZE], invy[MAX_PACKET_SIZE], invz[MAX_PACKET_SIZE];
+    alignas(64) Real tMax[MAX_PACKET_SIZE];
+    Real time[MAX_PACKET_SIZE];
+    int hitIndex[MAX_PACKET_SIZE];
+
+protected:
+    static void intervalMul(Real a, Real b, Real c, Real d, Real& lo, Real& hi){
+        Real ac = a*c, ad = a*d, bc = b*c, bd = b*d;
+        lo = std::min(std::min(ac, ad), std::min(bc, bd));
+        hi = std::max(std::max(ac, ad), std::max(bc, bd));
+    }
+
+    bool coherent;
+    Real originMin[3], originMax[3], invMin[3], invMax[3];
+};
+
+#endif
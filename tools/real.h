@@ -0,0 +1,12 @@
+#ifndef REAL_H
+#define REAL_H
+
+// Scalar type of the math core (vectors, rays, cameras, primitives, framebuffers).
+// Build with -DUSE_FLOAT for single precision.
+#ifdef USE_FLOAT
+typedef float Real;
+#else
+typedef double Real;
+#endif
+
+#endif
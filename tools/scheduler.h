@@ -0,0 +1,220 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "parallel.h"
+#include <atomic>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <algorithm>
+#include <cstdint>
+
+// A rectangle of pixels [x0, x1) x [y0, y1).
+struct Region{
+    int x0, y0, x1, y1;
+    int area()const{ return (x1 - x0) * (y1 - y0); }
+};
+
+// Chase-Lev work-stealing deque of ints with a fixed capacity (a power of
+// two). The owner pushes and pops at the bottom, other threads steal from
+// the top without locks. Memory orders follow Le et al., "Correct and
+// Efficient Work-Stealing for Weak Memory Models" (2013).
+class WorkDeque{
+public:
+    WorkDeque(int capacity = 1024)
+            :slots(new std::atomic<int>[capacity]), mask(capacity - 1), top(0), bottom(0){}
+
+    // Owner only. Returns false if the deque is full.
+    bool push(int item){
+        std::int64_t b = bottom.load(std::memory_order_relaxed);
+        std::int64_t t = top.load(std::memory_order_acquire);
+        if(b - t > mask){
+            return false;
+        }
+        slots[b & mask].store(item, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+    // Owner only, the most recently pushed item.
+    bool pop(int& item){
+        std::int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        std::int64_t t = top.load(std::memory_order_relaxed);
+        if(t > b){
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+        item = slots[b & mask].load(std::memory_order_relaxed);
+        if(t == b){
+            // The last item, a thief may be taking it too.
+            bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+    // Any thread, the oldest item. Fails if empty or another thief won.
+    bool steal(int& item){
+        std::int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        std::int64_t b = bottom.load(std::memory_order_acquire);
+        if(t >= b){
+            return false;
+        }
+        item = slots[t & mask].load(std::memory_order_relaxed);
+        return top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    }
+
+protected:
+    std::unique_ptr<std::atomic<int>[]> slots;
+    std::int64_t mask;
+    // Padded apart, so the owner and the thieves do not share a cache line.
+    std::atomic<std::int64_t> top;
+    char padding[64];
+    std::atomic<std::int64_t> bottom;
+};
+
+struct WorkerStats{
+    int regions, steals, splits;
+    double busySeconds, idleSeconds;
+};
+
+// Runs body(region) for regions of an image on nThreads workers (all cores
+// if 0), the calling thread being worker 0. Each worker starts with a
+// contiguous share of the regions in its own deque and steals from a
+// random other worker when it runs out. Once fewer regions are queued than
+// there are workers, a worker splits the region it takes into quarters
+// first, until regions get smaller than minSplit pixels on a side, so the
+// last tiles of a render are shared before workers run dry. Needs -pthread.
+class RegionScheduler{
+public:
+    RegionScheduler(int nThreads = 0, int minSplit = 4)
+            :nThreads(nThreads > 0 ? nThreads : defaultThreadCount()), minSplit(minSplit){}
+
+    template<typename Body>
+    void run(const std::vector<Region>& initial, const Body& body){
+        int n = std::max(1, std::min(nThreads, static_cast<int>(initial.size())));
+        // Every region splits into at most 4^depth pieces.
+        int perRegion = 1, maxSide = 0;
+        for(const Region& region: initial){
+            maxSide = std::max(maxSide, std::max(region.x1 - region.x0, region.y1 - region.y0));
+        }
+        for(int side = maxSide, pieces = 1; side >= 2 * minSplit; side = (side + 1) / 2){
+            pieces *= 4;
+            perRegion += pieces;
+        }
+        regions.assign(initial.size() * perRegion, Region());
+        std::copy(initial.begin(), initial.end(), regions.begin());
+        regionCount.store(static_cast<int>(initial.size()));
+        pending.store(static_cast<int>(initial.size()));
+        queued.store(static_cast<int>(initial.size()));
+        int capacity = 1;
+        while(capacity < static_cast<int>(regions.size())){
+            capacity *= 2;
+        }
+        deques.clear();
+        for(int i = 0; i < n; ++i){
+            deques.emplace_back(new WorkDeque(capacity));
+        }
+        stats.assign(n, WorkerStats());
+        // Pushed last to first, so each worker pops its share in order.
+        for(int i = 0; i < n; ++i){
+            int first = static_cast<int>(initial.size() * i / n), last = static_cast<int>(initial.size() * (i + 1) / n);
+            for(int r = last - 1; r >= first; --r){
+                deques[i]->push(r);
+            }
+        }
+        std::vector<std::thread> threads;
+        for(int i = 1; i < n; ++i){
+            threads.emplace_back([&, i](){ work(i, body); });
+        }
+        work(0, body);
+        for(auto& thread: threads){
+            thread.join();
+        }
+    }
+
+    const std::vector<WorkerStats>& workerStats()const{ return stats; }
+
+protected:
+    typedef std::chrono::steady_clock Clock;
+
+    template<typename Body>
+    void work(int id, const Body& body){
+        WorkerStats& workerStats = stats[id];
+        std::uint32_t victimState = 2654435761u * (id + 1);
+        int index;
+        while(pending.load(std::memory_order_acquire) > 0){
+            bool found = deques[id]->pop(index);
+            if(!found){
+                auto idleStart = Clock::now();
+                while(!found && pending.load(std::memory_order_acquire) > 0){
+                    // xorshift32, for the victim order only.
+                    victimState ^= victimState << 13;
+                    victimState ^= victimState >> 17;
+                    victimState ^= victimState << 5;
+                    int victim = static_cast<int>(victimState % deques.size());
+                    if(victim != id && deques[victim]->steal(index)){
+                        found = true;
+                        ++workerStats.steals;
+                    }
+                    else{
+                        std::this_thread::yield();
+                    }
+                }
+                workerStats.idleSeconds += std::chrono::duration<double>(Clock::now() - idleStart).count();
+                if(!found){
+                    break;
+                }
+            }
+            Region region = regions[index];
+            int workers = static_cast<int>(deques.size());
+            int left = queued.fetch_sub(1, std::memory_order_relaxed) - 1;
+            if(workers > 1 && left < workers && split(region, id)){
+                ++workerStats.splits;
+                continue;
+            }
+            auto start = Clock::now();
+            body(region);
+            workerStats.busySeconds += std::chrono::duration<double>(Clock::now() - start).count();
+            ++workerStats.regions;
+            pending.fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+    // Replaces region by its quarters on the worker's deque.
+    bool split(const Region& region, int id){
+        int width = region.x1 - region.x0, height = region.y1 - region.y0;
+        if(width < 2 * minSplit || height < 2 * minSplit){
+            return false;
+        }
+        int first = regionCount.fetch_add(4);
+        if(first + 4 > static_cast<int>(regions.size())){
+            return false;
+        }
+        int xm = region.x0 + width / 2, ym = region.y0 + height / 2;
+        regions[first] = Region{region.x0, region.y0, xm, ym};
+        regions[first + 1] = Region{xm, region.y0, region.x1, ym};
+        regions[first + 2] = Region{region.x0, ym, xm, region.y1};
+        regions[first + 3] = Region{xm, ym, region.x1, region.y1};
+        pending.fetch_add(3, std::memory_order_relaxed);
+        queued.fetch_add(4, std::memory_order_relaxed);
+        // Deques hold every region, so pushes cannot fail.
+        for(int i = 3; i >= 0; --i){
+            deques[id]->push(first + i);
+        }
+        return true;
+    }
+
+    int nThreads, minSplit;
+    std::vector<Region> regions;
+    std::vector<std::unique_ptr<WorkDeque> > deques;
+    std::vector<WorkerStats> stats;
+    // Regions in all deques, taken ones not counted.
+    std::atomic<int> regionCount, pending, queued;
+};
+
+#endif
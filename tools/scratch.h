@@ -0,0 +1,154 @@
+#ifndef SCRATCH_H
+#define SCRATCH_H
+
+#include <vector>
+#include <new>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <utility>
+#include <algorithm>
+#include <type_traits>
+
+// Memory for what a sample needs only while it runs: path vertices, hit
+// records, small buffers. Allocation moves a pointer forward, and reset
+// moves it back to a mark and runs the destructors of the objects made
+// since. The blocks stay for the next sample, so once the arena has grown
+// to the largest sample it never calls malloc again. Every thread has its
+// own (scratchArena), which PPMMSAA::shadeTiles resets after each sample.
+class ScratchArena{
+protected:
+    struct Destructor{
+        void (*destroy)(void*, std::size_t);
+        void* objects;
+        std::size_t count;
+        Destructor* previous;
+    };
+
+public:
+    struct Mark{
+        int block;
+        std::size_t offset;
+        Destructor* destructors;
+    };
+
+    explicit ScratchArena(std::size_t blockSize = 1 << 16)
+            :blockSize(blockSize), block(-1), offset(0), destructors(nullptr), heapAllocations(0){}
+    ~ScratchArena(){
+        reset();
+        for(auto& b: blocks){
+            std::free(b.first);
+        }
+    }
+    ScratchArena(const ScratchArena&) = delete;
+    ScratchArena& operator=(const ScratchArena&) = delete;
+
+    void* allocate(std::size_t bytes, std::size_t alignment = alignof(std::max_align_t)){
+        if(block >= 0){
+            std::uintptr_t base = reinterpret_cast<std::uintptr_t>(blocks[block].first);
+            std::size_t start = ((base + offset + alignment - 1) & ~std::uintptr_t(alignment - 1)) - base;
+            if(start + bytes <= blocks[block].second){
+                offset = start + bytes;
+                return blocks[block].first + start;
+            }
+        }
+        // The next block if it is large enough, else a new one before it.
+        std::size_t size = bytes + alignment;
+        ++block;
+        if(block == static_cast<int>(blocks.size()) || blocks[block].second < size){
+            size = std::max(size, blockSize);
+            char* memory = static_cast<char*>(std::malloc(size));
+            if(memory == nullptr){
+                throw std::bad_alloc();
+            }
+            ++heapAllocations;
+            blocks.insert(blocks.begin() + block, std::make_pair(memory, size));
+        }
+        std::uintptr_t base = reinterpret_cast<std::uintptr_t>(blocks[block].first);
+        std::size_t start = ((base + alignment - 1) & ~std::uintptr_t(alignment - 1)) - base;
+        offset = start + bytes;
+        return blocks[block].first + start;
+    }
+
+    template<typename T, typename... Args>
+    T* make(Args&&... args){
+        T* object = new(allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        registerDestructor(object, 1);
+        return object;
+    }
+    // n value-initialized objects.
+    template<typename T>
+    T* makeArray(std::size_t n){
+        T* objects = static_cast<T*>(allocate(n * sizeof(T), alignof(T)));
+        for(std::size_t i = 0; i < n; ++i){
+            new(objects + i) T();
+        }
+        registerDestructor(objects, n);
+        return objects;
+    }
+
+    Mark mark()const{ return Mark{block, offset, destructors}; }
+    // Frees everything made after mark, newest first.
+    void reset(const Mark& mark){
+        while(destructors != mark.destructors){
+            destructors->destroy(destructors->objects, destructors->count);
+            destructors = destructors->previous;
+        }
+        block = mark.block;
+        offset = mark.offset;
+    }
+    void reset(){ reset(Mark{-1, 0, nullptr}); }
+
+    std::size_t bytesReserved()const{
+        std::size_t bytes = 0;
+        for(const auto& b: blocks){
+            bytes += b.second;
+        }
+        return bytes;
+    }
+    // Blocks taken from the heap so far.
+    int heapAllocationCount()const{ return heapAllocations; }
+
+protected:
+    template<typename T>
+    static void destroyObjects(void* objects, std::size_t count){
+        for(std::size_t i = count; i > 0; --i){
+            static_cast<T*>(objects)[i - 1].~T();
+        }
+    }
+
+    template<typename T>
+    void registerDestructor(T* objects, std::size_t count){
+        if(std::is_trivially_destructible<T>::value){
+            return;
+        }
+        Destructor* destructor = static_cast<Destructor*>(allocate(sizeof(Destructor), alignof(Destructor)));
+        *destructor = Destructor{&destroyObjects<T>, objects, count, destructors};
+        destructors = destructor;
+    }
+
+    std::size_t blockSize;
+    std::vector<std::pair<char*, std::size_t> > blocks;
+    int block;
+    std::size_t offset;
+    Destructor* destructors;
+    int heapAllocations;
+};
+
+inline ScratchArena& scratchArena(){
+    thread_local ScratchArena arena;
+    return arena;
+}
+
+// Resets the thread's scratch arena to where it was at construction.
+class ScratchScope{
+public:
+    ScratchScope():arena(scratchArena()), saved(arena.mark()){}
+    ~ScratchScope(){ arena.reset(saved); }
+
+protected:
+    ScratchArena& arena;
+    ScratchArena::Mark saved;
+};
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// 4-lane registers of Real used by the SIMD Vec3 backend (-DUSE_SIMD_VEC3).
+// float needs SSE4.1 (-msse4.1), double needs AVX2 (-mavx2).
+// The 4th lane is padding; dot products ignore it.
+
+#include "real.h"
+
+#ifdef USE_FLOAT
+
+#ifndef __SSE4_1__
+#error "USE_SIMD_VEC3 with USE_FLOAT needs SSE4.1, build with -msse4.1 or -march=native."
+#endif
+#include <smmintrin.h>
+
+typedef __m128 Lane4;
+
+inline Lane4 lane4Load(const Real* p){ return _mm_loadu_ps(p); }
+inline void lane4Store(Real* p, Lane4 v){ _mm_storeu_ps(p, v); }
+inline Lane4 lane4Set(Real x, Real y, Real z){ return _mm_set_ps(0, z, y, x); }
+inline Lane4 lane4Set1(Real t){ return _mm_set1_ps(t); }
+inline Lane4 lane4Add(Lane4 u, Lane4 v){ return _mm_add_ps(u, v); }
+inline Lane4 lane4Sub(Lane4 u, Lane4 v){ return _mm_sub_ps(u, v); }
+inline Lane4 lane4Mul(Lane4 u, Lane4 v){ return _mm_mul_ps(u, v); }
+inline Lane4 lane4Neg(Lane4 v){ return _mm_xor_ps(v, _mm_set1_ps(-0.0f)); }
+
+inline Real lane4Dot3(Lane4 u, Lane4 v){
+    return _mm_cvtss_f32(_mm_dp_ps(u, v, 0x71));
+}
+
+// (y, z, x, w)
+inline Lane4 lane4YZX(Lane4 v){
+    return _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 0, 2, 1));
+}
+
+#else
+
+#ifndef __AVX2__
+#error "USE_SIMD_VEC3 with double needs AVX2, build with -mavx2 or -march=native."
+#endif
+#include <immintrin.h>
+
+typedef __m256d Lane4;
+
+inline Lane4 lane4Load(const Real* p){ return _mm256_loadu_pd(p); }
+inline void lane4Store(Real* p, Lane4 v){ _mm256_storeu_pd(p, v); }
+inline Lane4 lane4Set(Real x, Real y, Real z){ return _mm256_set_pd(0, z, y, x); }
+inline Lane4 lane4Set1(Real t){ return _mm256_set1_pd(t); }
+inline Lane4 lane4Add(Lane4 u, Lane4 v){ return _mm256_add_pd(u, v); }
+inline Lane4 lane4Sub(Lane4 u, Lane4 v){ return _mm256_sub_pd(u, v); }
+inline Lane4 lane4Mul(Lane4 u, Lane4 v){ return _mm256_mul_pd(u, v); }
+inline Lane4 lane4Neg(Lane4 v){ return _mm256_xor_pd(v, _mm256_set1_pd(-0.0)); }
+
+inline Real lane4Dot3(Lane4 u, Lane4 v){
+    Lane4 m = _mm256_mul_pd(u, v);
+    __m128d xy = _mm256_castpd256_pd128(m);
+    __m128d zw = _mm256_extractf128_pd(m, 1);
+    __m128d sum = _mm_add_sd(_mm_add_sd(xy, _mm_unpackhi_pd(xy, xy)), zw);
+    return _mm_cvtsd_f64(sum);
+}
+
+// (y, z, x, w)
+inline Lane4 lane4YZX(Lane4 v){
+    return _mm256_permute4x64_pd(v, _MM_SHUFFLE(3, 0, 2, 1));
+}
+
+#endif
+
+inline Lane4 lane4Cross(Lane4 u, Lane4 v){
+    // u.yzx * v.zxy - u.zxy * v.yzx == (u * v.yzx - u.yzx * v).yzx
+    return lane4YZX(lane4Sub(lane4Mul(u, lane4YZX(v)), lane4Mul(lane4YZX(u), v)));
+}
+
+#endif
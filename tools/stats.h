@@ -0,0 +1,143 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <vector>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <iomanip>
+#include <cstdint>
+
+// Render statistics, counted with -DUSE_STATS and compiled out otherwise.
+// Every thread counts into its own thread_local copy, which is added to the
+// totals when the thread exits, so the hot paths need no atomics. Report
+// after the render threads have joined.
+enum StatCounter{
+    STAT_SPHERE_TESTS,
+    STAT_TRIANGLE_TESTS,
+    STAT_INSTANCE_TESTS,
+    STAT_BVH_NODES,
+    STAT_CAMERA_RAYS,
+    STAT_PATHS_ESCAPED,
+    STAT_PATHS_ABSORBED,
+    STAT_PATHS_MAX_DEPTH,
+    // Rays traced at bounce 0, 1, ..., the last one counts all deeper rays.
+    STAT_RAYS_DEPTH,
+    STAT_RAYS_DEPTH_LAST = STAT_RAYS_DEPTH + 15,
+    STAT_COUNTERS
+};
+
+class Stats{
+public:
+    typedef std::vector<std::uint64_t> Counts;
+
+    struct ThreadCounts{
+        ThreadCounts():counts(STAT_COUNTERS, 0){}
+        ~ThreadCounts(){ Stats::merge(counts); }
+        Counts counts;
+    };
+
+    static ThreadCounts& local(){
+        thread_local ThreadCounts threadCounts;
+        return threadCounts;
+    }
+
+    // Counts of the exited threads plus the calling thread's.
+    static Counts totals(){
+        Counts sum = local().counts;
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        for(const Counts& counts: registry().exited){
+            for(int i = 0; i < STAT_COUNTERS; ++i){
+                sum[i] += counts[i];
+            }
+        }
+        return sum;
+    }
+    // Counts of each exited thread and then the calling thread's, to see how
+    // evenly work was spread.
+    static std::vector<Counts> perThread(){
+        std::vector<Counts> threads;
+        {
+            std::lock_guard<std::mutex> lock(registry().mutex);
+            threads = registry().exited;
+        }
+        threads.push_back(local().counts);
+        return threads;
+    }
+    static void reset(){
+        local().counts.assign(STAT_COUNTERS, 0);
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        registry().exited.clear();
+    }
+
+    static void report(std::ostream& out){
+        Counts sum = totals();
+        std::uint64_t paths = sum[STAT_PATHS_ESCAPED] + sum[STAT_PATHS_ABSORBED] + sum[STAT_PATHS_MAX_DEPTH];
+        std::uint64_t rays = 0;
+        for(int i = STAT_RAYS_DEPTH; i <= STAT_RAYS_DEPTH_LAST; ++i){
+            rays += sum[i];
+        }
+        out << "Render statistics" << std::endl;
+        out << "  camera rays        " << sum[STAT_CAMERA_RAYS] << std::endl;
+        out << "  rays traced        " << rays << std::endl;
+        out << "  BVH nodes visited  " << sum[STAT_BVH_NODES] << perRay(sum[STAT_BVH_NODES], rays) << std::endl;
+        out << "  sphere tests       " << sum[STAT_SPHERE_TESTS] << perRay(sum[STAT_SPHERE_TESTS], rays) << std::endl;
+        out << "  triangle tests     " << sum[STAT_TRIANGLE_TESTS] << perRay(sum[STAT_TRIANGLE_TESTS], rays) << std::endl;
+        out << "  instance tests     " << sum[STAT_INSTANCE_TESTS] << perRay(sum[STAT_INSTANCE_TESTS], rays) << std::endl;
+        out << "  paths escaped      " << sum[STAT_PATHS_ESCAPED] << percent(sum[STAT_PATHS_ESCAPED], paths) << std::endl;
+        out << "  paths absorbed     " << sum[STAT_PATHS_ABSORBED] << percent(sum[STAT_PATHS_ABSORBED], paths) << std::endl;
+        out << "  paths at max depth " << sum[STAT_PATHS_MAX_DEPTH] << percent(sum[STAT_PATHS_MAX_DEPTH], paths) << std::endl;
+        out << "  rays per depth    ";
+        for(int i = STAT_RAYS_DEPTH; i <= STAT_RAYS_DEPTH_LAST && sum[i] > 0; ++i){
+            out << ' ' << sum[i];
+        }
+        out << std::endl;
+        std::vector<Counts> threads = perThread();
+        if(threads.size() > 1){
+            out << "  camera rays per thread";
+            for(const Counts& counts: threads){
+                out << ' ' << counts[STAT_CAMERA_RAYS];
+            }
+            out << std::endl;
+        }
+    }
+
+protected:
+    struct Registry{
+        std::mutex mutex;
+        std::vector<Counts> exited;
+    };
+
+    static Registry& registry(){
+        static Registry r;
+        return r;
+    }
+
+    static void merge(const Counts& counts){
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        registry().exited.push_back(counts);
+    }
+
+    static std::string perRay(std::uint64_t count, std::uint64_t rays){
+        std::ostringstream s;
+        s << " (" << std::fixed << std::setprecision(2) << (rays ? double(count) / rays : 0.0) << " per ray)";
+        return s.str();
+    }
+    static std::string percent(std::uint64_t count, std::uint64_t total){
+        std::ostringstream s;
+        s << " (" << std::fixed << std::setprecision(1) << (total ? 100.0 * count / total : 0.0) << "%)";
+        return s.str();
+    }
+};
+
+#ifdef USE_STATS
+#define STAT_ADD(counter, n) (Stats::local().counts[counter] += (n))
+#else
+#define STAT_ADD(counter, n) ((void)0)
+#endif
+#define STAT_INC(counter) STAT_ADD(counter, 1)
+// Counts a ray traced at the given bounce.
+#define STAT_RAY_DEPTH(depth) STAT_INC(StatCounter(STAT_RAYS_DEPTH + ((depth) < 15 ? (depth) : 15)))
+
+#endif
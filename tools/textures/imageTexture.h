@@ -0,0 +1,72 @@
+#ifndef IMAGE_TEXTURE_H
+#define IMAGE_TEXTURE_H
+
+#include "texture.h"
+#include "textureCache.h"
+#include <cmath>
+#include <algorithm>
+
+// A texture of a TextureCache, repeated uScale x vScale times over [0, 1]^2.
+// Lookups are trilinear between the two mip levels that match the pixel
+// footprint, hits without ray differentials use the finest level.
+class ImageTexture: public Texture{
+public:
+    ImageTexture(shared_ptr<TextureCache> cachePtr, int id, Real uScale = 1, Real vScale = 1)
+            :cachePtr(cachePtr), id(id), uScale(uScale), vScale(vScale){}
+    virtual ~ImageTexture(){}
+
+    virtual RGB value(const HitRecord& hitRecord)const{
+        if(id < 0){
+            return RGB();
+        }
+        Real u = hitRecord.u * uScale, v = hitRecord.v * vScale;
+        Real width = cachePtr->levelWidth(id, 0) * uScale, height = cachePtr->levelHeight(id, 0) * vScale;
+        Real footprint = std::max(
+            std::max(std::fabs(hitRecord.dudx) * width, std::fabs(hitRecord.dvdx) * height),
+            std::max(std::fabs(hitRecord.dudy) * width, std::fabs(hitRecord.dvdy) * height));
+        int lastLevel = cachePtr->levels(id) - 1;
+        Real level = std::log2(std::max(footprint, Real(1)));
+        if(level >= lastLevel){
+            return bilinear(u, v, lastLevel);
+        }
+        int level0 = static_cast<int>(level);
+        Real t = level - level0;
+        RGB color = bilinear(u, v, level0);
+        if(t > 0){
+            color = (1 - t) * color + t * bilinear(u, v, level0 + 1);
+        }
+        return color;
+    }
+
+protected:
+    RGB bilinear(Real u, Real v, int level)const{
+        int w = cachePtr->levelWidth(id, level), h = cachePtr->levelHeight(id, level);
+        // Row 0 of the image is the top, v = 1.
+        Real x = u * w - Real(0.5), y = (1 - v) * h - Real(0.5);
+        Real fx = std::floor(x), fy = std::floor(y);
+        int x0 = wrap(static_cast<int>(fx), w), y0 = wrap(static_cast<int>(fy), h);
+        int x1 = x0 + 1 < w ? x0 + 1 : 0, y1 = y0 + 1 < h ? y0 + 1 : 0;
+        int xs[4] = {x0, x1, x0, x1}, ys[4] = {y0, y0, y1, y1};
+        Texel texels[4];
+        cachePtr->texels(id, level, xs, ys, 4, texels);
+        Real tx = x - fx, ty = y - fy;
+        Real weights[4] = {(1 - tx) * (1 - ty), tx * (1 - ty), (1 - tx) * ty, tx * ty};
+        RGB color;
+        for(int i = 0; i < 4; ++i){
+            color += weights[i] * RGB(TextureCache::decodeGamma(texels[i].r),
+                TextureCache::decodeGamma(texels[i].g), TextureCache::decodeGamma(texels[i].b));
+        }
+        return color;
+    }
+
+    static int wrap(int i, int n){
+        i %= n;
+        return i < 0 ? i + n : i;
+    }
+
+    shared_ptr<TextureCache> cachePtr;
+    int id;
+    Real uScale, vScale;
+};
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include "../objects/object.h"
+
+class Texture{
+public:
+    virtual ~Texture(){}
+    // Color at a hit, filtered over the footprint the hit record's
+    // (u, v) derivatives describe.
+    virtual RGB value(const HitRecord& hitRecord)const = 0;
+};
+
+class SolidColor: public Texture{
+public:
+    SolidColor(){}
+    SolidColor(const RGB& color):color(color){}
+    virtual RGB value(const HitRecord& hitRecord)const{ return color; }
+protected:
+    RGB color;
+};
+
+#endif
@@ -0,0 +1,272 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include "../image.h"
+#include "../util.h"
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <iterator>
+
+// 8-bit color with gamma 2.2 as in the written PPMs, alpha is linear.
+struct Texel{
+    unsigned char r, g, b, a;
+};
+
+// Textures are converted once into a file of mip levels, each cut into
+// TILE_SIZE x TILE_SIZE tiles stored contiguously, so the texels a lookup
+// needs are one small read apart. Tiles are read when first touched and at
+// most maxBytes of them stay resident, the least recently used tile is
+// replaced first.
+class TextureCache{
+public:
+    static const int TILE_SIZE = 8;
+    static const int TILE_TEXELS = TILE_SIZE * TILE_SIZE;
+
+    TextureCache(std::size_t maxBytes = std::size_t(64) << 20)
+            :maxTiles(std::max<std::size_t>(1, maxBytes / sizeof(Tile))),
+            hits(0), misses(0), evictions(0), peakTiles(0){}
+
+    // Returns the id of the texture, or -1. The tiled file is written to
+    // tiledName (fname + ".tiled" by default) if it does not exist yet.
+    // Add the textures before rendering starts.
+    int addTexture(const std::string& fname, const std::string& tiledName = ""){
+        std::string tiled = tiledName.empty() ? fname + ".tiled" : tiledName;
+        TextureFile file;
+        if(!openTiledFile(tiled, file)){
+            if(!writeTiledFile(fname, tiled) || !openTiledFile(tiled, file)){
+                return -1;
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        textures.push_back(std::move(file));
+        return static_cast<int>(textures.size()) - 1;
+    }
+
+    int levels(int id)const{ return static_cast<int>(textures[id].widths.size()); }
+    int levelWidth(int id, int level)const{ return textures[id].widths[level]; }
+    int levelHeight(int id, int level)const{ return textures[id].heights[level]; }
+
+    // Copies n texels of one level, taking the lock once. The coordinates
+    // must be inside the level.
+    void texels(int id, int level, const int* xs, const int* ys, int n, Texel* out){
+        std::lock_guard<std::mutex> lock(mutex);
+        const Tile* tile = nullptr;
+        std::uint64_t tileKey = ~std::uint64_t(0);
+        for(int i = 0; i < n; ++i){
+            int tx = xs[i] / TILE_SIZE, ty = ys[i] / TILE_SIZE;
+            std::uint64_t k = key(id, level, tx, ty);
+            if(k != tileKey){
+                tile = &fetchTile(k, id, level, tx, ty);
+                tileKey = k;
+            }
+            out[i] = tile->texels[(ys[i] % TILE_SIZE) * TILE_SIZE + xs[i] % TILE_SIZE];
+        }
+    }
+
+    std::size_t hitCount()const{ return hits; }
+    std::size_t missCount()const{ return misses; }
+    std::size_t evictionCount()const{ return evictions; }
+    std::size_t residentBytes()const{ return lru.size() * sizeof(Tile); }
+    std::size_t peakBytes()const{ return peakTiles * sizeof(Tile); }
+    void resetStats(){
+        hits = misses = evictions = 0;
+        peakTiles = lru.size();
+    }
+    // Drops every resident tile.
+    void clear(){
+        std::lock_guard<std::mutex> lock(mutex);
+        lru.clear();
+        index.clear();
+    }
+
+    static Real decodeGamma(unsigned char c){
+        static const std::vector<Real> table = gammaTable();
+        return table[c];
+    }
+
+    // Converts an image stb_image can read into a tiled mip file. Levels are
+    // box-filtered in linear color, one level in memory at a time.
+    static bool writeTiledFile(const std::string& fname, const std::string& tiled){
+        int w, h, channels;
+        unsigned char* data = stbi_load(fname.c_str(), &w, &h, &channels, 4);
+        if(!data){
+            return false;
+        }
+        std::vector<float> level(4 * static_cast<std::size_t>(w) * h);
+        for(std::size_t i = 0; i < level.size(); ++i){
+            level[i] = i % 4 == 3 ? data[i] / 255.0f : static_cast<float>(decodeGamma(data[i]));
+        }
+        stbi_image_free(data);
+
+        std::vector<std::int32_t> header(2);
+        header[0] = TILE_SIZE;
+        for(int lw = w, lh = h; ; lw = std::max(1, lw / 2), lh = std::max(1, lh / 2)){
+            header.push_back(lw);
+            header.push_back(lh);
+            if(lw == 1 && lh == 1){
+                break;
+            }
+        }
+        header[1] = static_cast<std::int32_t>(header.size() / 2 - 1);
+        std::ofstream out(tiled.c_str(), std::ios::binary);
+        out.write(magic(), 4);
+        out.write(reinterpret_cast<const char*>(header.data()), header.size() * sizeof(std::int32_t));
+
+        std::vector<Texel> tile(TILE_TEXELS);
+        for(int l = 0; l < header[1]; ++l){
+            int lw = header[2 + 2*l], lh = header[3 + 2*l];
+            for(int ty = 0; ty < (lh + TILE_SIZE - 1) / TILE_SIZE; ++ty){
+                for(int tx = 0; tx < (lw + TILE_SIZE - 1) / TILE_SIZE; ++tx){
+                    for(int j = 0; j < TILE_SIZE; ++j){
+                        for(int i = 0; i < TILE_SIZE; ++i){
+                            // Tiles over the edge repeat the last texel.
+                            int x = std::min(tx * TILE_SIZE + i, lw - 1), y = std::min(ty * TILE_SIZE + j, lh - 1);
+                            const float* c = &level[4 * (static_cast<std::size_t>(y) * lw + x)];
+                            Texel& texel = tile[j * TILE_SIZE + i];
+                            texel.r = encodeGamma(c[0]);
+                            texel.g = encodeGamma(c[1]);
+                            texel.b = encodeGamma(c[2]);
+                            texel.a = static_cast<unsigned char>(clamp(c[3], 0.0f, 1.0f) * 255 + 0.5f);
+                        }
+                    }
+                    out.write(reinterpret_cast<const char*>(tile.data()), TILE_TEXELS * sizeof(Texel));
+                }
+            }
+            if(l + 1 < header[1]){
+                level = downsample(level, lw, lh, header[4 + 2*l], header[5 + 2*l]);
+            }
+        }
+        return out.good();
+    }
+
+protected:
+    struct Tile{
+        std::uint64_t key;
+        Texel texels[TILE_TEXELS];
+    };
+
+    struct TextureFile{
+        std::unique_ptr<std::ifstream> stream;
+        std::vector<int> widths, heights, tilesX;
+        std::vector<std::streamoff> offsets;
+    };
+
+    static const char* magic(){ return "TMIP"; }
+
+    static std::uint64_t key(int id, int level, int tx, int ty){
+        return (static_cast<std::uint64_t>(id) << 48) | (static_cast<std::uint64_t>(level) << 40)
+            | (static_cast<std::uint64_t>(ty) << 20) | static_cast<std::uint64_t>(tx);
+    }
+
+    Tile& fetchTile(std::uint64_t k, int id, int level, int tx, int ty){
+        auto found = index.find(k);
+        if(found != index.end()){
+            ++hits;
+            lru.splice(lru.begin(), lru, found->second);
+            return lru.front();
+        }
+        ++misses;
+        if(lru.size() >= maxTiles){
+            ++evictions;
+            index.erase(lru.back().key);
+            lru.splice(lru.begin(), lru, std::prev(lru.end()));
+        }
+        else{
+            lru.push_front(Tile());
+            peakTiles = std::max(peakTiles, lru.size());
+        }
+        Tile& tile = lru.front();
+        tile.key = k;
+        readTile(textures[id], level, tx, ty, tile.texels);
+        index[k] = lru.begin();
+        return tile;
+    }
+
+    static void readTile(TextureFile& file, int level, int tx, int ty, Texel* texels){
+        std::streamoff offset = file.offsets[level]
+            + static_cast<std::streamoff>(ty * file.tilesX[level] + tx) * TILE_TEXELS * sizeof(Texel);
+        file.stream->seekg(offset);
+        if(!file.stream->read(reinterpret_cast<char*>(texels), TILE_TEXELS * sizeof(Texel))){
+            file.stream->clear();
+            std::fill(texels, texels + TILE_TEXELS, Texel());
+        }
+    }
+
+    // Also checks that the file is complete.
+    static bool openTiledFile(const std::string& tiled, TextureFile& file){
+        std::unique_ptr<std::ifstream> in(new std::ifstream(tiled.c_str(), std::ios::binary));
+        char tag[4];
+        std::int32_t tileSize, levelCount;
+        if(!in->read(tag, 4) || !std::equal(tag, tag + 4, magic())
+                || !in->read(reinterpret_cast<char*>(&tileSize), sizeof(tileSize))
+                || !in->read(reinterpret_cast<char*>(&levelCount), sizeof(levelCount))
+                || tileSize != TILE_SIZE || levelCount <= 0){
+            return false;
+        }
+        std::vector<std::int32_t> sizes(2 * levelCount);
+        if(!in->read(reinterpret_cast<char*>(sizes.data()), sizes.size() * sizeof(std::int32_t))){
+            return false;
+        }
+        std::streamoff offset = in->tellg();
+        for(int l = 0; l < levelCount; ++l){
+            int lw = sizes[2*l], lh = sizes[2*l + 1];
+            int tilesX = (lw + TILE_SIZE - 1) / TILE_SIZE, tilesY = (lh + TILE_SIZE - 1) / TILE_SIZE;
+            file.widths.push_back(lw);
+            file.heights.push_back(lh);
+            file.tilesX.push_back(tilesX);
+            file.offsets.push_back(offset);
+            offset += static_cast<std::streamoff>(tilesX) * tilesY * TILE_TEXELS * sizeof(Texel);
+        }
+        in->seekg(0, std::ios::end);
+        if(in->tellg() != offset){
+            return false;
+        }
+        file.stream = std::move(in);
+        return true;
+    }
+
+    static std::vector<float> downsample(const std::vector<float>& level, int w, int h, int nw, int nh){
+        std::vector<float> next(4 * static_cast<std::size_t>(nw) * nh);
+        for(int y = 0; y < nh; ++y){
+            int y0 = std::min(2*y, h - 1), y1 = std::min(2*y + 1, h - 1);
+            for(int x = 0; x < nw; ++x){
+                int x0 = std::min(2*x, w - 1), x1 = std::min(2*x + 1, w - 1);
+                for(int c = 0; c < 4; ++c){
+                    next[4 * (static_cast<std::size_t>(y) * nw + x) + c] = 0.25f * (
+                        level[4 * (static_cast<std::size_t>(y0) * w + x0) + c] + level[4 * (static_cast<std::size_t>(y0) * w + x1) + c]
+                        + level[4 * (static_cast<std::size_t>(y1) * w + x0) + c] + level[4 * (static_cast<std::size_t>(y1) * w + x1) + c]);
+                }
+            }
+        }
+        return next;
+    }
+
+    static std::vector<Real> gammaTable(){
+        std::vector<Real> table(256);
+        for(int i = 0; i < 256; ++i){
+            table[i] = std::pow(i / Real(255), Real(2.2));
+        }
+        return table;
+    }
+
+    static unsigned char encodeGamma(float c){
+        return static_cast<unsigned char>(std::pow(clamp(c, 0.0f, 1.0f), 1 / 2.2f) * 255 + 0.5f);
+    }
+
+    std::mutex mutex;
+    std::vector<TextureFile> textures;
+    std::list<Tile> lru;
+    std::unordered_map<std::uint64_t, std::list<Tile>::iterator> index;
+    std::size_t maxTiles;
+    std::size_t hits, misses, evictions, peakTiles;
+};
+
+#endif
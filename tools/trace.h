@@ -0,0 +1,129 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+
+// Timeline of render phases, written as Chrome trace JSON which
+// chrome://tracing and ui.perfetto.dev open. Recording is off until
+// Trace::start, the scopes cost one flag test then. Phases are coarse (a
+// build, a tile, a file), so events are stored under a lock.
+class Trace{
+public:
+    static void start(){
+        std::lock_guard<std::mutex> lock(state().mutex);
+        state().events.clear();
+        state().origin = std::chrono::steady_clock::now();
+        state().enabled = true;
+    }
+    static void stop(){ state().enabled = false; }
+    static bool enabled(){ return state().enabled; }
+
+    // Microseconds since start.
+    static double now(){
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - state().origin).count();
+    }
+
+    // Small ids in order of the threads' first event, the first is 0.
+    static int threadId(){
+        static std::atomic<int> threadCount(0);
+        thread_local int id = threadCount++;
+        return id;
+    }
+
+    static void record(const std::string& name, const char* category, double begin, double end){
+        Event event = {name, category, begin, end - begin, threadId()};
+        std::lock_guard<std::mutex> lock(state().mutex);
+        state().events.push_back(event);
+    }
+
+    static bool write(const std::string& fname){
+        std::lock_guard<std::mutex> lock(state().mutex);
+        std::ofstream out(fname.c_str());
+        out << std::fixed << std::setprecision(3);
+        out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+        int maxThread = 0;
+        for(const Event& event: state().events){
+            maxThread = event.thread > maxThread ? event.thread : maxThread;
+        }
+        for(int t = 0; t <= maxThread; ++t){
+            out << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << t
+                << ", \"args\": {\"name\": \"" << (t == 0 ? "main" : "worker " + std::to_string(t)) << "\"}},\n";
+        }
+        for(std::size_t i = 0; i < state().events.size(); ++i){
+            const Event& event = state().events[i];
+            out << "{\"name\": \"" << escape(event.name) << "\", \"cat\": \"" << event.category
+                << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << event.thread
+                << ", \"ts\": " << event.begin << ", \"dur\": " << event.duration << '}'
+                << (i + 1 < state().events.size() ? ",\n" : "\n");
+        }
+        out << "]}\n";
+        return out.good();
+    }
+
+    static std::size_t eventCount(){
+        std::lock_guard<std::mutex> lock(state().mutex);
+        return state().events.size();
+    }
+
+protected:
+    struct Event{
+        std::string name;
+        const char* category;
+        double begin, duration;
+        int thread;
+    };
+    struct State{
+        State():enabled(false), origin(std::chrono::steady_clock::now()){}
+        std::mutex mutex;
+        std::vector<Event> events;
+        std::atomic<bool> enabled;
+        std::chrono::steady_clock::time_point origin;
+    };
+
+    static std::string escape(const std::string& text){
+        std::string escaped;
+        for(char c: text){
+            if(c == '"' || c == '\\'){
+                escaped += '\\';
+            }
+            escaped += c;
+        }
+        return escaped;
+    }
+
+    static State& state(){
+        static State s;
+        return s;
+    }
+};
+
+// Records the time from construction to destruction as one event.
+class TraceScope{
+public:
+    TraceScope(const std::string& name, const char* category = "render")
+            :active(Trace::enabled()), category(category){
+        if(active){
+            this->name = name;
+            begin = Trace::now();
+        }
+    }
+    ~TraceScope(){
+        if(active){
+            Trace::record(name, category, begin, Trace::now());
+        }
+    }
+
+protected:
+    bool active;
+    std::string name;
+    const char* category;
+    double begin;
+};
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include "vec3.h"
+#include "util.h"
+#include "objects/aabb.h"
+#include <cmath>
+
+// Affine transform, a 3x4 matrix kept together with its inverse so points,
+// vectors and normals go both ways without inverting per ray.
+class Transform{
+public:
+    Transform(){
+        for(int i = 0; i < 3; ++i){
+            for(int j = 0; j < 4; ++j){
+                m[i][j] = inv[i][j] = i == j ? 1 : 0;
+            }
+        }
+    }
+
+    static Transform translate(const Vec3& offset){
+        Transform t;
+        for(int i = 0; i < 3; ++i){
+            t.m[i][3] = offset[i];
+            t.inv[i][3] = -offset[i];
+        }
+        return t;
+    }
+    static Transform scale(const Vec3& factor){
+        Transform t;
+        for(int i = 0; i < 3; ++i){
+            t.m[i][i] = factor[i];
+            t.inv[i][i] = 1 / factor[i];
+        }
+        return t;
+    }
+    static Transform scale(Real factor){ return scale(Vec3(factor, factor, factor)); }
+    // Counterclockwise around axis looking against it, in degrees.
+    static Transform rotate(const Vec3& axis, Real degrees){
+        Vec3 a = normalize(axis);
+        Real theta = degrees2radians(degrees);
+        Real s = std::sin(theta), c = std::cos(theta);
+        Transform t;
+        for(int i = 0; i < 3; ++i){
+            for(int j = 0; j < 3; ++j){
+                t.m[i][j] = a[i] * a[j] * (1 - c) + (i == j ? c : 0);
+            }
+        }
+        t.m[0][1] -= a.z() * s; t.m[0][2] += a.y() * s;
+        t.m[1][0] += a.z() * s; t.m[1][2] -= a.x() * s;
+        t.m[2][0] -= a.y() * s; t.m[2][1] += a.x() * s;
+        // Rotations are orthogonal.
+        for(int i = 0; i < 3; ++i){
+            for(int j = 0; j < 3; ++j){
+                t.inv[i][j] = t.m[j][i];
+            }
+        }
+        return t;
+    }
+
+    // Applies other first, then this.
+    Transform operator*(const Transform& other)const{
+        Transform t;
+        multiply(m, other.m, t.m);
+        multiply(other.inv, inv, t.inv);
+        return t;
+    }
+    Transform inverse()const{
+        Transform t;
+        for(int i = 0; i < 3; ++i){
+            for(int j = 0; j < 4; ++j){
+                t.m[i][j] = inv[i][j];
+                t.inv[i][j] = m[i][j];
+            }
+        }
+        return t;
+    }
+
+    Point3 point(const Point3& p)const{ return apply(m, p) + Vec3(m[0][3], m[1][3], m[2][3]); }
+    Vec3 vector(const Vec3& v)const{ return apply(m, v); }
+    // The inverse transpose keeps normals perpendicular to transformed surfaces.
+    Vec3 normal(const Vec3& n)const{
+        return Vec3(
+            inv[0][0]*n.x() + inv[1][0]*n.y() + inv[2][0]*n.z(),
+            inv[0][1]*n.x() + inv[1][1]*n.y() + inv[2][1]*n.z(),
+            inv[0][2]*n.x() + inv[1][2]*n.y() + inv[2][2]*n.z());
+    }
+    Point3 inversePoint(const Point3& p)const{ return apply(inv, p) + Vec3(inv[0][3], inv[1][3], inv[2][3]); }
+    Vec3 inverseVector(const Vec3& v)const{ return apply(inv, v); }
+
+    // Box around the eight transformed corners.
+    AABB box(const AABB& b)const{
+        AABB result;
+        if(b.empty()){
+            return result;
+        }
+        for(int corner = 0; corner < 8; ++corner){
+            result.expand(point(Point3(
+                corner & 1 ? b.max().x() : b.min().x(),
+                corner & 2 ? b.max().y() : b.min().y(),
+                corner & 4 ? b.max().z() : b.min().z())));
+        }
+        return result;
+    }
+
+    Point3 translation()const{ return Point3(m[0][3], m[1][3], m[2][3]); }
+    void setTranslation(const Point3& p){
+        for(int i = 0; i < 3; ++i){
+            m[i][3] = p[i];
+        }
+        Vec3 t = -apply(inv, p);
+        for(int i = 0; i < 3; ++i){
+            inv[i][3] = t[i];
+        }
+    }
+
+protected:
+    static Vec3 apply(const Real a[3][4], const Vec3& v){
+        return Vec3(
+            a[0][0]*v.x() + a[0][1]*v.y() + a[0][2]*v.z(),
+            a[1][0]*v.x() + a[1][1]*v.y() + a[1][2]*v.z(),
+            a[2][0]*v.x() + a[2][1]*v.y() + a[2][2]*v.z());
+    }
+    // c = a * b with the implicit last row (0, 0, 0, 1).
+    static void multiply(const Real a[3][4], const Real b[3][4], Real c[3][4]){
+        for(int i = 0; i < 3; ++i){
+            for(int j = 0; j < 4; ++j){
+                c[i][j] = a[i][0]*b[0][j] + a[i][1]*b[1][j] + a[i][2]*b[2][j] + (j == 3 ? a[i][3] : 0);
+            }
+        }
+    }
+
+    Real m[3][4], inv[3][4];
+};
+
+#endif
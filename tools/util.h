@@ -5,11 +5,17 @@
 #include <cmath>
 #include <functional>
 #include <random>
+#include <atomic>
+#include <cstdint>
+#include "real.h"
 #include "vec3.h"
 
-const double INF = std::numeric_limits<double>::max();
-const double TINY = 1e-6;
-const double PI = std::acos(-1.0);
+const Real INF = std::numeric_limits<Real>::max();
+const Real TINY = 1e-6;
+const Real PI = std::acos(Real(-1.0));
+// Relative epsilon for offsetting spawned ray origins off a surface.
+// It scales with the precision of Real, unlike the fixed TINY.
+const Real RAY_EPSILON = 256 * std::numeric_limits<Real>::epsilon();
 
 template<typename T>
 inline T clamp(T x, T min, T max) {
@@ -23,15 +29,65 @@ T interpolate(const T& begin, const T& end, double t){
     return (1.0 - t) * begin + t * end;
 }
 
+// One generator per thread, so render threads can sample at the same time.
+// The first thread gets the default seed, the others the following ones.
+inline std::mt19937& randomGenerator() {
+    static std::atomic<unsigned> threadCount(0);
+    thread_local std::mt19937 generator(std::mt19937::default_seed + threadCount++);
+    return generator;
+}
+
+// Restarts the calling thread's generator, for reproducible renders.
+inline void seedRandom(unsigned seed) {
+    randomGenerator().seed(seed);
+}
+
+// The splitmix64 finalizer, a cheap hash that mixes every input bit.
+inline std::uint64_t mixBits(std::uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// Counter-based random numbers for one sample of one pixel. Between
+// beginSample and endSample the thread's randomDouble returns the hash of
+// (seed, pixel, sample, dimension) for dimension 0, 1, 2, ..., so what a
+// sample draws does not depend on which thread renders it or what ran
+// before, and renders are the same for any thread count or tile order.
+struct SampleStream{
+    std::uint64_t key;
+    std::uint64_t dimension;
+    bool active;
+};
+
+inline SampleStream& sampleStream() {
+    thread_local SampleStream stream = {0, 0, false};
+    return stream;
+}
+
+inline void beginSample(std::uint64_t pixel, std::uint64_t sample, std::uint64_t seed = 0) {
+    SampleStream& stream = sampleStream();
+    stream.key = mixBits(mixBits(mixBits(seed) ^ pixel) ^ sample);
+    stream.dimension = 0;
+    stream.active = true;
+}
+
+inline void endSample() {
+    sampleStream().active = false;
+}
+
 inline double randomDouble(double min = 0.0, double max = 1.0) {
-    static std::uniform_real_distribution<double> distribution(0.0, 1.0);
-    static std::mt19937 generator;
-    static std::function<double()> randGenerator =
-        std::bind(distribution, generator);
-    return interpolate(min, max, randGenerator());
+    SampleStream& stream = sampleStream();
+    if(stream.active){
+        std::uint64_t bits = mixBits(stream.key + 0x9e3779b97f4a7c15ULL * ++stream.dimension);
+        // The top 53 bits, uniform in [0, 1).
+        return interpolate(min, max, (bits >> 11) * (1.0 / 9007199254740992.0));
+    }
+    std::uniform_real_distribution<double> distribution(0.0, 1.0);
+    return interpolate(min, max, distribution(randomGenerator()));
 }
 
-inline double degrees2radians(double degrees) {
+inline Real degrees2radians(Real degrees) {
     return degrees * PI / 180;
 }
 
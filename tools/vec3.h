@@ -3,37 +3,55 @@
 
 #include <cmath>
 #include <iostream> 
+#include "real.h"
 #include "util.h"
+#ifdef USE_SIMD_VEC3
+#include "simd.h"
+#endif
 
 using std::sqrt;
 
 class Vec3;
 inline std::ostream& operator<<(std::ostream &out, const Vec3 &v);
 inline Vec3 operator+(const Vec3 &u, const Vec3 &v);
-inline Vec3 operator+(const Vec3 &u, double t);
-inline Vec3 operator+(double t, const Vec3 &u);
+inline Vec3 operator+(const Vec3 &u, Real t);
+inline Vec3 operator+(Real t, const Vec3 &u);
 inline Vec3 operator-(const Vec3 &u, const Vec3 &v);
-inline Vec3 operator-(const Vec3 &u, double t);
-inline Vec3 operator-(double t, const Vec3 &u);
+inline Vec3 operator-(const Vec3 &u, Real t);
+inline Vec3 operator-(Real t, const Vec3 &u);
 inline Vec3 operator*(const Vec3 &u, const Vec3 &v);
-inline Vec3 operator*(double t, const Vec3 &v);
-inline Vec3 operator*(const Vec3 &v, double t);
-inline Vec3 operator/(const Vec3& v, double t);
-inline double dot(const Vec3 &u, const Vec3 &v);
+inline Vec3 operator*(Real t, const Vec3 &v);
+inline Vec3 operator*(const Vec3 &v, Real t);
+inline Vec3 operator/(const Vec3& v, Real t);
+inline Real dot(const Vec3 &u, const Vec3 &v);
 inline Vec3 cross(const Vec3 &u, const Vec3 &v);
 inline Vec3 normalize(const Vec3& v);
 
 class Vec3{
 public:
+#ifdef USE_SIMD_VEC3
+    Vec3(const Vec3& v){ lane4Store(e, v.lanes()); }
+    Vec3(Real e0 = 0.0, Real e1 = 0.0, Real e2 = 0.0){ lane4Store(e, lane4Set(e0, e1, e2)); }
+    explicit Vec3(Lane4 v){ lane4Store(e, v); }
+    Lane4 lanes() const { return lane4Load(e); }
+#else
     Vec3(const Vec3& v): e{v.e[0], v.e[1], v.e[2]}{}
-    Vec3(double e0 = 0.0, double e1 = 0.0, double e2 = 0.0): e{e0, e1, e2}{}
-    double x() const { return e[0]; }
-    double y() const { return e[1]; }
-    double z() const { return e[2]; }
-    double r() const { return e[0]; }
-    double g() const { return e[1]; }
-    double b() const { return e[2]; }
+    Vec3(Real e0 = 0.0, Real e1 = 0.0, Real e2 = 0.0): e{e0, e1, e2}{}
+#endif
+    Real x() const { return e[0]; }
+    Real y() const { return e[1]; }
+    Real z() const { return e[2]; }
+    Real r() const { return e[0]; }
+    Real g() const { return e[1]; }
+    Real b() const { return e[2]; }
     
+#ifdef USE_SIMD_VEC3
+    Vec3& operator=(const Vec3& v){
+        lane4Store(e, v.lanes());
+        return *this;
+    }
+    Vec3 operator-() const{ return Vec3(lane4Neg(lanes())); }
+#else
     Vec3& operator=(const Vec3& v){
         this->e[0] = v.e[0];
         this->e[1] = v.e[1];
@@ -41,9 +59,21 @@ public:
         return *this;
     }
     Vec3 operator-() const{ return Vec3(-e[0], -e[1], -e[2]); }
-    double operator[](int i) const{ return e[i];}
-    double& operator[](int i){return e[i];}
+#endif
+    Real operator[](int i) const{ return e[i];}
+    Real& operator[](int i){return e[i];}
     
+#ifdef USE_SIMD_VEC3
+    Vec3& operator+=(const Vec3 &v) {
+        lane4Store(e, lane4Add(lanes(), v.lanes()));
+        return *this;
+    }
+
+    Vec3& operator*=(const Real t) {
+        lane4Store(e, lane4Mul(lanes(), lane4Set1(t)));
+        return *this;
+    }
+#else
     Vec3& operator+=(const Vec3 &v) {
         e[0] += v.e[0];
         e[1] += v.e[1];
@@ -51,38 +81,49 @@ public:
         return *this;
     }
 
-    Vec3& operator*=(const double t) {
+    Vec3& operator*=(const Real t) {
         e[0] *= t;
         e[1] *= t;
         e[2] *= t;
         return *this;
     }
+#endif
 
-    Vec3& operator/=(const double t) {
+    Vec3& operator/=(const Real t) {
         return *this *= 1/t;
     }
 
-    double length() const {
+    Real length() const {
         return sqrt(lengthSquared());
     }
 
-    double lengthSquared() const {
+#ifdef USE_SIMD_VEC3
+    Real lengthSquared() const {
+        return lane4Dot3(lanes(), lanes());
+    }
+    
+    Vec3 normalized() const {
+        return Vec3(lane4Mul(lanes(), lane4Set1(1 / length())));
+    }
+#else
+    Real lengthSquared() const {
         return e[0]*e[0] + e[1]*e[1] + e[2]*e[2];
     }
     
     Vec3 normalized() const {
-        double len = length();
+        Real len = length();
         return Vec3(e[0] / len, e[1] / len, e[2] / len);
     }
+#endif
     
-    inline static Vec3 random(double min = 0.0, double max = 1.0){
+    inline static Vec3 random(Real min = 0.0, Real max = 1.0){
         return Vec3(
             randomDouble(min, max), 
             randomDouble(min, max), 
             randomDouble(min, max));
     }
     
-    inline static Vec3 randomVectorCircle(double radius = 1.0){
+    inline static Vec3 randomVectorCircle(Real radius = 1.0){
         auto phi = randomDouble(0, 2*PI);
         return Vec3(
             radius*cos(phi),
@@ -90,14 +131,14 @@ public:
             0);
     }
     
-    inline static Vec3 randomVectorInDisk(double maxRadius = 1.0){
+    inline static Vec3 randomVectorInDisk(Real maxRadius = 1.0){
         auto x = randomDouble(-maxRadius, maxRadius);
         auto border = sqrt(maxRadius*maxRadius - x*x);
         auto y = randomDouble(-border, border);
         return Vec3(x, y, 0);
     }
     
-    inline static Vec3 randomVectorSphere(double radius = 1.0){
+    inline static Vec3 randomVectorSphere(Real radius = 1.0){
         auto phi = randomDouble(0, 2*PI);
         auto theta = randomDouble(0, PI);
         return Vec3(
@@ -106,7 +147,7 @@ public:
             radius*cos(theta));
     }
     
-    inline static Vec3 randomVectorPillar(double radius = 1.0){
+    inline static Vec3 randomVectorPillar(Real radius = 1.0){
         auto z = randomDouble(-1, 1);
         auto phi = randomDouble(0, 2*PI);
         auto r = sqrt(1 - z*z);
@@ -116,8 +157,9 @@ public:
             radius*z);
     }
     
-    inline static Vec3 randomVectorHemisphere(double radius = 1.0, const Vec3& axis = Vec3(0, 0, 1)){
-        Vec3 vec = randomVectorSphere(radius);
+    // Uniform over the solid angle of the hemisphere around axis.
+    inline static Vec3 randomVectorHemisphere(Real radius = 1.0, const Vec3& axis = Vec3(0, 0, 1)){
+        Vec3 vec = randomVectorPillar(radius);
         if(dot(vec, axis) < 0){
             return -vec;
         }
@@ -130,7 +172,7 @@ public:
         return out;
     }
     
-    inline static Vec3 refract(const Vec3& in, const Vec3& norm, double etaiOverEtat){
+    inline static Vec3 refract(const Vec3& in, const Vec3& norm, Real etaiOverEtat){
         auto length = in.length();
         Vec3 inUnit = in / length;
         auto cosTheta = dot(-inUnit, norm);
@@ -141,12 +183,26 @@ public:
         return length * (outUnitPara + outUnitPerp);
     }
     
+    // u, v, w form a right-handed orthonormal basis for a unit vector w.
+    inline static void orthonormalBasis(const Vec3& w, Vec3& u, Vec3& v){
+        Real sign = w.z() >= 0 ? 1 : -1;
+        Real a = -1 / (sign + w.z());
+        Real b = w.x() * w.y() * a;
+        u = Vec3(1 + sign * w.x() * w.x() * a, sign * b, -sign * w.x());
+        v = Vec3(b, sign + w.y() * w.y() * a, -w.y());
+    }
+    
     // norm is a unit vector
     inline static Vec3 halfVec(const Vec3& in, const Vec3& norm){
         return normalize(normalize(in) + norm);
     }
 protected:
-    double e[3];
+#ifdef USE_SIMD_VEC3
+    // Padded to 4 lanes, the last one stays 0.
+    alignas(4 * sizeof(Real)) Real e[4];
+#else
+    Real e[3];
+#endif
 };
 
 // Vec3 Utility Functions
@@ -155,15 +211,71 @@ inline std::ostream& operator<<(std::ostream &out, const Vec3 &v) {
     return out << v[0] << ' ' << v[1] << ' ' << v[2];
 }
 
+#ifdef USE_SIMD_VEC3
+
+inline Vec3 operator+(const Vec3 &u, const Vec3 &v) {
+    return Vec3(lane4Add(u.lanes(), v.lanes()));
+}
+
+inline Vec3 operator+(const Vec3 &u, Real t) {
+    return Vec3(lane4Add(u.lanes(), lane4Set(t, t, t)));
+}
+
+inline Vec3 operator+(Real t, const Vec3 &u) {
+    return u + t;
+}
+
+inline Vec3 operator-(const Vec3 &u, const Vec3 &v) {
+    return Vec3(lane4Sub(u.lanes(), v.lanes()));
+}
+
+inline Vec3 operator-(const Vec3 &u, Real t) {
+    return Vec3(lane4Sub(u.lanes(), lane4Set(t, t, t)));
+}
+
+inline Vec3 operator-(Real t, const Vec3 &u) {
+    return Vec3(lane4Sub(lane4Set(t, t, t), u.lanes()));
+}
+
+inline Vec3 operator*(const Vec3 &u, const Vec3 &v) {
+    return Vec3(lane4Mul(u.lanes(), v.lanes()));
+}
+
+inline Vec3 operator*(Real t, const Vec3 &v) {
+    return Vec3(lane4Mul(lane4Set1(t), v.lanes()));
+}
+
+inline Vec3 operator*(const Vec3 &v, Real t) {
+    return t * v;
+}
+
+inline Vec3 operator/(const Vec3& v, Real t) {
+    return (1/t) * v;
+}
+
+inline Real dot(const Vec3 &u, const Vec3 &v) {
+    return lane4Dot3(u.lanes(), v.lanes());
+}
+
+inline Vec3 cross(const Vec3 &u, const Vec3 &v) {
+    return Vec3(lane4Cross(u.lanes(), v.lanes()));
+}
+
+inline Vec3 normalize(const Vec3& v) {
+    return v.normalized();
+}
+
+#else
+
 inline Vec3 operator+(const Vec3 &u, const Vec3 &v) {
     return Vec3(u[0] + v[0], u[1] + v[1], u[2] + v[2]);
 }
 
-inline Vec3 operator+(const Vec3 &u, double t) {
+inline Vec3 operator+(const Vec3 &u, Real t) {
     return Vec3(u[0] + t, u[1] + t, u[2] + t);
 }
 
-inline Vec3 operator+(double t, const Vec3 &u) {
+inline Vec3 operator+(Real t, const Vec3 &u) {
     return u + t;
 }
 
@@ -171,11 +283,11 @@ inline Vec3 operator-(const Vec3 &u, const Vec3 &v) {
     return Vec3(u[0] - v[0], u[1] - v[1], u[2] - v[2]);
 }
 
-inline Vec3 operator-(const Vec3 &u, double t) {
+inline Vec3 operator-(const Vec3 &u, Real t) {
     return Vec3(u[0] - t, u[1] - t, u[2] - t);
 }
 
-inline Vec3 operator-(double t, const Vec3 &u) {
+inline Vec3 operator-(Real t, const Vec3 &u) {
     return Vec3(t - u[0], t - u[1], t - u[2]);
 }
 
@@ -183,19 +295,19 @@ inline Vec3 operator*(const Vec3 &u, const Vec3 &v) {
     return Vec3(u[0] * v[0], u[1] * v[1], u[2] * v[2]);
 }
 
-inline Vec3 operator*(double t, const Vec3 &v) {
+inline Vec3 operator*(Real t, const Vec3 &v) {
     return Vec3(t*v[0], t*v[1], t*v[2]);
 }
 
-inline Vec3 operator*(const Vec3 &v, double t) {
+inline Vec3 operator*(const Vec3 &v, Real t) {
     return t * v;
 }
 
-inline Vec3 operator/(const Vec3& v, double t) {
+inline Vec3 operator/(const Vec3& v, Real t) {
     return (1/t) * v;
 }
 
-inline double dot(const Vec3 &u, const Vec3 &v) {
+inline Real dot(const Vec3 &u, const Vec3 &v) {
     return u[0] * v[0]
          + u[1] * v[1]
          + u[2] * v[2];
@@ -211,6 +323,8 @@ inline Vec3 normalize(const Vec3& v) {
     return v / v.length();
 }
 
+#endif
+
 using Point3 = Vec3;
 using Color = Vec3;
 using RGB = Vec3;